@@ -31,6 +31,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Utils.h"
 
 #include <QString>
+#include <QVector>
+#include <cstdlib>
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -178,33 +180,111 @@ AbstractAudioReader* AbstractAudioReader::create_audio_reader(const QString& fil
     return newReader;
 }
 
+static const int POOL_ALIGNMENT = 64;
+static const int POOL_MIN_CLASS = 10;	// 1024 samples
+static const int POOL_CLASSES = 14;	// up to 8M samples
+static const int POOL_BLOCKS_PER_CLASS = 8;
+
+static thread_local bool threadBlockPoolGone = false;
+
+// The free blocks of one thread, they are freed when the thread exits
+struct ThreadBlockPool {
+    ~ThreadBlockPool() {
+        threadBlockPoolGone = true;
+        for (int i = 0; i < POOL_CLASSES; ++i) {
+            foreach(audio_sample_t* block, freeBlocks[i]) {
+                free(block);
+            }
+        }
+    }
+
+    QVector<audio_sample_t*> freeBlocks[POOL_CLASSES];
+};
+
+static thread_local ThreadBlockPool threadBlockPool;
+
+
+static int size_class(uint size)
+{
+    int sizeClass = 0;
+    while (sizeClass < POOL_CLASSES && (1u << (POOL_MIN_CLASS + sizeClass)) < size) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+
+/**
+ * Returns a block of at least \a size samples, \a size is set to the
+ * real size of the block. Blocks bigger then the largest size class are
+ * allocated for this request only.
+ */
+audio_sample_t* DecodeBufferPool::acquire(uint& size)
+{
+    int sizeClass = size_class(size);
+
+    if (sizeClass < POOL_CLASSES) {
+        size = 1u << (POOL_MIN_CLASS + sizeClass);
+    }
+
+    if (sizeClass < POOL_CLASSES && !threadBlockPoolGone) {
+        QVector<audio_sample_t*>& freeBlocks = threadBlockPool.freeBlocks[sizeClass];
+        if (!freeBlocks.isEmpty()) {
+            audio_sample_t* block = freeBlocks.last();
+            freeBlocks.removeLast();
+            return block;
+        }
+    }
+
+    void* block = nullptr;
+#ifdef NO_POSIX_MEMALIGN
+    block = malloc(size * sizeof(audio_sample_t));
+#else
+    if (posix_memalign(&block, POOL_ALIGNMENT, size * sizeof(audio_sample_t))) {
+        block = nullptr;
+    }
+#endif
+    if (!block) {
+        qFatal("DecodeBufferPool: could not allocate %u samples", size);
+    }
+
+    return static_cast<audio_sample_t*>(block);
+}
+
+
+// Keeps the block for reuse by the calling thread, blocks released by
+// another thread then the one that acquired them simply change pool.
+void DecodeBufferPool::release(audio_sample_t* block, uint size)
+{
+    if (!block) {
+        return;
+    }
+
+    int sizeClass = size_class(size);
+
+    // DecodeBuffers deleted on exit can outlive the pool of the main thread
+    if (sizeClass < POOL_CLASSES && size == (1u << (POOL_MIN_CLASS + sizeClass)) && !threadBlockPoolGone) {
+        QVector<audio_sample_t*>& freeBlocks = threadBlockPool.freeBlocks[sizeClass];
+        if (freeBlocks.size() < POOL_BLOCKS_PER_CLASS) {
+            freeBlocks.append(block);
+            return;
+        }
+    }
+
+    free(block);
+}
+
+
 DecodeBuffer::DecodeBuffer()
 {
     destination = nullptr;
     readBuffer = nullptr;
     m_channels = destinationBufferSize = readBufferSize = 0;
-    m_bufferSizeCheckCounter = m_totalCheckSize = m_smallerReadCounter = 0;
 }
 
 
 void DecodeBuffer::check_buffers_capacity(uint size, uint channels)
 {
-/*	m_bufferSizeCheckCounter++;
-    m_totalCheckSize += size;
-
-    float meanvalue = (m_totalCheckSize / (float)m_bufferSizeCheckCounter);
-
-    if (meanvalue < destinationBufferSize && ((meanvalue + 256) < destinationBufferSize) && !(destinationBufferSize == size)) {
-        m_smallerReadCounter++;
-        if (m_smallerReadCounter > 8) {
-            delete_destination_buffers();
-            delete_readbuffer();
-            m_bufferSizeCheckCounter = m_smallerReadCounter = 0;
-            m_totalCheckSize = 0;
-        }
-    }*/
-
-
     if (destinationBufferSize < size || m_channels < channels) {
 
         delete_destination_buffers();
@@ -213,20 +293,22 @@ void DecodeBuffer::check_buffers_capacity(uint size, uint channels)
 
         destination = new audio_sample_t*[m_channels];
 
+        uint blockSize = size;
         for (uint chan = 0; chan < m_channels; chan++) {
-            destination[chan] = new audio_sample_t[size];
+            blockSize = size;
+            destination[chan] = DecodeBufferPool::acquire(blockSize);
         }
 
-        destinationBufferSize = size;
-// 		printf("resizing destination to %.3f KB\n", (float)size*4/1024);
+        destinationBufferSize = blockSize;
     }
 
     if (readBufferSize < (size*m_channels)) {
 
         delete_readbuffer();
 
-        readBuffer = new audio_sample_t[size*m_channels];
-        readBufferSize = (size*m_channels);
+        uint blockSize = size * m_channels;
+        readBuffer = DecodeBufferPool::acquire(blockSize);
+        readBufferSize = blockSize;
     }
 }
 
@@ -234,7 +316,7 @@ void DecodeBuffer::delete_destination_buffers()
 {
     if (destination) {
         for (uint chan = 0; chan < m_channels; chan++) {
-            delete [] destination[chan];
+            DecodeBufferPool::release(destination[chan], destinationBufferSize);
         }
 
         delete [] destination;
@@ -249,7 +331,7 @@ void DecodeBuffer::delete_readbuffer()
 {
     if (readBuffer) {
 
-        delete [] readBuffer;
+        DecodeBufferPool::release(readBuffer, readBufferSize);
 
         readBuffer = nullptr;
         readBufferSize = 0;
@@ -26,6 +26,16 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include <QString>
 
+// Hands out 64 byte aligned sample blocks in power of two size classes.
+// Released blocks are kept per thread for reuse, so the DecodeBuffers of
+// the readers, the peak builder and the export don't keep reallocating.
+class DecodeBufferPool {
+
+public:
+	static audio_sample_t* acquire(uint& size);
+	static void release(audio_sample_t* block, uint size);
+};
+
 class DecodeBuffer {
 	
 public:
@@ -44,13 +54,9 @@ public:
 
 private:
 	uint m_channels;
-	uint m_smallerReadCounter;
-	quint64 m_totalCheckSize;
-	uint m_bufferSizeCheckCounter;
 	
 	void delete_destination_buffers();
 	void delete_readbuffer();
-	void delete_resample_buffers();
 
 };
 
@@ -74,6 +80,8 @@ public:
 	
 	bool is_valid() {return (m_channels > 0 && m_nframes > 0);}
 	virtual QString decoder_type() const = 0;
+	// Bit depth of integer PCM data, 0 for floating point or lossy formats
+	virtual uint get_bit_depth() const {return 0;}
 	virtual void clear_buffers() {}
 	
 	static AbstractAudioReader* create_audio_reader(const QString& filename, const QString& decoder = 0);
@@ -28,6 +28,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QFile>
 #include <QString>
 #include "Utils.h"
+#include "Mixer.h"
 
 #include "FLAC/export.h"
 
@@ -162,6 +163,8 @@ class FlacPrivate
 		uint m_bitsPerSample{};
 		uint m_samples{};
 		
+		// One decoded FLAC frame, bufferUsed samples per channel stored one
+		// channel after the other, bufferStart samples of which are consumed
 		audio_sample_t	*internalBuffer;
 		int		bufferSize;
 		int		bufferUsed;
@@ -207,8 +210,6 @@ FLAC__StreamDecoderWriteStatus FlacPrivate::write_callback(const FLAC__StreamDec
 	
 	FlacPrivate *fp = (FlacPrivate*)client_data;
 	
-	uint		c;
-	nframes_t	pos = 0;
 	nframes_t	frames = frame->header.blocksize;
 	
 	if (fp->bufferUsed > 0) {
@@ -224,15 +225,13 @@ FLAC__StreamDecoderWriteStatus FlacPrivate::write_callback(const FLAC__StreamDec
 		fp->bufferSize = frames * frame->header.channels;
 	}
 	
-	for (nframes_t i=0; i < frames; i++) {
-		// in FLAC channel 0 is left, 1 is right
-		for (c=0; c < frame->header.channels; c++) {
-			audio_sample_t value = (audio_sample_t)((float)buffer[c][i] / (float)((uint)1<<(frame->header.bits_per_sample-1)));
-			fp->internalBuffer[pos++] = value;
-		}
+	// The samples are stored per channel, in FLAC channel 0 is left, 1 is right
+	const float scale = 1.0f / (float)((uint)1<<(frame->header.bits_per_sample-1));
+	for (uint c=0; c < frame->header.channels; c++) {
+		Mixer::convert_s32_to_float((const int*)buffer[c], fp->internalBuffer + c * frames, frames, scale);
 	}
 	
-	fp->bufferUsed = frames * frame->header.channels;
+	fp->bufferUsed = frames;
 	
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
@@ -414,6 +413,12 @@ void FlacAudioReader::clear_buffers()
 }
 
 
+uint FlacAudioReader::get_bit_depth() const
+{
+	return m_flac ? m_flac->m_bitsPerSample : 0;
+}
+
+
 bool FlacAudioReader::can_decode(const QString& filename)
 {
 	if (!libFLAC_is_present) {
@@ -556,25 +561,10 @@ nframes_t FlacAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCou
 #endif
 		}
 		
-		framesAvailable = (m_flac->bufferUsed - m_flac->bufferStart) / get_num_channels() ;
+		framesAvailable = m_flac->bufferUsed - m_flac->bufferStart;
 		framesToCopy = (frameCount - framesCoppied < framesAvailable) ? frameCount - framesCoppied : framesAvailable;
-		switch (get_num_channels()) {
-			case 1:
-				memcpy(buffer->destination[0] + framesCoppied, m_flac->internalBuffer + m_flac->bufferStart, framesToCopy * sizeof(audio_sample_t));
-				break;
-			case 2:
-				for (nframes_t i = 0; i < framesToCopy; i++) {
-					buffer->destination[0][framesCoppied + i] = m_flac->internalBuffer[m_flac->bufferStart + i * 2];
-					buffer->destination[1][framesCoppied + i] = m_flac->internalBuffer[m_flac->bufferStart + i * 2 + 1];
-				}
-				break;
-			default:
-				for (nframes_t i = 0; i < framesToCopy; i++) {
-					for (int c = 0; c < get_num_channels(); c++) {
-						buffer->destination[c][framesCoppied + i] = m_flac->internalBuffer[m_flac->bufferStart + i * get_num_channels() + c];
-					}
-				}
-				break;
+		for (uint c = 0; c < get_num_channels(); c++) {
+			memcpy(buffer->destination[c] + framesCoppied, m_flac->internalBuffer + c * m_flac->bufferUsed + m_flac->bufferStart, framesToCopy * sizeof(audio_sample_t));
 		}
 		
 		if(framesToCopy == framesAvailable) {
@@ -582,7 +572,7 @@ nframes_t FlacAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCou
 			m_flac->bufferStart = 0;
 		}
 		else {
-			m_flac->bufferStart += framesToCopy * get_num_channels();
+			m_flac->bufferStart += framesToCopy;
 		}
 		framesCoppied += framesToCopy;
 	}
@@ -34,6 +34,7 @@ public:
 	~FlacAudioReader();
 	
 	QString decoder_type() const {return "flac";}
+	uint get_bit_depth() const;
 	void clear_buffers();
 
 	static bool can_decode(const QString &filename);
@@ -23,10 +23,25 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include "MadAudioReader.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDataStream>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QString>
 #include <QVector>
+#include <QStringList>
+
+#if defined (Q_OS_UNIX)
+#include <utime.h>
+#endif
 
 #include "Utils.h"
+#include "Mixer.h"
+#include "TConfig.h"
 
 RELAYTOOL_MAD;
 
@@ -37,6 +52,90 @@ RELAYTOOL_MAD;
 
 static const int INPUT_BUFFER_SIZE = 5*8192;
 
+// Bump when the layout of the seek index files changes
+static const qint32 SEEK_INDEX_VERSION = 1;
+static const int SEEK_INDEX_HASH_SIZE = 16384;
+
+
+// Building the seek index needs a scan of the complete mp3 file, which is
+// slow for long files. The index is stored in ~/.traverso/mp3index and kept
+// in memory, so opening the same file again (deep copies of ReadSources,
+// peak building, ...) doesn't need the scan. The least recently used index
+// files are removed once the directory exceeds the mp3indexquota setting.
+struct MadSeekIndex
+{
+    QVector<unsigned long long> seekPositions;
+    mad_header	firstHeader;
+    unsigned long	frames;
+    bool		vbr;
+    qint64		fileSize;
+    qint64		modified;
+    QByteArray	headerHash;
+};
+
+static QCache<QString, MadSeekIndex> seekIndexCache(16 * 1024);
+static QMutex seekIndexMutex;
+
+static QString seek_index_filename(const QString& filename)
+{
+    QByteArray key = QCryptographicHash::hash(QFileInfo(filename).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QDir::homePath() + "/.traverso/mp3index/" + key.toHex() + ".idx";
+}
+
+// Marks the index file as recently used, pruning removes the
+// index files with the oldest modification time first.
+static void touch_seek_index(const QString& indexFile)
+{
+#if defined (Q_OS_UNIX)
+    utime(QFile::encodeName(indexFile).constData(), nullptr);
+#else
+    Q_UNUSED(indexFile);
+#endif
+}
+
+// Removes the least recently used index files until the index
+// directory fits within the quota again.
+static void prune_seek_indexes(const QString& indexDir)
+{
+    qint64 quota = qint64(config().get_property("Hardware", "mp3indexquota", 64).toInt()) * 1024 * 1024;
+
+    QDir dir(indexDir);
+    QFileInfoList files = dir.entryInfoList(QStringList() << "*.idx", QDir::Files, QDir::Time | QDir::Reversed);
+
+    qint64 used = 0;
+    foreach(const QFileInfo& info, files) {
+        used += info.size();
+    }
+
+    for (int i = 0; i < files.size() && used > quota; ++i) {
+        if (QFile::remove(files.at(i).absoluteFilePath())) {
+            used -= files.at(i).size();
+        }
+    }
+}
+
+// File size and modification time catch most changes, the hash of the start
+// of the file catches files replaced by a file with the same size and mtime.
+static bool get_file_signature(const QString& filename, qint64& size, qint64& modified, QByteArray& hash)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QFileInfo info(filename);
+    size = info.size();
+    modified = info.lastModified().toMSecsSinceEpoch();
+    hash = QCryptographicHash::hash(file.read(SEEK_INDEX_HASH_SIZE), QCryptographicHash::Sha1);
+
+    return true;
+}
+
+static int seek_index_cost(const MadSeekIndex* index)
+{
+    return int((index->seekPositions.size() * sizeof(unsigned long long)) / 1024) + 1;
+}
+
 
 K3bMad::K3bMad()
   : m_madStructuresInitialized(false),
@@ -440,7 +539,10 @@ MadAudioReader::MadAudioReader(const QString& filename)
 
     initDecoderInternal();
 
-    m_nframes = countFrames();
+    if (!loadSeekIndex()) {
+        m_nframes = countFrames();
+        saveSeekIndex();
+    }
 
     switch( d->firstHeader.mode ) {
         case MAD_MODE_SINGLE_CHANNEL:
@@ -733,6 +835,115 @@ unsigned long MadAudioReader::countFrames()
 }
 
 
+// Fills in the seek positions, first header, vbr flag and frame count from
+// the in memory or on disk index of this file, if it's still valid.
+bool MadAudioReader::loadSeekIndex()
+{
+    qint64 size, modified;
+    QByteArray hash;
+
+    if (!get_file_signature(m_fileName, size, modified, hash)) {
+        return false;
+    }
+
+    QMutexLocker locker(&seekIndexMutex);
+
+    MadSeekIndex* index = seekIndexCache.object(m_fileName);
+
+    if (!index || index->fileSize != size || index->modified != modified || index->headerHash != hash) {
+        QFile file(seek_index_filename(m_fileName));
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+
+        QDataStream stream(&file);
+        qint32 version, headerSize;
+        qint64 fileSize, fileModified;
+        QByteArray fileHash, header;
+        quint64 frames;
+        bool vbr;
+        QVector<unsigned long long> seekPositions;
+
+        stream >> version >> headerSize >> fileSize >> fileModified >> fileHash;
+
+        if (version != SEEK_INDEX_VERSION || headerSize != qint32(sizeof(mad_header)) ||
+            fileSize != size || fileModified != modified || fileHash != hash) {
+            return false;
+        }
+
+        stream >> frames >> vbr >> header >> seekPositions;
+
+        if (stream.status() != QDataStream::Ok || header.size() != int(sizeof(mad_header)) || seekPositions.isEmpty()) {
+            return false;
+        }
+
+        file.close();
+        touch_seek_index(file.fileName());
+
+        index = new MadSeekIndex;
+        index->seekPositions = seekPositions;
+        memcpy(&index->firstHeader, header.constData(), sizeof(mad_header));
+        index->frames = frames;
+        index->vbr = vbr;
+        index->fileSize = size;
+        index->modified = modified;
+        index->headerHash = hash;
+
+        seekIndexCache.insert(m_fileName, index, seek_index_cost(index));
+    }
+
+    // QVector is implicitly shared, so all readers of this file use the same data
+    d->seekPositions = index->seekPositions;
+    d->firstHeader = index->firstHeader;
+    d->vbr = index->vbr;
+    m_nframes = index->frames;
+
+    return true;
+}
+
+
+// Stores the result of countFrames() in memory and on disk
+void MadAudioReader::saveSeekIndex()
+{
+    if (m_nframes <= 0 || d->seekPositions.isEmpty()) {
+        return;
+    }
+
+    MadSeekIndex* index = new MadSeekIndex;
+
+    if (!get_file_signature(m_fileName, index->fileSize, index->modified, index->headerHash)) {
+        delete index;
+        return;
+    }
+
+    index->seekPositions = d->seekPositions;
+    index->firstHeader = d->firstHeader;
+    index->frames = m_nframes;
+    index->vbr = d->vbr;
+
+    QMutexLocker locker(&seekIndexMutex);
+
+    QString filename = seek_index_filename(m_fileName);
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+
+    QFile file(filename);
+    if (file.open(QIODevice::WriteOnly)) {
+        QDataStream stream(&file);
+        stream << SEEK_INDEX_VERSION << qint32(sizeof(mad_header))
+               << index->fileSize << index->modified << index->headerHash
+               << quint64(index->frames) << index->vbr
+               << QByteArray(reinterpret_cast<const char*>(&index->firstHeader), sizeof(mad_header))
+               << index->seekPositions;
+        file.close();
+        prune_seek_indexes(QFileInfo(filename).absolutePath());
+    } else {
+        qWarning("MadAudioReader: Could not write seek index %s", QS_C(filename));
+    }
+
+    seekIndexCache.insert(m_fileName, index, seek_index_cost(index));
+}
+
+
 nframes_t MadAudioReader::read_private(DecodeBuffer* buffer, nframes_t frameCount)
 {
     d->outputBuffers = buffer->destination;
@@ -812,35 +1023,31 @@ bool MadAudioReader::createPcmSamples(mad_synth* synth)
         nframes = m_nframes - (m_readPos + offset);
     }
 
-    // now create the output
-    for (i = 0; i < nframes; i++) {
-        if (overflow == false && d->outputPos + i >= d->outputSize) {
-            writeBuffers = d->overflowBuffers;
-            offset = 0 - i;
-            overflow = true;
+    // now create the output, the frames which don't fit in the output
+    // buffers go to the overflow buffers
+    const float scale = 1.0f / float(1L << MAD_F_FRACBITS);
+    nframes_t outputSpace = (d->outputPos < d->outputSize) ? nframes_t(d->outputSize - d->outputPos) : 0;
+    i = qMin(nframes, outputSpace);
+    overflow = (i < nframes);
+
+    for (uint c = 0; c < synth->pcm.channels && c < 2; c++) {
+        /* The right channel isn't there if the decoded stream is monophonic */
+        if (i) {
+            Mixer::convert_s32_to_float((const int*)synth->pcm.samples[c], writeBuffers[c] + offset, i, scale);
         }
-
-        /* Left channel */
-        writeBuffers[0][offset + i] = mad_f_todouble(synth->pcm.samples[0][i]);
-
-        /* Right channel. If the decoded stream is monophonic then no right channel
-        */
-        if (synth->pcm.channels == 2) {
-            writeBuffers[1][offset + i] = mad_f_todouble(synth->pcm.samples[1][i]);
+        if (overflow) {
+            Mixer::convert_s32_to_float((const int*)synth->pcm.samples[c] + i, d->overflowBuffers[c], nframes - i, scale);
         }
     } // pcm conversion
 
     if (overflow) {
-        d->overflowSize = i + offset;
+        d->overflowSize = nframes - i;
         d->overflowStart = 0;
-        d->outputPos -= offset; // i was stored here when we switched to writing to overflow
-        //printf("written: %d (overflow: %u)\n",  nframes - d->overflowSize, d->overflowSize);
-    }
-    else {
-        d->outputPos += i;
-        //printf("written: %d (os=%lu)\n",  i, d->overflowSize);
+        //printf("written: %d (overflow: %u)\n",  i, d->overflowSize);
     }
 
+    d->outputPos += i;
+
     return true;
 }
 
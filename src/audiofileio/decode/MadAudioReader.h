@@ -118,6 +118,8 @@ protected:
 	void create_buffers();
 	bool initDecoderInternal();
 	unsigned long countFrames();
+	bool loadSeekIndex();
+	void saveSeekIndex();
 	bool createPcmSamples(mad_synth* synth);
 	
 	static int	MaxAllowedRecoverableErrors;
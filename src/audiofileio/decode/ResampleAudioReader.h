@@ -42,6 +42,8 @@ public:
 		return AbstractAudioReader::read_from(buffer, location.to_frame(m_outputRate), count);
 	}
 	QString decoder_type() const {return (m_reader) ? m_reader->decoder_type() : "";}
+	// Resampled data is no longer integer PCM
+	uint get_bit_depth() const {return (m_reader && m_outputRate == m_rate) ? m_reader->get_bit_depth() : 0;}
 	void clear_buffers();
 	
 	uint get_output_rate();
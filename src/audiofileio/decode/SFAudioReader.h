@@ -34,6 +34,7 @@ public:
 	~SFAudioReader();
 	
 	QString decoder_type() const {return "sndfile";}
+	uint get_bit_depth() const;
 	
 	static bool can_decode(QString filename);
 
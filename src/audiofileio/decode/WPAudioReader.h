@@ -33,6 +33,7 @@ public:
 	~WPAudioReader();
 	
 	QString decoder_type() const {return "wavpack";}
+	uint get_bit_depth() const {return m_isFloat ? 0 : uint(m_bytesPerSample * 8);}
 	
 	static bool can_decode(const QString& filename);
 
@@ -24,6 +24,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include <QString>
 
+#if defined (Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#endif
+
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
 #include "Debugger.h"
@@ -36,6 +44,12 @@ SFAudioWriter::SFAudioWriter()
 }
 
 
+// Recording files are written to disk in batches of this size. It's a
+// multiple of the logical block size, as O_DIRECT requires.
+static const qint64 RECORDING_BATCH_SIZE = 1024 * 1024;
+static const qint64 RECORDING_ALIGNMENT = 4096;
+
+
 SFAudioWriter::~SFAudioWriter()
 {
 	if (m_sf) {
@@ -82,6 +96,20 @@ bool SFAudioWriter::set_format_attribute(const QString& key, const QString& valu
 			return true;
 		}
 	}
+	// Recording attributes, only used on Linux, ignored elsewhere
+	else if (key == "recording") {
+		m_recording = (value == "true");
+		return true;
+	}
+	else if (key == "directio") {
+		m_directIO = (value == "true");
+		return true;
+	}
+	else if (key == "preallocate") {
+		// in MB
+		m_preallocateSize = value.toLongLong() * 1024 * 1024;
+		return true;
+	}
 	
 	return false;
 }
@@ -98,6 +126,12 @@ bool SFAudioWriter::open_private()
 	m_sfinfo.channels = m_channels;
 	//m_sfinfo.frames = m_spec->endLocation - m_spec->startLocation + 1;
 	
+#if defined (Q_OS_LINUX)
+	if (m_recording) {
+		return open_recording_file();
+	}
+#endif
+
 	m_file.setFileName(m_fileName);
 	
 	if (!m_file.open(QIODevice::WriteOnly)) {
@@ -156,6 +190,12 @@ bool SFAudioWriter::close_private()
 	bool success = (sf_close(m_sf) == 0);
 	
 	m_sf = nullptr;
+
+#if defined (Q_OS_LINUX)
+	if (m_fd >= 0 && !close_recording_file()) {
+		success = false;
+	}
+#endif
 	
 	return success;
 }
@@ -186,3 +226,276 @@ int SFAudioWriter::get_sf_format()
 	return (sfBitDepth | m_fileType);
 }
 
+
+#if defined (Q_OS_LINUX)
+
+// Opens the recording file with O_DIRECT if requested and supported by the
+// file system, the batches bypass the page cache then. Without O_DIRECT,
+// written batches are flushed asynchronously and dropped from the page
+// cache, so recording doesn't push the playback data out of it.
+bool SFAudioWriter::open_recording_file()
+{
+	char errbuf[256];
+	QByteArray fileName = QFile::encodeName(m_fileName);
+	int flags = O_RDWR | O_CREAT | O_TRUNC;
+
+	m_fd = -1;
+	if (m_directIO) {
+		m_fd = ::open(fileName.constData(), flags | O_DIRECT, 0644);
+	}
+	if (m_fd < 0) {
+		m_directIO = false;
+		m_fd = ::open(fileName.constData(), flags, 0644);
+	}
+	if (m_fd < 0) {
+		qWarning("SFAudioWriter::open_recording_file: Could not create file (%s)", QS_C(m_fileName));
+		return false;
+	}
+
+	void* batch = nullptr;
+	if (posix_memalign(&batch, RECORDING_ALIGNMENT, RECORDING_BATCH_SIZE) != 0) {
+		::close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	m_batch = static_cast<char*>(batch);
+	m_batchStart = m_batchFill = m_allocated = m_pos = m_length = 0;
+
+	SF_VIRTUAL_IO vio;
+	vio.get_filelen = vio_get_filelen;
+	vio.seek = vio_seek;
+	vio.read = vio_read;
+	vio.write = vio_write;
+	vio.tell = vio_tell;
+
+	m_sf = sf_open_virtual(&vio, SFM_WRITE, &m_sfinfo, this);
+
+	if (m_sf == nullptr) {
+		sf_error_str (nullptr, errbuf, sizeof (errbuf) - 1);
+		PWARN(QString("Record: cannot open output file \"%1\" (%2)").arg(m_fileName).arg(errbuf).toLatin1().data());
+		close_recording_file();
+		return false;
+	}
+
+	return true;
+}
+
+
+// Writes the remaining data and releases the preallocated space
+// beyond the end of the file.
+bool SFAudioWriter::close_recording_file()
+{
+	bool success = (leave_streaming() == 0);
+
+	// Truncating frees the blocks fallocate() reserved beyond the end of file
+	if (m_allocated > m_length && ftruncate(m_fd, m_length) != 0) {
+		success = false;
+	}
+
+	if (::close(m_fd) != 0) {
+		success = false;
+	}
+
+	m_fd = -1;
+	m_allocated = 0;
+
+	return success;
+}
+
+
+// Appends and rewrites of the current batch go into the batch, anything else
+// (sndfile updating the header at close) ends the batched writing.
+qint64 SFAudioWriter::write_recording_file(const char* data, qint64 count)
+{
+	qint64 written = 0;
+
+	if (m_batch && m_pos >= m_batchStart && m_pos <= m_batchStart + m_batchFill) {
+		while (written < count) {
+			qint64 offset = m_pos - m_batchStart;
+			qint64 chunk = qMin(count - written, RECORDING_BATCH_SIZE - offset);
+
+			memcpy(m_batch + offset, data + written, size_t(chunk));
+			written += chunk;
+			m_pos += chunk;
+			m_batchFill = qMax(m_batchFill, offset + chunk);
+			m_length = qMax(m_length, m_pos);
+
+			if (m_batchFill == RECORDING_BATCH_SIZE && flush_batch() < 0) {
+				return -1;
+			}
+		}
+
+		return written;
+	}
+
+	if (leave_streaming() < 0) {
+		return -1;
+	}
+
+	while (written < count) {
+		ssize_t result = pwrite(m_fd, data + written, size_t(count - written), m_pos);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		written += result;
+		m_pos += result;
+	}
+
+	m_length = qMax(m_length, m_pos);
+
+	return written;
+}
+
+
+// Writes the full batch at m_batchStart, growing the preallocation ahead of it
+int SFAudioWriter::flush_batch()
+{
+	if (m_preallocateSize > 0 && m_batchStart + RECORDING_BATCH_SIZE > m_allocated) {
+		qint64 size = qMax(m_preallocateSize, RECORDING_BATCH_SIZE);
+		if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, m_allocated, size) == 0) {
+			m_allocated += size;
+		} else {
+			// Not supported by this file system
+			m_preallocateSize = 0;
+		}
+	}
+
+	qint64 done = 0;
+	while (done < RECORDING_BATCH_SIZE) {
+		ssize_t result = pwrite(m_fd, m_batch + done, size_t(RECORDING_BATCH_SIZE - done), m_batchStart + done);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			PERROR(QString("SFAudioWriter: could not write to %1 (%2)").arg(m_fileName).arg(strerror(errno)));
+			return -1;
+		}
+		done += result;
+	}
+
+	if (!m_directIO) {
+		// Start the write back of this batch, and wait for the one before,
+		// which normally is on disk already, so it can be dropped from the cache
+		sync_file_range(m_fd, m_batchStart, RECORDING_BATCH_SIZE, SYNC_FILE_RANGE_WRITE);
+		if (m_batchStart >= RECORDING_BATCH_SIZE) {
+			qint64 previous = m_batchStart - RECORDING_BATCH_SIZE;
+			sync_file_range(m_fd, previous, RECORDING_BATCH_SIZE,
+					SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(m_fd, previous, RECORDING_BATCH_SIZE, POSIX_FADV_DONTNEED);
+		}
+	}
+
+	m_batchStart += RECORDING_BATCH_SIZE;
+	m_batchFill = 0;
+
+	return 0;
+}
+
+
+// Writes the partial batch and switches to plain writes at m_pos
+int SFAudioWriter::leave_streaming()
+{
+	if (!m_batch) {
+		return 0;
+	}
+
+	int result = 0;
+	qint64 size = m_batchFill;
+
+	if (m_directIO) {
+		// O_DIRECT only writes whole blocks, the padding is cut off below
+		size = (m_batchFill + RECORDING_ALIGNMENT - 1) & ~(RECORDING_ALIGNMENT - 1);
+		memset(m_batch + m_batchFill, 0, size_t(size - m_batchFill));
+	}
+
+	qint64 done = 0;
+	while (done < size) {
+		ssize_t written = pwrite(m_fd, m_batch + done, size_t(size - done), m_batchStart + done);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			result = -1;
+			break;
+		}
+		done += written;
+	}
+
+	if (m_directIO) {
+		fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+		if (ftruncate(m_fd, m_length) != 0) {
+			result = -1;
+		}
+		m_directIO = false;
+	}
+
+	free(m_batch);
+	m_batch = nullptr;
+
+	return result;
+}
+
+
+sf_count_t SFAudioWriter::vio_get_filelen(void* user)
+{
+	return static_cast<SFAudioWriter*>(user)->m_length;
+}
+
+
+sf_count_t SFAudioWriter::vio_seek(sf_count_t offset, int whence, void* user)
+{
+	SFAudioWriter* writer = static_cast<SFAudioWriter*>(user);
+
+	switch (whence) {
+	case SEEK_SET:
+		writer->m_pos = offset;
+		break;
+	case SEEK_CUR:
+		writer->m_pos += offset;
+		break;
+	case SEEK_END:
+		writer->m_pos = writer->m_length + offset;
+		break;
+	}
+
+	return writer->m_pos;
+}
+
+
+sf_count_t SFAudioWriter::vio_read(void* ptr, sf_count_t count, void* user)
+{
+	SFAudioWriter* writer = static_cast<SFAudioWriter*>(user);
+
+	if (writer->leave_streaming() < 0) {
+		return 0;
+	}
+
+	ssize_t result = pread(writer->m_fd, ptr, size_t(count), writer->m_pos);
+	if (result <= 0) {
+		return 0;
+	}
+
+	writer->m_pos += result;
+
+	return result;
+}
+
+
+sf_count_t SFAudioWriter::vio_write(const void* ptr, sf_count_t count, void* user)
+{
+	qint64 written = static_cast<SFAudioWriter*>(user)->write_recording_file(static_cast<const char*>(ptr), count);
+
+	return written < 0 ? 0 : written;
+}
+
+
+sf_count_t SFAudioWriter::vio_tell(void* user)
+{
+	return static_cast<SFAudioWriter*>(user)->m_pos;
+}
+
+#endif
@@ -54,6 +54,30 @@ protected:
 private:
 	QFile m_file;
 
+	// Recording files are written through sndfile's virtual I/O in large
+	// batches, to a file which is preallocated ahead of the write position
+	bool		m_recording{};
+	bool		m_directIO{};
+	qint64		m_preallocateSize{};
+	int		m_fd{-1};
+	char*		m_batch{};
+	qint64		m_batchStart{};
+	qint64		m_batchFill{};
+	qint64		m_allocated{};
+	qint64		m_pos{};
+	qint64		m_length{};
+
+	bool open_recording_file();
+	bool close_recording_file();
+	qint64 write_recording_file(const char* data, qint64 count);
+	int flush_batch();
+	int leave_streaming();
+
+	static sf_count_t vio_get_filelen(void* user);
+	static sf_count_t vio_seek(sf_count_t offset, int whence, void* user);
+	static sf_count_t vio_read(void* ptr, sf_count_t count, void* user);
+	static sf_count_t vio_write(const void* ptr, sf_count_t count, void* user);
+	static sf_count_t vio_tell(void* user);
 };
 
 #endif
@@ -23,11 +23,26 @@
 #include "Mixer.h"
 #include "defines.h"
 #include <cmath> // used for fabs
+#include <cstring> // used for memcpy
+
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (USE_XMMINTRIN)
+#include <xmmintrin.h>
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
 
 Mixer::compute_peak_t			Mixer::compute_peak 		= nullptr;
 Mixer::apply_gain_to_buffer_t		Mixer::apply_gain_to_buffer 	= nullptr;
 Mixer::mix_buffers_with_gain_t		Mixer::mix_buffers_with_gain 	= nullptr;
 Mixer::mix_buffers_no_gain_t		Mixer::mix_buffers_no_gain 	= nullptr;
+Mixer::find_peaks_t			Mixer::find_peaks		= nullptr;
+Mixer::convert_s16_to_float_t		Mixer::convert_s16_to_float	= nullptr;
+Mixer::convert_s24_to_float_t		Mixer::convert_s24_to_float	= nullptr;
+Mixer::convert_s32_to_float_t		Mixer::convert_s32_to_float	= nullptr;
+Mixer::deinterleave_t			Mixer::deinterleave		= nullptr;
+Mixer::deinterleave_s32_to_float_t	Mixer::deinterleave_s32_to_float = nullptr;
+Mixer::interleave_t			Mixer::interleave		= nullptr;
 
 
 
@@ -60,6 +75,334 @@ void default_mix_buffers_no_gain (audio_sample_t* dst, const audio_sample_t* src
         }
 }
 
+void default_find_peaks (const audio_sample_t* buf, nframes_t nframes, float* min, float* max)
+{
+        float a = *max;
+        float b = *min;
+
+        for (nframes_t i = 0; i < nframes; i++) {
+                a = fmaxf(buf[i], a);
+                b = fminf(buf[i], b);
+        }
+
+        *max = a;
+        *min = b;
+}
+
+void default_convert_s16_to_float (const short* src, audio_sample_t* dst, nframes_t nsamples)
+{
+        const float scale = 1.0f / 32768.0f;
+
+        for (nframes_t i = 0; i < nsamples; i++) {
+                dst[i] = float(src[i]) * scale;
+        }
+}
+
+void default_convert_s24_to_float (const unsigned char* src, audio_sample_t* dst, nframes_t nsamples)
+{
+        const float scale = 1.0f / 8388608.0f;
+
+        for (nframes_t i = 0; i < nsamples; i++) {
+                // Shift the 3 bytes into the upper part of an int, so the
+                // sign is extended by the arithmetic shift right afterwards
+                int value = int((uint(src[0]) << 8) | (uint(src[1]) << 16) | (uint(src[2]) << 24)) >> 8;
+                dst[i] = float(value) * scale;
+                src += 3;
+        }
+}
+
+void default_convert_s32_to_float (const int* src, audio_sample_t* dst, nframes_t nsamples, float scale)
+{
+        for (nframes_t i = 0; i < nsamples; i++) {
+                dst[i] = float(src[i]) * scale;
+        }
+}
+
+void default_deinterleave (const audio_sample_t* src, audio_sample_t** dst, nframes_t nframes, uint channels)
+{
+        switch (channels) {
+        case 1:
+                memcpy(dst[0], src, nframes * sizeof(audio_sample_t));
+                break;
+        case 2:
+                for (nframes_t f = 0; f < nframes; f++) {
+                        dst[0][f] = src[f * 2];
+                        dst[1][f] = src[f * 2 + 1];
+                }
+                break;
+        default:
+                for (nframes_t f = 0; f < nframes; f++) {
+                        for (uint c = 0; c < channels; c++) {
+                                dst[c][f] = src[f * channels + c];
+                        }
+                }
+        }
+}
+
+void default_deinterleave_s32_to_float (const int* src, audio_sample_t** dst, nframes_t nframes, uint channels, float scale)
+{
+        for (nframes_t f = 0; f < nframes; f++) {
+                for (uint c = 0; c < channels; c++) {
+                        dst[c][f] = float(src[f * channels + c]) * scale;
+                }
+        }
+}
+
+void default_interleave (const audio_sample_t* const* src, audio_sample_t* dst, nframes_t nframes, uint channels)
+{
+        switch (channels) {
+        case 1:
+                memcpy(dst, src[0], nframes * sizeof(audio_sample_t));
+                break;
+        case 2:
+                for (nframes_t f = 0; f < nframes; f++) {
+                        dst[f * 2] = src[0][f];
+                        dst[f * 2 + 1] = src[1][f];
+                }
+                break;
+        default:
+                for (nframes_t f = 0; f < nframes; f++) {
+                        for (uint c = 0; c < channels; c++) {
+                                dst[f * channels + c] = src[c][f];
+                        }
+                }
+        }
+}
+
+
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (USE_XMMINTRIN)
+
+void x86_sse_find_peaks (const audio_sample_t* buf, nframes_t nframes, float* min, float* max)
+{
+        __m128 current_max = _mm_set1_ps(*max);
+        __m128 current_min = _mm_set1_ps(*min);
+
+        // Process the unaligned head one sample at a time
+        while (nframes && (((uintptr_t)buf) % 16)) {
+                __m128 work = _mm_load_ss(buf);
+                current_max = _mm_max_ss(current_max, work);
+                current_min = _mm_min_ss(current_min, work);
+                ++buf;
+                --nframes;
+        }
+
+        while (nframes >= 4) {
+                __m128 work = _mm_load_ps(buf);
+                current_max = _mm_max_ps(current_max, work);
+                current_min = _mm_min_ps(current_min, work);
+                buf += 4;
+                nframes -= 4;
+        }
+
+        while (nframes) {
+                __m128 work = _mm_load_ss(buf);
+                current_max = _mm_max_ss(current_max, work);
+                current_min = _mm_min_ss(current_min, work);
+                ++buf;
+                --nframes;
+        }
+
+        // Reduce the 4 lanes to one value
+        __m128 tmp = _mm_shuffle_ps(current_max, current_max, _MM_SHUFFLE(2, 3, 0, 1));
+        current_max = _mm_max_ps(current_max, tmp);
+        tmp = _mm_shuffle_ps(current_max, current_max, _MM_SHUFFLE(1, 0, 3, 2));
+        current_max = _mm_max_ps(current_max, tmp);
+
+        tmp = _mm_shuffle_ps(current_min, current_min, _MM_SHUFFLE(2, 3, 0, 1));
+        current_min = _mm_min_ps(current_min, tmp);
+        tmp = _mm_shuffle_ps(current_min, current_min, _MM_SHUFFLE(1, 0, 3, 2));
+        current_min = _mm_min_ps(current_min, tmp);
+
+        _mm_store_ss(max, current_max);
+        _mm_store_ss(min, current_min);
+}
+
+// The integer conversions need SSE2, builds without it use the plain versions
+#if defined (__SSE2__)
+
+void x86_sse_convert_s16_to_float (const short* src, audio_sample_t* dst, nframes_t nsamples)
+{
+        const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+        while (nsamples >= 8) {
+                __m128i work = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                // Move each sample into the upper half of a 32 bit lane,
+                // the arithmetic shift right extends the sign
+                __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(work, work), 16);
+                __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(work, work), 16);
+                _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+                _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+                src += 8;
+                dst += 8;
+                nsamples -= 8;
+        }
+
+        default_convert_s16_to_float(src, dst, nsamples);
+}
+
+// Moves the 4 packed 24 bit samples in the lower 12 bytes of work into the
+// upper 3 bytes of the 32 bit lanes, and extends their sign
+static inline __m128i x86_sse_unpack_s24(__m128i work)
+{
+        const __m128i lane0 = _mm_setr_epi32(-1, 0, 0, 0);
+        const __m128i lane1 = _mm_setr_epi32(0, -1, 0, 0);
+        const __m128i lane2 = _mm_setr_epi32(0, 0, -1, 0);
+        const __m128i lane3 = _mm_setr_epi32(0, 0, 0, -1);
+
+        // Sample n starts at byte 3n and has to start at byte 4n + 1
+        __m128i packed = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(_mm_slli_si128(work, 1), lane0),
+                             _mm_and_si128(_mm_slli_si128(work, 2), lane1)),
+                _mm_or_si128(_mm_and_si128(_mm_slli_si128(work, 3), lane2),
+                             _mm_and_si128(_mm_slli_si128(work, 4), lane3)));
+
+        return _mm_srai_epi32(packed, 8);
+}
+
+void x86_sse_convert_s24_to_float (const unsigned char* src, audio_sample_t* dst, nframes_t nsamples)
+{
+        const __m128 scale = _mm_set1_ps(1.0f / 8388608.0f);
+
+        // Full 16 byte loads, as long as they don't read beyond the
+        // end of src, 16 bytes hold 5 samples but only 4 are used
+        while (nsamples >= 6) {
+                __m128i work = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(x86_sse_unpack_s24(work)), scale));
+                src += 12;
+                dst += 4;
+                nsamples -= 4;
+        }
+
+        default_convert_s24_to_float(src, dst, nsamples);
+}
+
+void x86_sse_convert_s32_to_float (const int* src, audio_sample_t* dst, nframes_t nsamples, float scale)
+{
+        const __m128 factor = _mm_set1_ps(scale);
+
+        while (nsamples >= 8) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4));
+                _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(a), factor));
+                _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), factor));
+                src += 8;
+                dst += 8;
+                nsamples -= 8;
+        }
+
+        default_convert_s32_to_float(src, dst, nsamples, scale);
+}
+
+#else
+
+void x86_sse_convert_s16_to_float (const short* src, audio_sample_t* dst, nframes_t nsamples)
+{
+        default_convert_s16_to_float(src, dst, nsamples);
+}
+
+void x86_sse_convert_s24_to_float (const unsigned char* src, audio_sample_t* dst, nframes_t nsamples)
+{
+        default_convert_s24_to_float(src, dst, nsamples);
+}
+
+void x86_sse_convert_s32_to_float (const int* src, audio_sample_t* dst, nframes_t nsamples, float scale)
+{
+        default_convert_s32_to_float(src, dst, nsamples, scale);
+}
+
+#endif
+
+void x86_sse_deinterleave (const audio_sample_t* src, audio_sample_t** dst, nframes_t nframes, uint channels)
+{
+        if (channels != 2) {
+                default_deinterleave(src, dst, nframes, channels);
+                return;
+        }
+
+        audio_sample_t* left = dst[0];
+        audio_sample_t* right = dst[1];
+
+        while (nframes >= 4) {
+                // L0 R0 L1 R1 and L2 R2 L3 R3
+                __m128 a = _mm_loadu_ps(src);
+                __m128 b = _mm_loadu_ps(src + 4);
+                _mm_storeu_ps(left, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                _mm_storeu_ps(right, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                src += 8;
+                left += 4;
+                right += 4;
+                nframes -= 4;
+        }
+
+        audio_sample_t* tail[2] = {left, right};
+        default_deinterleave(src, tail, nframes, 2);
+}
+
+void x86_sse_deinterleave_s32_to_float (const int* src, audio_sample_t** dst, nframes_t nframes, uint channels, float scale)
+{
+        if (channels == 1) {
+                x86_sse_convert_s32_to_float(src, dst[0], nframes, scale);
+                return;
+        }
+
+        if (channels != 2) {
+                default_deinterleave_s32_to_float(src, dst, nframes, channels, scale);
+                return;
+        }
+
+        audio_sample_t* left = dst[0];
+        audio_sample_t* right = dst[1];
+
+#if defined (__SSE2__)
+        const __m128 factor = _mm_set1_ps(scale);
+
+        while (nframes >= 4) {
+                // L0 R0 L1 R1 and L2 R2 L3 R3
+                __m128i w0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                __m128i w1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4));
+                __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(w0), factor);
+                __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(w1), factor);
+                _mm_storeu_ps(left, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                _mm_storeu_ps(right, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                src += 8;
+                left += 4;
+                right += 4;
+                nframes -= 4;
+        }
+#endif
+
+        audio_sample_t* tail[2] = {left, right};
+        default_deinterleave_s32_to_float(src, tail, nframes, 2, scale);
+}
+
+void x86_sse_interleave (const audio_sample_t* const* src, audio_sample_t* dst, nframes_t nframes, uint channels)
+{
+        if (channels != 2) {
+                default_interleave(src, dst, nframes, channels);
+                return;
+        }
+
+        const audio_sample_t* left = src[0];
+        const audio_sample_t* right = src[1];
+
+        while (nframes >= 4) {
+                // L0 L1 L2 L3 and R0 R1 R2 R3
+                __m128 l = _mm_loadu_ps(left);
+                __m128 r = _mm_loadu_ps(right);
+                _mm_storeu_ps(dst, _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps(dst + 4, _mm_unpackhi_ps(l, r));
+                left += 4;
+                right += 4;
+                dst += 8;
+                nframes -= 4;
+        }
+
+        const audio_sample_t* tail[2] = {left, right};
+        default_interleave(tail, dst, nframes, 2);
+}
+
+#endif
+
 
 #if defined (__APPLE__) && defined (BUILD_VECLIB_OPTIMIZATIONS)
 #include <Accelerate/Accelerate.h>
@@ -73,8 +416,25 @@ float veclib_compute_peak (const audio_sample_t* buf, nframes_t nsamples, float
 
 void veclib_find_peaks (const audio_sample_t* buf, nframes_t nframes, float *min, float *max)
 {
-	vDSP_maxv (const_cast<audio_sample_t*>(buf), 1, max, nframes);
-	vDSP_minv (const_cast<audio_sample_t*>(buf), 1, min, nframes);
+	float tmpmax = 0.0f;
+	float tmpmin = 0.0f;
+	vDSP_maxv (const_cast<audio_sample_t*>(buf), 1, &tmpmax, nframes);
+	vDSP_minv (const_cast<audio_sample_t*>(buf), 1, &tmpmin, nframes);
+	*max = fmaxf(*max, tmpmax);
+	*min = fminf(*min, tmpmin);
+}
+
+void veclib_convert_s16_to_float (const short* src, audio_sample_t* dst, nframes_t nsamples)
+{
+	float scale = 1.0f / 32768.0f;
+	vDSP_vflt16(const_cast<short*>(src), 1, dst, 1, nsamples);
+	vDSP_vsmul(dst, 1, &scale, dst, 1, nsamples);
+}
+
+void veclib_convert_s32_to_float (const int* src, audio_sample_t* dst, nframes_t nsamples, float scale)
+{
+	vDSP_vflt32(const_cast<int*>(src), 1, dst, 1, nsamples);
+	vDSP_vsmul(dst, 1, &scale, dst, 1, nsamples);
 }
 
 void veclib_apply_gain_to_buffer (audio_sample_t * buf, nframes_t nframes, float gain)
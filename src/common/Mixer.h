@@ -64,6 +64,13 @@ float default_compute_peak			(const audio_sample_t*  buf, nframes_t nsamples, fl
 void  default_apply_gain_to_buffer		(audio_sample_t*  buf, nframes_t nframes, float gain);
 void  default_mix_buffers_with_gain		(audio_sample_t*  dst, const audio_sample_t*  src, nframes_t nframes, float gain);
 void  default_mix_buffers_no_gain		(audio_sample_t*  dst, const audio_sample_t*  src, nframes_t nframes);
+void  default_find_peaks			(const audio_sample_t*  buf, nframes_t nframes, float* min, float* max);
+void  default_convert_s16_to_float		(const short*  src, audio_sample_t*  dst, nframes_t nsamples);
+void  default_convert_s24_to_float		(const unsigned char*  src, audio_sample_t*  dst, nframes_t nsamples);
+void  default_convert_s32_to_float		(const int*  src, audio_sample_t*  dst, nframes_t nsamples, float scale);
+void  default_deinterleave			(const audio_sample_t*  src, audio_sample_t**  dst, nframes_t nframes, uint channels);
+void  default_deinterleave_s32_to_float	(const int*  src, audio_sample_t**  dst, nframes_t nframes, uint channels, float scale);
+void  default_interleave			(const audio_sample_t* const*  src, audio_sample_t*  dst, nframes_t nframes, uint channels);
 
 
 #if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (SSE_OPTIMIZATIONS)
@@ -78,12 +85,26 @@ extern "C"
 }
 #endif
 
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (USE_XMMINTRIN)
+/* SSE intrinsics functions */
+void  x86_sse_find_peaks		(const audio_sample_t*  buf, nframes_t nframes, float* min, float* max);
+void  x86_sse_convert_s16_to_float	(const short*  src, audio_sample_t*  dst, nframes_t nsamples);
+void  x86_sse_convert_s24_to_float	(const unsigned char*  src, audio_sample_t*  dst, nframes_t nsamples);
+void  x86_sse_convert_s32_to_float	(const int*  src, audio_sample_t*  dst, nframes_t nsamples, float scale);
+void  x86_sse_deinterleave		(const audio_sample_t*  src, audio_sample_t**  dst, nframes_t nframes, uint channels);
+void  x86_sse_deinterleave_s32_to_float	(const int*  src, audio_sample_t**  dst, nframes_t nframes, uint channels, float scale);
+void  x86_sse_interleave		(const audio_sample_t* const*  src, audio_sample_t*  dst, nframes_t nframes, uint channels);
+#endif
+
 #if defined (__APPLE__)  && defined (BUILD_VECLIB_OPTIMIZATIONS)
 
 float veclib_compute_peak              (const audio_sample_t* buf, nframes_t nsamples, float current);
 void  veclib_apply_gain_to_buffer      (audio_sample_t* buf, nframes_t nframes, float gain);
 void  veclib_mix_buffers_with_gain     (audio_sample_t* dst, const audio_sample_t* src, nframes_t nframes, float gain);
 void  veclib_mix_buffers_no_gain       (audio_sample_t* dst, const audio_sample_t* src, nframes_t nframes);
+void  veclib_find_peaks                (const audio_sample_t* buf, nframes_t nframes, float* min, float* max);
+void  veclib_convert_s16_to_float      (const short* src, audio_sample_t* dst, nframes_t nsamples);
+void  veclib_convert_s32_to_float      (const int* src, audio_sample_t* dst, nframes_t nsamples, float scale);
 
 #endif
 
@@ -94,11 +115,34 @@ public:
         typedef void  (*apply_gain_to_buffer_t)		(audio_sample_t* , nframes_t, float);
         typedef void  (*mix_buffers_with_gain_t)	(audio_sample_t* , const audio_sample_t* , nframes_t, float);
         typedef void  (*mix_buffers_no_gain_t)		(audio_sample_t* , const audio_sample_t* , nframes_t);
+        typedef void  (*find_peaks_t)			(const audio_sample_t* , nframes_t, float*, float*);
+        typedef void  (*convert_s16_to_float_t)		(const short* , audio_sample_t* , nframes_t);
+        typedef void  (*convert_s24_to_float_t)		(const unsigned char* , audio_sample_t* , nframes_t);
+        typedef void  (*convert_s32_to_float_t)		(const int* , audio_sample_t* , nframes_t, float);
+        typedef void  (*deinterleave_t)			(const audio_sample_t* , audio_sample_t** , nframes_t, uint);
+        typedef void  (*deinterleave_s32_to_float_t)	(const int* , audio_sample_t** , nframes_t, uint, float);
+        typedef void  (*interleave_t)			(const audio_sample_t* const* , audio_sample_t* , nframes_t, uint);
 
         static compute_peak_t		compute_peak;
         static apply_gain_to_buffer_t	apply_gain_to_buffer;
         static mix_buffers_with_gain_t	mix_buffers_with_gain;
         static mix_buffers_no_gain_t	mix_buffers_no_gain;
+        // Lowers *min and raises *max to the smallest/largest sample in buf
+        static find_peaks_t		find_peaks;
+        // Convert native endian 16 bit and packed little endian 24 bit
+        // integer samples to floats in the range [-1.0, 1.0)
+        static convert_s16_to_float_t	convert_s16_to_float;
+        static convert_s24_to_float_t	convert_s24_to_float;
+        // Convert native endian 32 bit integer (or fixed point) samples to
+        // floats by multiplying them with scale
+        static convert_s32_to_float_t	convert_s32_to_float;
+        // Split interleaved frames of channels samples into one buffer
+        // per channel, used by the audio file decoders
+        static deinterleave_t		deinterleave;
+        static deinterleave_s32_to_float_t	deinterleave_s32_to_float;
+        // Merge one buffer per channel into interleaved frames, used by
+        // the export render loop and the stem writers
+        static interleave_t		interleave;
 };
 
 #endif
@@ -38,7 +38,7 @@ $Id: Tsar.cpp,v 1.4 2008/02/11 10:11:52 r_sijrier Exp $
  * 	\class Tsar
  * 	\brief Tsar (Thread Save Add and Remove) is a singleton class to call  
  *		functions (both signals and slots) in a thread save way without
- *		using any mutual exclusion primitives (mutex)
+ *		blocking the audio thread on mutual exclusion primitives (mutex)
  *
  */
 
@@ -66,6 +66,7 @@ Tsar::Tsar()
 	m_events.append(new RingBufferNPT<TsarEvent>(audioThreadEventsBufferSize));
 
 	m_retryCount = 0;
+	m_rtListsRequested = 0;
 	
 #if defined (THREAD_CHECK)
 	m_threadId = QThread::currentThreadId ();
@@ -133,6 +134,26 @@ void Tsar::process_events( )
 {
 //#define profile
 
+	bool pending = false;
+	for (int i=0; i<m_events.size(); ++i) {
+		if (m_events.at(i)->read_space() > 0) {
+			pending = true;
+			break;
+		}
+	}
+
+	if (!pending) {
+		return;
+	}
+
+	// Never block the audio thread, the events are processed during
+	// the next cycle if another thread traverses the realtime lists.
+	if (!m_rtListsMutex.tryLock()) {
+		m_rtListsRequested = 1;
+		return;
+	}
+	m_rtListsRequested = 0;
+
 	for (int i=0; i<m_events.size(); ++i) {
 		RingBufferNPT<TsarEvent>* newEvents = m_events.at(i);
 		
@@ -163,6 +184,29 @@ void Tsar::process_events( )
 #endif
 		}
 	}
+
+	m_rtListsMutex.unlock();
+}
+
+/**
+ * 	Locks the realtime lists (the lists which are only modified by the slots
+ *	invoked through Tsar in the audio thread) for the calling thread.
+ *	The lock is handed over to the audio thread first if it's waiting for it.
+
+	This function is NOT realtime save, don't call it from the audio thread!
+ */
+void Tsar::lock_rt_lists()
+{
+	// Bounded, the audio thread doesn't run while the driver is restarted
+	for (int i=0; m_rtListsRequested && i<100; ++i) {
+		QThread::usleep(100);
+	}
+	m_rtListsMutex.lock();
+}
+
+void Tsar::unlock_rt_lists()
+{
+	m_rtListsMutex.unlock();
 }
 
 void Tsar::finish_processed_events( )
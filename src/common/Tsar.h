@@ -26,6 +26,7 @@ $Id: Tsar.h,v 1.4 2008/02/11 10:11:52 r_sijrier Exp $
 #include <QObject>
 #include <QBasicTimer>
 #include <QByteArray>
+#include <QMutex>
 #include "RingBufferNPT.h"
 #include <iostream>
 
@@ -78,6 +79,11 @@ public:
     void process_event_signal(const TsarEvent& event);
     void process_event_slot_signal(const TsarEvent& event);
 
+    // Threads other then the audio thread which traverse the realtime
+    // lists (like the LookaheadRenderer) hold this lock while doing so.
+    void lock_rt_lists();
+    void unlock_rt_lists();
+
 protected:
     void timerEvent(QTimerEvent *event);
 
@@ -97,6 +103,8 @@ private:
     QBasicTimer                         m_timer;
     int 	m_eventCounter;
     int 	m_retryCount;
+    QMutex	m_rtListsMutex;
+    volatile size_t	m_rtListsRequested;
 
 #if defined (THREAD_CHECK)
     unsigned long	m_threadId;
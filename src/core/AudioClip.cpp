@@ -413,7 +413,10 @@ void AudioClip::set_selected(bool /*selected*/)
 //
 //  Function called in RealTime AudioThread processing path
 //
-int AudioClip::process(nframes_t nframes)
+//  Reads the part of the clip within the nframes starting at transportLocation,
+//  processes it in renderBus and mixes the result into processBus.
+//
+int AudioClip::process(nframes_t nframes, const TimeRef& transportLocation, AudioBus* renderBus, AudioBus* processBus)
 {
     Q_ASSERT(m_sheet);
 
@@ -437,7 +440,7 @@ int AudioClip::process(nframes_t nframes)
 
     Q_ASSERT(m_readSource);
 
-    AudioBus* bus = m_sheet->get_clip_render_bus();
+    AudioBus* bus = renderBus;
     bus->silence_buffers(nframes);
 
     TimeRef mix_pos;
@@ -451,7 +454,6 @@ int AudioClip::process(nframes_t nframes)
 
 
     uint outputRate = m_readSource->get_output_rate();
-    TimeRef transportLocation = m_sheet->get_transport_location();
     TimeRef upperRange = transportLocation + TimeRef(framesToProcess, outputRate);
 
 
@@ -490,7 +492,12 @@ int AudioClip::process(nframes_t nframes)
 
     uint read_frames = 0;
 
-    if (m_sheet->realtime_path()) {
+    if (m_readSource->is_resident()) {
+        // Short sources are in memory as a whole, no ring buffer involved
+        read_frames = uint(m_readSource->resident_read(static_cast<audio_sample_t**>(mixdown), mix_pos, framesToProcess));
+    } else if (m_sheet->realtime_path() || !m_sheet->renderDecodeBuffer) {
+        // The LookaheadRenderer can still be finishing a block right
+        // after the transport stopped, only exports read from file
         read_frames = uint(m_readSource->rb_read(static_cast<audio_sample_t**>(mixdown), mix_pos, framesToProcess));
     } else {
         read_frames = uint(m_readSource->file_read(m_sheet->renderDecodeBuffer, mix_pos, framesToProcess));
@@ -512,14 +519,12 @@ int AudioClip::process(nframes_t nframes)
 
 
     apill_foreach(FadeCurve* fade, FadeCurve*, m_fades) {
-        fade->process(bus, nframes);
+        fade->process(bus, nframes, transportLocation);
     }
 
     TimeRef endlocation = mix_pos + TimeRef(read_frames, get_rate());
     m_fader->process_gain(mixdown, mix_pos, endlocation, read_frames, channelcount);
 
-    AudioBus* processBus = m_track->get_process_bus();
-
     // NEVER EVER FORGET that the mixing should be done on the WHOLE buffer, not just part of it
     // so use an unmodified nframes variable!!!!!!!!!!!!!!!!!!!!!!!!!!!1
     if (channelcount == 1) {
@@ -533,6 +538,42 @@ int AudioClip::process(nframes_t nframes)
     return 1;
 }
 
+// Returns false if the ring buffers of the ReadSource don't hold the data
+// process() needs for the nframes starting at transportLocation (yet).
+// A ring buffer which is behind that location is resynced.
+bool AudioClip::is_ready_for(const TimeRef& transportLocation, nframes_t nframes)
+{
+    if (get_channel_count() == 0 || m_recordingStatus == RECORDING || !m_isReadSourceValid) {
+        return true;
+    }
+
+    if (m_isMuted || (get_gain() == 0.0f) ) {
+        return true;
+    }
+
+    uint outputRate = m_readSource->get_output_rate();
+    TimeRef upperRange = transportLocation + TimeRef(nframes, outputRate);
+
+    if ( (m_trackStartLocation >= upperRange) || (m_trackEndLocation <= transportLocation) ) {
+        return true;
+    }
+
+    TimeRef mix_pos;
+    nframes_t framesToProcess = nframes;
+
+    if (transportLocation < m_trackStartLocation) {
+        mix_pos = m_sourceStartLocation;
+        framesToProcess -= m_trackStartLocation.to_frame(outputRate) - transportLocation.to_frame(outputRate);
+    } else {
+        mix_pos = (transportLocation - m_trackStartLocation + m_sourceStartLocation);
+    }
+    if (m_trackEndLocation < upperRange) {
+        framesToProcess -= upperRange.to_frame(outputRate) - m_trackEndLocation.to_frame(outputRate);
+    }
+
+    return m_readSource->rb_ready_for(mix_pos, framesToProcess);
+}
+
 //
 //  Function called in RealTime AudioThread processing path
 //
@@ -598,6 +639,13 @@ int AudioClip::init_recording()
         spec->extraFormat["filetype"] = "wav";
     }
 
+    if (spec->writerType == "sndfile") {
+        // Preallocated, batched writing, see SFAudioWriter
+        spec->extraFormat["recording"] = "true";
+        spec->extraFormat["preallocate"] = config().get_property("Recording", "PreallocateSize", 64).toString();
+        spec->extraFormat["directio"] = config().get_property("Recording", "DirectIO", "false").toString();
+    }
+
     spec->data_width = 1;	// 1 means float
     spec->channels = channelcount;
     spec->sample_rate = audiodevice().get_sample_rate();
@@ -60,7 +60,8 @@ public:
 	
 	void set_audio_source(ReadSource* source);
     int init_recording();
-	int process(nframes_t nframes);
+	int process(nframes_t nframes, const TimeRef& transportLocation, AudioBus* renderBus, AudioBus* processBus);
+	bool is_ready_for(const TimeRef& transportLocation, nframes_t nframes);
 	
 	void set_track_start_location(const TimeRef& location);
 	void set_fade_in(double range);
@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QFile>
 #include <QMutexLocker>
 #include <QFileInfo>
+#include <QThread>
 
 #include "Export.h"
 #include "AbstractAudioReader.h"
@@ -33,17 +34,56 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Peak.h"
 #include "defines.h"
 
+// Importing is mostly limited by disk throughput, more workers than this
+// only make the files compete for the disk.
+static const int MAX_COPY_WORKERS = 4;
+
+
+class AudioFileCopyConvert::CopyWorker : public QRunnable
+{
+public:
+	CopyWorker(AudioFileCopyConvert* converter)
+		: m_converter(converter)
+	{}
+	
+	void run()
+	{
+		CopyTask task;
+		while (m_converter->dequeue_task(task)) {
+			m_converter->process_task(task);
+		}
+	}
+	
+private:
+	AudioFileCopyConvert* m_converter;
+};
+
+
 AudioFileCopyConvert::AudioFileCopyConvert()
 {
 	m_stopProcessing = false;
-	moveToThread(this);
-	start();
-	connect(this, SIGNAL(dequeueTask()), this, SLOT(dequeue_tasks()), Qt::QueuedConnection);
+	m_activeWorkers = 0;
+	m_totalFrames = m_processedFrames = 0;
+	m_progress = 0;
+	m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), MAX_COPY_WORKERS));
+	
+	// The ReadSources are owned by the ResourcesManager, they are
+	// removed in the GUI thread once their copy is done.
+	connect(this, SIGNAL(taskDone(ReadSource*)), this, SLOT(task_done(ReadSource*)), Qt::QueuedConnection);
+}
+
+AudioFileCopyConvert::~AudioFileCopyConvert()
+{
+	stop_merging();
+	m_pool.waitForDone();
 }
 
 /**
  *	Queues the ReadSource source to be copied. This function will take ownership of the ReadSource
 	and takes care of 'deleting' it once the copy is finished!!
+	
+	Each task works on its own copy of \a spec, so one ExportSpecification
+	can be used for all queued files.
 
  * @param source 
  * @param dir 
@@ -67,25 +107,69 @@ void AudioFileCopyConvert::enqueue_task(ReadSource * source,
 	task.tracknumber = tracknumber;
 	task.trackname = trackname;
 	task.dir = dir;
-	task.spec = spec;
+	task.spec = new ExportSpecification(*spec);
+	
+	QMutexLocker locker(&m_mutex);
 	
-	m_mutex.lock();
+	// A new batch starts when the previous one is done
+	if (m_tasks.isEmpty() && m_activeWorkers == 0) {
+		m_totalFrames = m_processedFrames = 0;
+		m_progress = 0;
+	}
+	
+	m_stopProcessing = false;
+	m_totalFrames += source->get_length().universal_frame();
 	m_tasks.enqueue(task);
-	m_mutex.unlock();
 	
-	emit dequeueTask();
+	if (m_activeWorkers < m_pool.maxThreadCount()) {
+		m_activeWorkers++;
+		m_pool.start(new CopyWorker(this));
+	}
 }
 
-void AudioFileCopyConvert::dequeue_tasks()
+// Called by the workers, returns false and retires the calling
+// worker if there is nothing left to do.
+bool AudioFileCopyConvert::dequeue_task(CopyTask& task)
 {
-	m_mutex.lock();
-	if (m_tasks.size()) {
-		CopyTask task = m_tasks.dequeue();
-		m_mutex.unlock();
-		process_task(task);
-		return;
+	QMutexLocker locker(&m_mutex);
+	
+	if (m_tasks.isEmpty() || m_stopProcessing) {
+		m_activeWorkers--;
+		
+		if (m_stopProcessing && m_activeWorkers == 0) {
+			while (!m_tasks.isEmpty()) {
+				CopyTask dropped = m_tasks.dequeue();
+				delete dropped.spec;
+				emit taskDone(dropped.readsource);
+			}
+			locker.unlock();
+			emit processingStopped();
+		}
+		
+		return false;
+	}
+	
+	task = m_tasks.dequeue();
+	return true;
+}
+
+void AudioFileCopyConvert::add_progress(qint64 frames)
+{
+	QMutexLocker locker(&m_mutex);
+	
+	m_processedFrames += frames;
+	
+	int currentprogress = m_totalFrames ? int(double(m_processedFrames) / double(m_totalFrames) * 100) : 100;
+	if (currentprogress > m_progress) {
+		m_progress = currentprogress;
+		locker.unlock();
+		emit progress(currentprogress);
 	}
-	m_mutex.unlock();
+}
+
+void AudioFileCopyConvert::task_done(ReadSource* source)
+{
+	resources_manager()->remove_source(source);
 }
 
 void AudioFileCopyConvert::process_task(CopyTask task)
@@ -109,11 +193,10 @@ void AudioFileCopyConvert::process_task(CopyTask task)
 	task.spec->sample_rate = task.readsource->get_rate();
 	task.spec->blocksize = buffersize;
 	task.spec->name = task.outFileName;
-	task.spec->dataF = new audio_sample_t[buffersize * 2];
+	task.spec->dataF = new audio_sample_t[buffersize * task.spec->channels];
 	
 	WriteSource* writesource = new WriteSource(task.spec);
 	bool failedToPrepareWritesource = false;
-	int oldprogress = 0;
 
 	if (writesource->prepare_export() == -1) {
 		failedToPrepareWritesource = true;
@@ -154,13 +237,10 @@ void AudioFileCopyConvert::process_task(CopyTask task)
 		// Process the data, and write to disk
 		writesource->process(buffersize);
 		
+		TimeRef oldpos = task.spec->pos;
 		task.spec->pos.add_frames(nframes, task.readsource->get_rate());
 		
-		int currentprogress = int(double(task.spec->pos.universal_frame()) / double(task.spec->totalTime.universal_frame()) * 100);
-		if (currentprogress > oldprogress) {
-			oldprogress = currentprogress;
-			emit progress(currentprogress);
-		}
+		add_progress((task.spec->pos - oldpos).universal_frame());
 			
 	} while (task.spec->pos != task.spec->totalTime);
 		
@@ -172,15 +252,13 @@ void AudioFileCopyConvert::process_task(CopyTask task)
 	delete writesource;
     writesource = nullptr;
 	delete [] task.spec->dataF;
-	resources_manager()->remove_source(task.readsource);
+	delete task.spec;
+	
+	emit taskDone(task.readsource);
 	
-	//  The user asked to stop processing, exit the event loop
-	// and signal we're done.
+	// The user asked to stop processing, the last
+	// worker signals we're done.
 	if (m_stopProcessing) {
-		exit(0);
-		wait(1000);
-		m_tasks.clear();
-		emit processingStopped();
 		return;
 	}
 	
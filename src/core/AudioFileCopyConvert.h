@@ -22,30 +22,35 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #ifndef AUDIO_FILE_COPY_CONVERT_H
 #define AUDIO_FILE_COPY_CONVERT_H
 
-#include <QThread>
+#include <QObject>
 #include <QQueue>
 #include <QMutex>
+#include <QThreadPool>
 
 class ReadSource;
 struct ExportSpecification;
 
-class AudioFileCopyConvert : public QThread
+// Copies imported files into the project as float wav files. Each file is
+// decoded once, the decoded blocks are written and fed to the peak builder
+// at the same time. Files are processed in parallel on a thread pool.
+class AudioFileCopyConvert : public QObject
 {
 	Q_OBJECT
 public:
 	AudioFileCopyConvert();
-	void run() {
-		exec();
-	}
+	~AudioFileCopyConvert();
 	
 	void enqueue_task(ReadSource* source, ExportSpecification* spec, const QString& dir, const QString& outfilename, int tracknumber, const QString& trackname);
 	void stop_merging();
 
 		
 private slots:
-	void dequeue_tasks();
+	void task_done(ReadSource* source);
 	
 private:
+	class CopyWorker;
+	friend class CopyWorker;
+	
 	struct CopyTask {
 		QString outFileName;
 		QString dir;
@@ -58,15 +63,22 @@ private:
 	
 	QQueue<CopyTask> m_tasks;
 	QMutex m_mutex;
-	bool m_stopProcessing;
+	QThreadPool m_pool;
+	volatile bool m_stopProcessing;
+	int m_activeWorkers;
+	qint64 m_totalFrames;
+	qint64 m_processedFrames;
+	int m_progress;
 	
+	bool dequeue_task(CopyTask& task);
 	void process_task(CopyTask task);
+	void add_progress(qint64 frames);
 	
 signals:
-	void dequeueTask();
 	void progress(int);
 	void taskStarted(QString);
 	void taskFinished(QString, int, QString);
+	void taskDone(ReadSource*);
 	void processingStopped();
 };
 
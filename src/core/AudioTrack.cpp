@@ -37,6 +37,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <climits>
 #include "AddRemove.h"
 #include "PCommand.h"
+#include "Project.h"
+#include "Tsar.h"
+#include "LookaheadRenderer.h"
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -84,6 +87,23 @@ void AudioTrack::init()
 
         connect(this, SIGNAL(privateAudioClipAdded(AudioClip*)), this, SLOT(private_audioclip_added(AudioClip*)));
         connect(this, SIGNAL(privateAudioClipRemoved(AudioClip*)), this, SLOT(private_audioclip_removed(AudioClip*)));
+
+        // Edits which change what is rendered ahead of the transport
+        connect(this, SIGNAL(audioClipAdded(AudioClip*)), this, SLOT(invalidate_lookahead()));
+        connect(this, SIGNAL(audioClipRemoved(AudioClip*)), this, SLOT(invalidate_lookahead()));
+        connect(this, SIGNAL(frozenChanged(bool)), this, SLOT(invalidate_lookahead()));
+        connect(m_pluginChain, SIGNAL(pluginAdded(Plugin*)), this, SLOT(invalidate_lookahead()));
+        connect(m_pluginChain, SIGNAL(pluginRemoved(Plugin*)), this, SLOT(invalidate_lookahead()));
+        // and those which change which Tracks are rendered ahead
+        connect(this, SIGNAL(armedChanged(bool)), m_sheet, SLOT(invalidate_lookahead()));
+        connect(this, SIGNAL(routingConfigurationChanged()), m_sheet, SLOT(invalidate_lookahead()));
+
+        // Not pm().get_project(), new projects create their Tracks
+        // before they become the current project
+        Project* project = m_sheet->get_project();
+        if (project) {
+                connect(this, SIGNAL(armedChanged(bool)), project, SLOT(update_latency_profile()));
+        }
 }
 
 QDomNode AudioTrack::get_state( QDomDocument doc, bool istemplate)
@@ -94,6 +114,9 @@ QDomNode AudioTrack::get_state( QDomDocument doc, bool istemplate)
         node.setAttribute("numtakes", m_numtakes);
 	node.setAttribute("showclipvolumeautomation", m_showClipVolumeAutomation);
 	node.setAttribute("InputBus", m_busInName);
+        if (m_frozenClip && !istemplate) {
+                node.setAttribute("frozenclip", m_frozenClip->get_id());
+        }
 
 
         if (! istemplate ) {
@@ -161,6 +184,18 @@ int AudioTrack::set_state( const QDomNode & node )
                 }
         }
 
+        qint64 frozenClipId = e.attribute("frozenclip", "0").toLongLong();
+        if (frozenClipId) {
+                AudioClip* clip = resources_manager()->get_clip(frozenClipId);
+                if (clip) {
+                        clip->set_sheet(m_sheet);
+                        clip->set_state(clip->get_dom_node());
+                        set_frozen_clip(clip);
+                } else {
+                        info().warning(tr("Track %1: frozen AudioClip not found, unfreezing the Track").arg(m_name));
+                }
+        }
+
         return 1;
 }
 
@@ -169,6 +204,10 @@ int AudioTrack::set_state( const QDomNode & node )
 int AudioTrack::arm()
 {
         PENTER;
+        if (m_frozenClip) {
+                info().information(tr("Track %1 is frozen, unfreeze it to record").arg(m_name));
+                return -1;
+        }
         set_armed(true);
         return 1;
 }
@@ -263,10 +302,46 @@ int AudioTrack::process( nframes_t nframes )
         return 0;
     }
 
+    LookaheadRenderer* lookahead = m_sheet->get_lookahead_renderer();
+
+    if (m_lookahead && lookahead->owns(m_lookahead)) {
+        // Rendered ahead of the transport by the LookaheadRenderer
+        processResult = lookahead->read(m_lookahead, m_processBus, nframes);
+    } else if (m_rtFrozenClip) {
+        // Clips, plugins and fader are rendered into the frozen clip
+        m_processBus->silence_buffers(nframes);
+        processResult = qMax(m_rtFrozenClip->process(nframes, m_sheet->get_transport_location(), m_sheet->get_clip_render_bus(), m_processBus), 0);
+    } else {
+        processResult = render(nframes, m_sheet->get_transport_location(), m_processBus, m_sheet->get_clip_render_bus(), true);
+    }
+
+    process_stem(nframes);
+
+    // TODO: is there a situation where we still want to call process_post_sends
+    // even if processresult == 0?
+    if (processResult) {
+        if (!m_isArmed) {
+            m_processBus->process_monitoring(m_vumonitors);
+        }
+
+        // And finally do the post sends
+        process_post_sends(nframes);
+    }
+
+    return processResult;
+}
+
+// Renders the clips through the plugin chain and fader into bus, the clips
+// are processed in clipBus. The pre sends read from the process bus, so only
+// pass sends if bus is the process bus.
+int AudioTrack::render(nframes_t nframes, const TimeRef& location, AudioBus* bus, AudioBus* clipBus, bool sends)
+{
+    int processResult = 0;
+
     // Get the 'render bus' from sheet, a bit hackish solution, but
     // it avoids to have a dedicated render bus for each Track,
     // or buffers located on the heap...
-    m_processBus->silence_buffers(nframes);
+    bus->silence_buffers(nframes);
 
     int result;
     float panFactor;
@@ -280,7 +355,7 @@ int AudioTrack::process( nframes_t nframes )
         }
 
 
-        result = clip->process(nframes);
+        result = clip->process(nframes, location, clipBus, bus);
 
         if (result <= 0) {
             continue;
@@ -290,22 +365,24 @@ int AudioTrack::process( nframes_t nframes )
     }
 
     // Then do the pre-send:
-    process_pre_sends(nframes);
+    if (sends) {
+        process_pre_sends(nframes);
+    }
 
 
     // Then apply the pre fader plugins;
-    m_pluginChain->process_pre_fader(m_processBus, nframes);
+    m_pluginChain->process_pre_fader(bus, nframes);
 
 
     // Apply PAN
-    if ( (m_processBus->get_channel_count() >= 1) && (m_pan > 0) )  {
+    if ( (bus->get_channel_count() >= 1) && (m_pan > 0) )  {
         panFactor = 1 - m_pan;
-        Mixer::apply_gain_to_buffer(m_processBus->get_buffer(0, nframes), nframes, panFactor);
+        Mixer::apply_gain_to_buffer(bus->get_buffer(0, nframes), nframes, panFactor);
     }
 
-    if ( (m_processBus->get_channel_count() >= 2) && (m_pan < 0) )  {
+    if ( (bus->get_channel_count() >= 2) && (m_pan < 0) )  {
         panFactor = 1 + m_pan;
-        Mixer::apply_gain_to_buffer(m_processBus->get_buffer(1, nframes), nframes, panFactor);
+        Mixer::apply_gain_to_buffer(bus->get_buffer(1, nframes), nframes, panFactor);
     }
 
 
@@ -313,33 +390,68 @@ int AudioTrack::process( nframes_t nframes )
     // so wrap the process buffers into a audio_sample_t**
     // FIXME make it future proof so it can deal with any amount of channels?
     audio_sample_t* mixdown[6];
-    for(uint chan=0; chan<m_processBus->get_channel_count(); chan++) {
-        mixdown[chan] = m_processBus->get_buffer(chan, nframes);
+    for(uint chan=0; chan<bus->get_channel_count(); chan++) {
+        mixdown[chan] = bus->get_buffer(chan, nframes);
     }
 
-    TimeRef location = m_sheet->get_transport_location();
     TimeRef endlocation = location + TimeRef(nframes, audiodevice().get_sample_rate());
     // Apply fader Gain/envelope
-    m_fader->process_gain(mixdown, location, endlocation, nframes, m_processBus->get_channel_count());
+    m_fader->process_gain(mixdown, location, endlocation, nframes, bus->get_channel_count());
 
 
     // Post fader plugins now
-    processResult |= m_pluginChain->process_post_fader(m_processBus, nframes);
+    processResult |= m_pluginChain->process_post_fader(bus, nframes);
 
-    // TODO: is there a situation where we still want to call process_post_sends
-    // even if processresult == 0?
-    if (processResult) {
-        if (!m_isArmed) {
-            m_processBus->process_monitoring(m_vumonitors);
-        }
+    return processResult;
+}
 
-        // And finally do the post sends
-        process_post_sends(nframes);
-    }
+// Renders the Track for freezing it, called from the export thread while the
+// transport is stopped. Sends and the mute state of the Track are ignored.
+int AudioTrack::render_freeze(nframes_t nframes)
+{
+    int processResult = render(nframes, m_sheet->get_transport_location(), m_processBus, m_sheet->get_clip_render_bus(), false);
+
+    process_stem(nframes);
 
     return processResult;
 }
 
+// Renders the Track for the nframes starting at location into bus, called
+// from the LookaheadRenderer thread for Tracks which can_render_ahead().
+int AudioTrack::render_ahead(nframes_t nframes, const TimeRef& location, AudioBus* bus, AudioBus* clipBus)
+{
+    if (m_rtFrozenClip) {
+        bus->silence_buffers(nframes);
+        return qMax(m_rtFrozenClip->process(nframes, location, clipBus, bus), 0);
+    }
+
+    return render(nframes, location, bus, clipBus, false);
+}
+
+// Returns false if any of the clips within the nframes starting at location
+// is still waiting for the DiskIO thread to fill its ring buffers.
+bool AudioTrack::is_ready_for(const TimeRef& location, nframes_t nframes)
+{
+    if (m_rtFrozenClip) {
+        return m_rtFrozenClip->is_ready_for(location, nframes);
+    }
+
+    apill_foreach(AudioClip* clip, AudioClip*, m_rtAudioClips) {
+        if (!clip->is_ready_for(location, nframes)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Tracks which don't depend on live input, and don't feed the process bus
+// to a pre send, can be rendered ahead of the transport.
+bool AudioTrack::can_render_ahead() const
+{
+    return !m_isArmed && m_preSends.size() == 0;
+}
+
 
 TCommand* AudioTrack::toggle_arm()
 {
@@ -352,6 +464,72 @@ TCommand* AudioTrack::toggle_arm()
 }
 
 
+/**
+ * 	Freezes the Track: its clips, plugins and fader are rendered offline into
+ *	a file in the audio sources dir, which is played back instead, so plugin
+ *	heavy Tracks cost disk bandwidth instead of CPU. Freezing leaves the clips
+ *	and plugins of the Track untouched, toggling a frozen Track unfreezes it.
+ */
+TCommand* AudioTrack::toggle_freeze()
+{
+        if (m_frozenClip) {
+                set_frozen_clip(nullptr);
+                return nullptr;
+        }
+
+        if (m_isArmed) {
+                info().information(tr("Track %1 is armed for recording, it can't be frozen").arg(m_name));
+                return nullptr;
+        }
+
+        // The frozen file holds the post fader signal only
+        if (!get_pre_sends().isEmpty()) {
+                info().information(tr("Track %1 has pre fader sends, it can't be frozen").arg(m_name));
+                return nullptr;
+        }
+
+        TimeRef startlocation(LLONG_MAX);
+        TimeRef endlocation;
+        get_render_range(startlocation, endlocation);
+
+        if (startlocation >= endlocation) {
+                info().information(tr("Track %1 has no audio to freeze").arg(m_name));
+                return nullptr;
+        }
+
+        m_sheet->get_project()->freeze_track(this);
+
+        return nullptr;
+}
+
+/**
+ * 	Makes the Track play \a clip instead of rendering its clips and plugin
+ *	chain, or restores normal processing if \a clip is null.
+ */
+void AudioTrack::set_frozen_clip(AudioClip* clip)
+{
+        AudioClip* previous = m_frozenClip;
+        m_frozenClip = clip;
+
+        if (clip) {
+                clip->set_track(this);
+                resources_manager()->mark_clip_added(clip);
+        }
+
+        if (m_sheet->is_transport_rolling()) {
+                THREAD_SAVE_INVOKE(this, clip, private_set_frozen_clip(AudioClip*));
+        } else {
+                private_set_frozen_clip(clip);
+        }
+
+        if (previous) {
+                previous->removed_from_track();
+                resources_manager()->mark_clip_removed(previous);
+        }
+
+        emit frozenChanged(m_frozenClip != nullptr);
+}
+
 TCommand* AudioTrack::silence_others( )
 {
         PCommand* command = new PCommand(this, "solo", tr("Silence Other Tracks"));
@@ -454,12 +632,22 @@ void AudioTrack::private_audioclip_added(AudioClip *clip)
 {
     m_audioClips.append(clip);
     qSort(m_audioClips.begin(), m_audioClips.end(), AudioClip::isLeftMostClip);
+
+    connect(clip, SIGNAL(muteChanged()), this, SLOT(invalidate_lookahead()));
+    connect(clip, SIGNAL(fadeAdded(FadeCurve*)), this, SLOT(invalidate_lookahead()));
+    connect(clip, SIGNAL(fadeRemoved(FadeCurve*)), this, SLOT(invalidate_lookahead()));
+
     emit audioClipAdded(clip);
 }
 
 void AudioTrack::private_audioclip_removed(AudioClip* clip)
 {
     m_audioClips.removeAll(clip);
+
+    disconnect(clip, SIGNAL(muteChanged()), this, SLOT(invalidate_lookahead()));
+    disconnect(clip, SIGNAL(fadeAdded(FadeCurve*)), this, SLOT(invalidate_lookahead()));
+    disconnect(clip, SIGNAL(fadeRemoved(FadeCurve*)), this, SLOT(invalidate_lookahead()));
+
     emit audioClipRemoved(clip);
 }
 
@@ -472,6 +660,8 @@ void AudioTrack::clip_position_changed(AudioClip * clip)
     } else {
         private_clip_position_changed(clip);
     }
+
+    invalidate_lookahead();
 }
 
 void AudioTrack::private_clip_position_changed(AudioClip *clip)
@@ -479,6 +669,20 @@ void AudioTrack::private_clip_position_changed(AudioClip *clip)
     m_rtAudioClips.sort(clip);
 }
 
+void AudioTrack::private_set_frozen_clip(AudioClip* clip)
+{
+    m_rtFrozenClip = clip;
+}
+
+// Makes the LookaheadRenderer render this Track again from a bit after the
+// transport location on, the part in between is played as rendered before.
+void AudioTrack::invalidate_lookahead()
+{
+    if (m_lookahead) {
+        m_lookahead->invalid = 1;
+    }
+}
+
 TCommand* AudioTrack::toggle_show_clip_volume_automation()
 {
 	m_showClipVolumeAutomation = !m_showClipVolumeAutomation;
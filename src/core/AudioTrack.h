@@ -33,6 +33,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "defines.h"
 
 class Sheet;
+struct LookaheadBuffer;
 
 
 class AudioTrack : public Track
@@ -65,6 +66,16 @@ public :
         bool armed();
         int disarm();
         int process(nframes_t nframes);
+        int render_freeze(nframes_t nframes);
+        int render_ahead(nframes_t nframes, const TimeRef& location, AudioBus* bus, AudioBus* clipBus);
+        bool is_ready_for(const TimeRef& location, nframes_t nframes);
+        bool can_render_ahead() const;
+
+        LookaheadBuffer* get_lookahead_buffer() const {return m_lookahead;}
+        void set_lookahead_buffer(LookaheadBuffer* buffer) {m_lookahead = buffer;}
+
+        bool is_frozen() const {return m_frozenClip != nullptr;}
+        void set_frozen_clip(AudioClip* clip);
 
 protected:
         void add_input_bus(AudioBus* bus);
@@ -74,9 +85,14 @@ private :
 
         // only to be accessed/modified by AudioThread
         APILinkedList 	m_rtAudioClips;
+        AudioClip*      m_rtFrozenClip{};
 
         // only to be accessed from GUI thread
         QList<AudioClip*>   m_audioClips;
+        AudioClip*          m_frozenClip{};
+
+        // Owned by the LookaheadRenderer of the Sheet
+        LookaheadBuffer*    m_lookahead{};
 
         int             m_numtakes{};
         bool            m_isArmed{};
@@ -84,6 +100,7 @@ private :
 
         void set_armed(bool armed);
         void init();
+        int render(nframes_t nframes, const TimeRef& location, AudioBus* bus, AudioBus* clipBus, bool sends);
 
 signals:
         void audioClipAdded(AudioClip* clip);
@@ -93,11 +110,13 @@ signals:
         void privateAudioClipRemoved(AudioClip* clip);
 
         void armedChanged(bool isArmed);
+        void frozenChanged(bool isFrozen);
 
 public slots:
         void clip_position_changed(AudioClip* clip);
 
         TCommand* toggle_arm();
+        TCommand* toggle_freeze();
         TCommand* silence_others();
 	TCommand* toggle_show_clip_volume_automation();
 
@@ -108,6 +127,8 @@ private slots:
         void private_audioclip_removed(AudioClip* clip);
 
         void private_clip_position_changed(AudioClip* clip);
+        void private_set_frozen_clip(AudioClip* clip);
+        void invalidate_lookahead();
 };
 
 #endif
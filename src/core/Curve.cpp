@@ -157,11 +157,12 @@ int Curve::process(
 	}
 	
 	// Calculate the vector, an apply to the buffer including the makeup gain.
-        get_vector(startlocation.universal_frame(), endlocation.universal_frame(), m_session->mixdown, nframes);
+        audio_sample_t* mixdown = m_session->get_mixdown_buffer();
+        get_vector(startlocation.universal_frame(), endlocation.universal_frame(), mixdown, nframes);
 	
 	for (uint chan=0; chan<channels; ++chan) {
 		for (nframes_t n = 0; n < nframes; ++n) {
-                        buffer[chan][n] *= (m_session->mixdown[n] * makeupgain);
+                        buffer[chan][n] *= (mixdown[n] * makeupgain);
 		}
 	}
 	
@@ -0,0 +1,439 @@
+/*
+Copyright (C) 2026 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "DecodeCache.h"
+
+#include "ResampleAudioReader.h"
+#include "ReadSource.h"
+#include "ProjectManager.h"
+#include "Project.h"
+#include "TConfig.h"
+#include "Mixer.h"
+#include "Utils.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QVector>
+#include <QtEndian>
+#include <QStringList>
+#include <climits>
+
+#if defined (Q_OS_UNIX)
+#include <utime.h>
+#endif
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+
+static const int WAV_HEADER_SIZE = 44;
+static const nframes_t DECODE_CHUNK_SIZE = 16384;
+
+
+DecodeCache& decode_cache()
+{
+	static DecodeCache cache;
+	return cache;
+}
+
+
+DecodeCache::DecodeCache()
+{
+	m_abort = 0;
+
+	m_thread = new QThread;
+	moveToThread(m_thread);
+	m_thread->start(QThread::LowPriority);
+
+	connect(this, SIGNAL(newJob()), this, SLOT(process_jobs()), Qt::QueuedConnection);
+}
+
+
+DecodeCache::~DecodeCache()
+{
+	stop();
+
+	m_thread->exit(0);
+
+	if (!m_thread->wait(1000)) {
+		m_thread->terminate();
+	}
+
+	delete m_thread;
+}
+
+
+bool DecodeCache::is_compressed(const QString& decoder)
+{
+	return (decoder == "flac" || decoder == "vorbis" || decoder == "mad" || decoder == "wavpack");
+}
+
+
+static QString cache_name(qint64 sourceId, uint rate)
+{
+	if (rate) {
+		return QString::number(sourceId) + "-" + QString::number(rate);
+	}
+	return QString::number(sourceId);
+}
+
+
+/**
+ * 	Returns the file name of the best cache file of \a source for playback at
+ *	\a outputRate. If the best one doesn't exist yet, a job to create it is
+ *	queued (or resumed), and the next best existing cache file, or an empty
+ *	string is returned. cacheFileReady() is emitted once the job has finished.
+ *
+ *	Sources at another rate then \a outputRate are resampled to \a outputRate
+ *	at the best converter quality, if Conversion/BackgroundResampling is set.
+ *	Compressed sources are decoded at their own rate otherwise.
+
+	This function is thread save.
+ */
+QString DecodeCache::request(ReadSource* source, uint outputRate)
+{
+	Project* project = pm().get_project();
+	if (!project) {
+		return QString();
+	}
+
+	bool resample = (outputRate != source->get_file_rate()) &&
+			config().get_property("Conversion", "BackgroundResampling", false).toBool();
+
+	if (!resample && !is_compressed(source->get_decoder_type())) {
+		return QString();
+	}
+
+	Job job;
+	job.sourceId = source->get_id();
+	job.fileName = source->get_filename();
+	job.decoder = source->get_decoder_type();
+	job.cacheDir = project->get_root_dir() + "/decodecache/";
+	job.cacheName = cache_name(job.sourceId, resample ? outputRate : 0);
+	job.outputRate = resample ? outputRate : 0;
+	job.channels = source->get_channel_count();
+
+	QString cacheFile = job.cacheDir + job.cacheName + ".wav";
+
+	if (QFile::exists(cacheFile)) {
+		touch(cacheFile);
+		return cacheFile;
+	}
+
+	QMutexLocker locker(&m_mutex);
+
+	if (!m_queued.contains(job.cacheName)) {
+		m_queued.insert(job.cacheName);
+		m_jobs.append(job);
+		m_abort = 0;
+
+		emit newJob();
+	}
+
+	locker.unlock();
+
+	return resample ? get_cache_file(source, source->get_file_rate()) : QString();
+}
+
+
+/**
+ * 	Returns the file name of the complete cache file of \a source resampled
+ *	to \a outputRate, else that of the decoded copy of a compressed \a source,
+ *	or an empty string if neither exists (yet).
+ */
+QString DecodeCache::get_cache_file(ReadSource* source, uint outputRate)
+{
+	Project* project = pm().get_project();
+
+	if (!project) {
+		return QString();
+	}
+
+	QString cacheDir = project->get_root_dir() + "/decodecache/";
+	QStringList candidates;
+
+	if (outputRate != source->get_file_rate()) {
+		candidates << cacheDir + cache_name(source->get_id(), outputRate) + ".wav";
+	}
+	if (is_compressed(source->get_decoder_type())) {
+		candidates << cacheDir + cache_name(source->get_id(), 0) + ".wav";
+	}
+
+	foreach(const QString& cacheFile, candidates) {
+		if (QFile::exists(cacheFile)) {
+			touch(cacheFile);
+			return cacheFile;
+		}
+	}
+
+	return QString();
+}
+
+
+// Marks the cache file as recently used, eviction removes the
+// files with the oldest modification time first.
+void DecodeCache::touch(const QString& cacheFile)
+{
+#if defined (Q_OS_UNIX)
+	utime(QFile::encodeName(cacheFile).constData(), nullptr);
+#else
+	Q_UNUSED(cacheFile);
+#endif
+}
+
+
+// ReadSources report the cache files they stream from, these are
+// never evicted to make room for new ones.
+void DecodeCache::file_opened(const QString& cacheFile)
+{
+	QMutexLocker locker(&m_mutex);
+	++m_openFiles[QDir::cleanPath(cacheFile)];
+}
+
+
+void DecodeCache::file_closed(const QString& cacheFile)
+{
+	QMutexLocker locker(&m_mutex);
+
+	QString path = QDir::cleanPath(cacheFile);
+	if (--m_openFiles[path] <= 0) {
+		m_openFiles.remove(path);
+	}
+}
+
+
+// Interrupts the running job and drops the pending ones, the partially
+// written cache files are resumed when the sources are requested again.
+void DecodeCache::stop()
+{
+	QMutexLocker locker(&m_mutex);
+
+	m_abort = 1;
+	m_jobs.clear();
+	m_queued.clear();
+}
+
+
+void DecodeCache::process_jobs()
+{
+	forever {
+		m_mutex.lock();
+		if (m_jobs.isEmpty()) {
+			m_mutex.unlock();
+			return;
+		}
+		Job job = m_jobs.first();
+		m_mutex.unlock();
+
+		int result = process_job(job);
+
+		m_mutex.lock();
+		if (!m_jobs.isEmpty() && m_jobs.first().cacheName == job.cacheName) {
+			m_jobs.removeFirst();
+		}
+		// Failed jobs stay in the queued set, so they are not retried
+		// over and over again during this session.
+		if (result == 0) {
+			m_queued.remove(job.cacheName);
+		}
+		m_mutex.unlock();
+
+		if (result > 0) {
+			emit cacheFileReady(job.sourceId, job.cacheDir + job.cacheName + ".wav");
+		}
+	}
+}
+
+
+static void write_wav_header(QFile& file, uint channels, uint rate, nframes_t frames)
+{
+	quint32 dataSize = quint32(frames) * channels * sizeof(float);
+
+	QDataStream stream(&file);
+	stream.setByteOrder(QDataStream::LittleEndian);
+
+	stream.writeRawData("RIFF", 4);
+	stream << quint32(WAV_HEADER_SIZE - 8 + dataSize);
+	stream.writeRawData("WAVE", 4);
+	stream.writeRawData("fmt ", 4);
+	stream << quint32(16);
+	stream << quint16(3);	// WAVE_FORMAT_IEEE_FLOAT
+	stream << quint16(channels);
+	stream << quint32(rate);
+	stream << quint32(rate * channels * sizeof(float));
+	stream << quint16(channels * sizeof(float));
+	stream << quint16(32);
+	stream.writeRawData("data", 4);
+	stream << dataSize;
+}
+
+
+// Returns 1 if the cache file was completed, 0 if the job was interrupted
+// and a negative value if the source can't be cached.
+int DecodeCache::process_job(const Job& job)
+{
+	PENTER;
+
+	QString partialName = job.cacheDir + job.cacheName + ".partial.wav";
+	QString cacheName = job.cacheDir + job.cacheName + ".wav";
+
+	if (!QDir().mkpath(job.cacheDir)) {
+		qWarning("DecodeCache: could not create %s", QS_C(job.cacheDir));
+		return -1;
+	}
+
+	ResampleAudioReader* reader = new ResampleAudioReader(job.fileName, job.decoder);
+	if (!reader->is_valid()) {
+		delete reader;
+		return -1;
+	}
+
+	// Offline we can afford the best converter there is
+	if (job.outputRate) {
+		reader->set_converter_type(SRC_SINC_BEST_QUALITY);
+		reader->set_output_rate(job.outputRate);
+	}
+
+	uint channels = reader->get_num_channels();
+	nframes_t nframes = reader->get_nframes();
+	qint64 frameSize = channels * sizeof(float);
+	qint64 totalSize = WAV_HEADER_SIZE + qint64(nframes) * frameSize;
+
+	// The RIFF size fields are 32 bit
+	if (channels != job.channels || totalSize > qint64(UINT_MAX)) {
+		delete reader;
+		return -1;
+	}
+
+	QFile file(partialName);
+	if (!file.open(QIODevice::ReadWrite)) {
+		qWarning("DecodeCache: could not open %s", QS_C(partialName));
+		delete reader;
+		return -1;
+	}
+
+	// Resume from the last complete frame of a previous run
+	nframes_t done = 0;
+	if (file.size() > WAV_HEADER_SIZE) {
+		done = nframes_t(qMin(qint64(nframes), (file.size() - WAV_HEADER_SIZE) / frameSize));
+	}
+
+	if (!make_room(job.cacheDir, job.cacheName, totalSize - file.size())) {
+		PMESG("DecodeCache: quota exceeded, not caching %s", QS_C(job.fileName));
+		file.remove();
+		delete reader;
+		return -1;
+	}
+
+	// The header holds the final sizes, the .partial suffix marks the file
+	// as incomplete until it's renamed.
+	file.seek(0);
+	write_wav_header(file, channels, reader->get_output_rate(), nframes);
+	file.resize(WAV_HEADER_SIZE + qint64(done) * frameSize);
+	file.seek(file.size());
+
+	DecodeBuffer buffer;
+	QVector<float> interleaved(int(DECODE_CHUNK_SIZE * channels));
+	bool failed = false;
+
+	while (done < nframes && !m_abort) {
+		nframes_t read = reader->read_from(&buffer, done, qMin(DECODE_CHUNK_SIZE, nframes - done));
+		if (read == 0) {
+			failed = true;
+			break;
+		}
+
+		Mixer::interleave(buffer.destination, interleaved.data(), read, channels);
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+		quint32* words = reinterpret_cast<quint32*>(interleaved.data());
+		for (uint i = 0; i < read * channels; ++i) {
+			words[i] = qToLittleEndian(words[i]);
+		}
+#endif
+
+		qint64 bytes = qint64(read) * frameSize;
+		if (file.write(reinterpret_cast<const char*>(interleaved.constData()), bytes) != bytes) {
+			qWarning("DecodeCache: could not write to %s", QS_C(partialName));
+			failed = true;
+			break;
+		}
+
+		done += read;
+	}
+
+	delete reader;
+
+	if (failed) {
+		file.remove();
+		return -1;
+	}
+
+	file.close();
+
+	if (done < nframes) {
+		return 0;
+	}
+
+	if (!QFile::rename(partialName, cacheName)) {
+		QFile::remove(partialName);
+		return -1;
+	}
+
+	return 1;
+}
+
+
+// Removes the least recently used cache files until required more bytes
+// fit within the quota. The files of cacheName itself and the files which
+// are streamed from are never removed.
+bool DecodeCache::make_room(const QString& cacheDir, const QString& cacheName, qint64 required)
+{
+	qint64 quota = qint64(config().get_property("Hardware", "decodecachequota", 4096).toInt()) * 1024 * 1024;
+
+	QDir dir(cacheDir);
+	QFileInfoList files = dir.entryInfoList(QStringList() << "*.wav", QDir::Files, QDir::Time | QDir::Reversed);
+
+	qint64 used = 0;
+	foreach(const QFileInfo& info, files) {
+		used += info.size();
+	}
+
+	QMutexLocker locker(&m_mutex);
+
+	for (int i = 0; i < files.size() && (used + required) > quota; ++i) {
+		const QFileInfo& info = files.at(i);
+		if (info.fileName().section('.', 0, 0) == cacheName ||
+		    m_openFiles.contains(QDir::cleanPath(info.absoluteFilePath()))) {
+			continue;
+		}
+		if (QFile::remove(info.absoluteFilePath())) {
+			used -= info.size();
+		}
+	}
+
+	return (used + required) <= quota;
+}
+
+//eof
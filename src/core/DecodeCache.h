@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2026 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QList>
+#include <QSet>
+#include <QHash>
+
+#include "defines.h"
+
+class ReadSource;
+
+// Decodes compressed audio sources (flac, vorbis, mp3, wavpack) once in the
+// background into a float wav file in the project's decodecache directory,
+// and resamples sources which don't match the output rate at the best
+// converter quality. Streaming from the cache file is much cheaper than
+// decoding and resampling in the DiskIO thread. Jobs are resumable, the cache
+// is bounded by a disk quota and the least recently used files are evicted
+// first, except those a ReadSource streams from.
+class DecodeCache : public QObject
+{
+	Q_OBJECT
+
+public:
+	QString request(ReadSource* source, uint outputRate);
+	QString get_cache_file(ReadSource* source, uint outputRate);
+	void touch(const QString& cacheFile);
+	void file_opened(const QString& cacheFile);
+	void file_closed(const QString& cacheFile);
+	void stop();
+
+	static bool is_compressed(const QString& decoder);
+
+private:
+	struct Job {
+		qint64		sourceId;
+		QString		fileName;
+		QString		decoder;
+		QString		cacheDir;
+		QString		cacheName;
+		uint		outputRate;
+		uint		channels;
+	};
+
+	QThread*	m_thread;
+	QMutex		m_mutex;
+	QList<Job>	m_jobs;
+	QSet<QString>	m_queued;
+	QHash<QString, int> m_openFiles;
+	volatile size_t	m_abort;
+
+	int process_job(const Job& job);
+	bool make_room(const QString& cacheDir, const QString& cacheName, qint64 required);
+
+	DecodeCache();
+	~DecodeCache();
+	DecodeCache(const DecodeCache&);
+	// allow this function to create one instance
+	friend DecodeCache& decode_cache();
+
+private slots:
+	void process_jobs();
+
+signals:
+	void newJob();
+	void cacheFileReady(qint64 sourceId, const QString& cacheFile);
+};
+
+// use this function to access the DecodeCache
+DecodeCache& decode_cache();
+
+#endif
+
+//eof
@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include "DiskIO.h"
 #include "Sheet.h"
+#include "LookaheadRenderer.h"
 #include <QThread>
 
 #if defined (Q_OS_UNIX)
@@ -133,6 +134,145 @@ void DiskIOThread::run()
 
 
 
+/************** READ BUFFER POOL ************/
+
+ReadBufferPool& readbuffer_pool()
+{
+    static ReadBufferPool pool;
+    return pool;
+}
+
+ReadBufferPool::ReadBufferPool()
+{
+    m_usedBytes = m_freeBytes = 0;
+    m_budget = qint64(config().get_property("Hardware", "readbufferbudget", 512).toInt()) * 1024 * 1024;
+}
+
+ReadBufferPool::~ReadBufferPool()
+{
+    foreach(RingBufferNPT<char>* buffer, m_freeBuffers) {
+        delete buffer;
+    }
+}
+
+/**
+ *	Returns a ring buffer of size bytes, or nullptr if the read buffer
+ *	budget doesn't allow another buffer of this size.
+ *
+ *	Note: This function is thread save.
+ */
+RingBufferNPT<char>* ReadBufferPool::acquire(size_t size)
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 bytes = qint64(size);
+
+    for (int i=0; i<m_freeBuffers.size(); ++i) {
+        RingBufferNPT<char>* buffer = m_freeBuffers.at(i);
+        if (buffer->bufsize() == size) {
+            m_freeBuffers.removeAt(i);
+            m_freeBytes -= bytes;
+            m_usedBytes += bytes;
+            buffer->reset();
+            return buffer;
+        }
+    }
+
+    // Make room by dropping unused buffers of other sizes first
+    while ((m_usedBytes + m_freeBytes + bytes) > m_budget && !m_freeBuffers.isEmpty()) {
+        RingBufferNPT<char>* buffer = m_freeBuffers.takeFirst();
+        m_freeBytes -= qint64(buffer->bufsize());
+        delete buffer;
+    }
+
+    if ((m_usedBytes + bytes) > m_budget) {
+        return nullptr;
+    }
+
+    m_usedBytes += bytes;
+
+    return new RingBufferNPT<char>(size);
+}
+
+/**
+ *	Gives buffer back to the pool. The caller has to make sure nobody
+ *	accesses the buffer anymore.
+ *
+ *	Note: This function is thread save.
+ */
+void ReadBufferPool::release(RingBufferNPT<char>* buffer)
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 bytes = qint64(buffer->bufsize());
+    m_usedBytes -= bytes;
+
+    if (m_freeBuffers.size() >= MAX_FREE_BUFFERS) {
+        delete buffer;
+        return;
+    }
+
+    m_freeBuffers.append(buffer);
+    m_freeBytes += bytes;
+}
+
+
+ReaderPool& reader_pool()
+{
+    static ReaderPool pool;
+    return pool;
+}
+
+ReaderPool::ReaderPool()
+{
+    m_maxOpenReaders = config().get_property("Hardware", "maxopenreaders", 256).toInt();
+}
+
+/**
+ *	Registers source as having an open audio reader. If this brings the
+ *	amount of open readers over the limit, the least recently used readers
+ *	which are not in use right now are closed.
+ *
+ *	Note: This function is thread save.
+ */
+void ReaderPool::reader_opened(ReadSource* source)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_sources.removeAll(source);
+    m_sources.append(source);
+
+    for (int i=0; i<m_sources.size() - 1 && m_sources.size() > m_maxOpenReaders; ) {
+        if (m_sources.at(i)->close_idle_reader()) {
+            m_sources.removeAt(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Marks the reader of source as most recently used
+void ReaderPool::reader_used(ReadSource* source)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_sources.isEmpty() || m_sources.last() == source) {
+        return;
+    }
+
+    if (m_sources.removeOne(source)) {
+        m_sources.append(source);
+    }
+}
+
+void ReaderPool::reader_closed(ReadSource* source)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_sources.removeAll(source);
+}
+
+
 /** 	\class DiskIO 
  *	\brief handles all the read's and write's of AudioSources in it's private thread.
  *
@@ -189,6 +329,9 @@ void DiskIO::seek()
     Q_ASSERT_X(m_sheet->threadId != QThread::currentThreadId (), "DiskIO::seek", "Error, running in gui thread!!!!!");
 #endif
 
+    // The LookaheadRenderer reads from the ring buffers too
+    m_sheet->get_lookahead_renderer()->wait_until_idle();
+
     mutex.lock();
 
     m_stopWork = 0;
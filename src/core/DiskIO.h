@@ -28,6 +28,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QPair>
 
 #include "defines.h"
+#include "RingBufferNPT.h"
 
 class ReadSource;
 class WriteSource;
@@ -43,6 +44,60 @@ struct BufferStatus {
 	bool	needSync;
 };
 
+// Hands out the (byte sized) ring buffers of all ReadSources, and keeps the
+// total amount of memory used by them within the Hardware/readbufferbudget
+// limit (in MB). Released buffers are kept for reuse as long as the budget allows.
+class ReadBufferPool
+{
+public:
+	RingBufferNPT<char>* acquire(size_t bytes);
+	void release(RingBufferNPT<char>* buffer);
+
+private:
+	static const int MAX_FREE_BUFFERS = 32;
+
+	QMutex		m_mutex;
+	QList<RingBufferNPT<char>*>	m_freeBuffers;
+	qint64		m_usedBytes;
+	qint64		m_freeBytes;
+	qint64		m_budget;
+
+	ReadBufferPool();
+	~ReadBufferPool();
+	ReadBufferPool(const ReadBufferPool&);
+	// allow this function to create one instance
+	friend ReadBufferPool& readbuffer_pool();
+};
+
+// use this function to access the ReadBufferPool
+ReadBufferPool& readbuffer_pool();
+
+
+// Keeps track of the ReadSources which have their audio reader opened, and
+// closes the least recently used idle readers when more then
+// Hardware/maxopenreaders are open. ReadSources reopen them on demand.
+class ReaderPool
+{
+public:
+	void reader_opened(ReadSource* source);
+	void reader_used(ReadSource* source);
+	void reader_closed(ReadSource* source);
+
+private:
+	QMutex		m_mutex;
+	QList<ReadSource*>	m_sources;
+	int		m_maxOpenReaders;
+
+	ReaderPool();
+	ReaderPool(const ReaderPool&);
+	// allow this function to create one instance
+	friend ReaderPool& reader_pool();
+};
+
+// use this function to access the ReaderPool
+ReaderPool& reader_pool();
+
+
 class DiskIO : public QObject
 {
 	Q_OBJECT
@@ -22,7 +22,9 @@
 
 #include "Export.h"
 #include "Project.h"
+#include "WriteSource.h"
 #include <cstdio>
+#include <cstring>
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -74,10 +76,12 @@ ExportSpecification::ExportSpecification()
 	name = "";
 	writeToc = false;
 	normalize = false;
+	stems = false;
 	renderpass = WRITE_TO_HARDDISK;
 	normvalue = 1.0;
 	peakvalue = 0.0;
 	isCdExport = false;
+	freezeTrack = nullptr;
 }
 
 int ExportSpecification::is_valid()
@@ -145,3 +149,156 @@ int ExportSpecification::is_valid()
 
 	return 1;
 }
+
+
+// Starts out with the format of spec
+ExportTarget::ExportTarget(const ExportSpecification& spec)
+	: writerType(spec.writerType)
+	, extraFormat(spec.extraFormat)
+	, sample_rate(spec.sample_rate)
+	, data_width(spec.data_width)
+	, src_quality(spec.src_quality)
+	, dither_type(spec.dither_type)
+{
+}
+
+
+// The amount of rendered blocks which can wait for the encoder
+static const int MAX_QUEUED_BLOCKS = 4;
+
+/**
+ * 	Creates an encoder for the file described by \a spec, in the format of
+ *	\a target if set. The encoder works on its own copy of \a spec, so the
+ *	caller can move on rendering while earlier blocks are still being written.
+ */
+ExportEncoder::ExportEncoder(ExportSpecification* spec, const ExportTarget* target)
+	: m_spec(*spec)
+{
+	m_spec.dataF = nullptr;
+	m_spec.targets.clear();
+
+	if (target) {
+		m_spec.writerType = target->writerType;
+		m_spec.extraFormat = target->extraFormat;
+		m_spec.sample_rate = target->sample_rate;
+		m_spec.data_width = target->data_width;
+		m_spec.src_quality = target->src_quality;
+		m_spec.dither_type = target->dither_type;
+		m_spec.name += target->nameSuffix;
+	}
+	m_finishing = false;
+	m_failed = false;
+
+	for (int i = 0; i < MAX_QUEUED_BLOCKS; ++i) {
+		Block* block = new Block;
+		block->data.resize(int(spec->blocksize * spec->channels));
+		m_freeBlocks.append(block);
+	}
+
+	m_writer = new WriteSource(&m_spec);
+}
+
+ExportEncoder::~ExportEncoder()
+{
+	if (isRunning()) {
+		finish_export();
+	}
+
+	delete m_writer;
+	qDeleteAll(m_blocks);
+	qDeleteAll(m_freeBlocks);
+}
+
+int ExportEncoder::prepare_export()
+{
+	// WriteSource validates the spec, which needs a data buffer by then
+	m_spec.dataF = m_freeBlocks.first()->data.data();
+
+	if (m_writer->prepare_export() == -1) {
+		return -1;
+	}
+
+	start();
+
+	return 1;
+}
+
+/**
+ * 	Queues \a nframes interleaved frames rendered at \a pos for encoding.
+ *	Blocks while the queue is full. Returns 0 on success, or -1 if writing
+ *	an earlier block failed.
+ */
+int ExportEncoder::process(const audio_sample_t* interleaved, nframes_t nframes, const TimeRef& pos)
+{
+	QMutexLocker locker(&m_mutex);
+
+	while (m_freeBlocks.isEmpty() && !m_failed) {
+		m_blockFreed.wait(&m_mutex);
+	}
+
+	if (m_failed) {
+		return -1;
+	}
+
+	Block* block = m_freeBlocks.takeLast();
+	locker.unlock();
+
+	Q_ASSERT(int(nframes * m_spec.channels) <= block->data.size());
+	memcpy(block->data.data(), interleaved, nframes * m_spec.channels * sizeof(audio_sample_t));
+	block->nframes = nframes;
+	block->pos = pos;
+
+	locker.relock();
+	m_blocks.enqueue(block);
+	m_blockQueued.wakeOne();
+
+	return 0;
+}
+
+// Waits until all queued blocks are written and closes the file
+int ExportEncoder::finish_export()
+{
+	m_mutex.lock();
+	m_finishing = true;
+	m_blockQueued.wakeOne();
+	m_mutex.unlock();
+
+	wait();
+
+	m_writer->finish_export();
+
+	return m_failed ? -1 : 1;
+}
+
+void ExportEncoder::run()
+{
+	forever {
+		m_mutex.lock();
+		while (m_blocks.isEmpty() && !m_finishing) {
+			m_blockQueued.wait(&m_mutex);
+		}
+		if (m_blocks.isEmpty()) {
+			m_mutex.unlock();
+			break;
+		}
+		Block* block = m_blocks.dequeue();
+		bool failed = m_failed;
+		m_mutex.unlock();
+
+		// WriteSource reads the data and position from our spec
+		int result = 0;
+		if (!failed) {
+			m_spec.dataF = block->data.data();
+			m_spec.pos = block->pos;
+			result = m_writer->process(block->nframes);
+		}
+
+		m_mutex.lock();
+		if (result) {
+			m_failed = true;
+		}
+		m_freeBlocks.append(block);
+		m_blockFreed.wakeOne();
+		m_mutex.unlock();
+	}
+}
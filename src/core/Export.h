@@ -26,6 +26,10 @@ $Id: Export.h,v 1.20 2009/05/07 19:59:03 n_doebelin Exp $
 #include <QThread>
 #include <QString>
 #include <QMap>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
 
 #include <samplerate.h>
 
@@ -33,8 +37,28 @@ $Id: Export.h,v 1.20 2009/05/07 19:59:03 n_doebelin Exp $
 #include "gdither.h"
 
 class Project;
+class AudioTrack;
 class ExportThread;
 class Marker;
+class WriteSource;
+struct ExportSpecification;
+
+// The format of one output file of an export. Rendering once and encoding
+// to several targets at the same time saves a complete render per format.
+struct ExportTarget
+{
+	ExportTarget(const ExportSpecification& spec);
+
+	QString			writerType;
+	QMap<QString, QString>	extraFormat;
+	uint			sample_rate;
+	int			data_width;
+	int			src_quality;
+	GDitherType		dither_type;
+	// appended to the file name, to keep targets with the same extension apart
+	QString			nameSuffix;
+};
+
 
 struct ExportSpecification
 {
@@ -67,6 +91,10 @@ struct ExportSpecification
 	TimeRef      	totalTime;
 	TimeRef      	pos;
 	QMap<QString, QString>	extraFormat;
+	
+	/* when set, the rendered audio is written to each of these targets,
+	   instead of to the format described above */
+	QList<ExportTarget>	targets;
 
 	/* shared between UI thread and audio thread */
 
@@ -85,14 +113,19 @@ struct ExportSpecification
 	QString		cdrdaoToc;
 	bool		writeToc;
 	bool		normalize;
+	/* also write the post fader signal of each track and bus to its own file */
+	bool		stems;
 	int		renderpass;
 	float		peakvalue;
 	float 		normvalue;
 	bool 		resumeTransport;
 	TimeRef		resumeTransportLocation;
+	/* false if a sheet failed to render or the export was aborted */
 	bool		renderfinished;
 	bool		isCdExport;
         QList<Marker*>  markers;
+	/* when set, only this track is rendered, to freeze it */
+	AudioTrack*	freezeTrack;
 	
 	ExportThread* 	thread;
 };
@@ -119,4 +152,39 @@ private:
 };
 
 
+// Runs the WriteSource of an export in its own thread. Rendered blocks are
+// handed over through a bounded queue, so sample rate conversion, dithering
+// and encoding overlap with rendering the next blocks on another core.
+class ExportEncoder : public QThread
+{
+public:
+	ExportEncoder(ExportSpecification* spec, const ExportTarget* target = nullptr);
+	~ExportEncoder();
+
+	int prepare_export();
+	int process(const audio_sample_t* interleaved, nframes_t nframes, const TimeRef& pos);
+	int finish_export();
+
+protected:
+	void run();
+
+private:
+	struct Block {
+		QVector<audio_sample_t>	data;
+		nframes_t		nframes;
+		TimeRef			pos;
+	};
+
+	ExportSpecification	m_spec;
+	WriteSource*		m_writer;
+	QMutex			m_mutex;
+	QWaitCondition		m_blockQueued;
+	QWaitCondition		m_blockFreed;
+	QQueue<Block*>		m_blocks;
+	QList<Block*>		m_freeBlocks;
+	bool			m_finishing;
+	bool			m_failed;
+};
+
+
 #endif
@@ -167,7 +167,7 @@ int FadeCurve::set_state( const QDomNode & node )
 }
 
 
-void FadeCurve::process(AudioBus *bus, nframes_t nframes)
+void FadeCurve::process(AudioBus *bus, nframes_t nframes, const TimeRef& transportLocation)
 {
 
         if (is_bypassed()) {
@@ -184,7 +184,6 @@ void FadeCurve::process(AudioBus *bus, nframes_t nframes)
         TimeRef trackStartLocation, trackEndLocation, mix_pos;
         TimeRef fadeRange = TimeRef(get_range());
 
-        TimeRef transportLocation = m_session->get_transport_location();
         TimeRef upperRange = transportLocation + TimeRef(framesToProcess, outputRate);
 
 	
@@ -232,11 +231,12 @@ void FadeCurve::process(AudioBus *bus, nframes_t nframes)
 
         upperRange = mix_pos + TimeRef(framesToProcess, outputRate);
 
-        get_vector(mix_pos.universal_frame(), upperRange.universal_frame(), m_session->gainbuffer, framesToProcess);
+        audio_sample_t* gainbuffer = m_session->get_gain_buffer();
+        get_vector(mix_pos.universal_frame(), upperRange.universal_frame(), gainbuffer, framesToProcess);
 
         for (int chan=0; chan<bus->get_channel_count(); ++chan) {
                 for (nframes_t frame = 0; frame < framesToProcess; ++frame) {
-                        mixdown[chan][frame] *= m_session->gainbuffer[frame];
+                        mixdown[chan][frame] *= gainbuffer[frame];
                 }
         }
 }
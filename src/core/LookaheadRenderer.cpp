@@ -0,0 +1,435 @@
+/*
+Copyright (C) 2026 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#include "LookaheadRenderer.h"
+
+#include <AudioDevice.h>
+#include <AudioBus.h>
+#include <AudioChannel.h>
+#include "AudioTrack.h"
+#include "Sheet.h"
+#include "TConfig.h"
+#include "Tsar.h"
+
+#include <cstring>
+
+// Always put me below _all_ includes, this is needed
+// in case we run with memory leak detection enabled!
+#include "Debugger.h"
+
+
+LookaheadRenderer::LookaheadRenderer(Sheet* sheet)
+	: m_sheet(sheet)
+{
+	// A whole number of blocks, and enough of them to restart
+	// edited Tracks half the depth ahead of the transport
+	m_depth = config().get_property("Hardware", "AnticipativeDepth", 8192).toUInt();
+	m_depth = qMax(m_depth, 4 * BLOCK_SIZE);
+	m_depth = ((m_depth + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE;
+
+	m_channels = sheet->get_render_bus()->get_channel_count();
+
+	m_renderBus = create_bus("Lookahead Render Bus");
+	m_clipRenderBus = create_bus("Lookahead Clip Render Bus");
+
+	m_mixdown.resize(BLOCK_SIZE);
+	m_gainbuffer.resize(BLOCK_SIZE);
+
+	m_ownedCount = 0;
+	m_rate = audiodevice().get_sample_rate();
+	m_rtEpoch = m_seenEpoch = 0;
+	m_holdFrames = 0;
+	m_holding = false;
+
+	m_readPos = m_epoch = m_active = m_enabled = m_lockRequested = m_stop = m_rolling = 0;
+}
+
+LookaheadRenderer::~LookaheadRenderer()
+{
+	PENTERDES;
+
+	stop_thread();
+
+	qDeleteAll(m_buffers);
+
+	delete_bus(m_renderBus);
+	delete_bus(m_clipRenderBus);
+}
+
+// The channels of our buses are not created by the AudioDevice, which
+// would resize them to its period size when that changes.
+AudioBus* LookaheadRenderer::create_bus(const QString& name)
+{
+	BusConfig busConfig;
+	busConfig.name = name;
+	busConfig.type = "output";
+
+	AudioBus* bus = new AudioBus(busConfig);
+
+	for (uint chan=0; chan<m_channels; ++chan) {
+		AudioChannel* channel = new AudioChannel(name, chan, ChannelIsOutput);
+		channel->set_buffer_size(BLOCK_SIZE);
+		bus->add_channel(channel);
+	}
+
+	return bus;
+}
+
+void LookaheadRenderer::delete_bus(AudioBus* bus)
+{
+	for (uint chan=0; chan<bus->get_channel_count(); ++chan) {
+		delete bus->get_channel(chan);
+	}
+
+	delete bus;
+}
+
+void LookaheadRenderer::set_enabled(bool enabled)
+{
+	if (bool(m_enabled) == enabled) {
+		return;
+	}
+
+	if (enabled) {
+		m_enabled = 1;
+		m_stop = 0;
+		m_rolling = m_sheet->is_transport_rolling();
+
+		foreach(AudioTrack* track, m_sheet->get_audio_tracks()) {
+			add_track(track);
+		}
+
+		start(QThread::HighPriority);
+	} else {
+		m_enabled = 0;
+		stop_thread();
+	}
+
+	invalidate();
+}
+
+void LookaheadRenderer::stop_thread()
+{
+	m_waitMutex.lock();
+	m_stop = 1;
+	m_wakeup.wakeAll();
+	m_waitMutex.unlock();
+
+	wait();
+}
+
+// Called from the GUI thread when the transport starts or stops rolling
+void LookaheadRenderer::set_transport_rolling(bool rolling)
+{
+	QMutexLocker locker(&m_waitMutex);
+
+	m_rolling = rolling;
+	m_wakeup.wakeAll();
+}
+
+// Creates the buffer of track, the Track is handed over to the
+// renderer thread at the start of the next epoch.
+void LookaheadRenderer::add_track(AudioTrack* track)
+{
+	if (!m_enabled || track->get_lookahead_buffer()) {
+		return;
+	}
+
+	track->set_lookahead_buffer(create_buffer(track));
+}
+
+LookaheadBuffer* LookaheadRenderer::create_buffer(AudioTrack* track)
+{
+	LookaheadBuffer* buffer = new LookaheadBuffer;
+	buffer->track = track;
+	buffer->data.fill(0.0f, int(m_channels * m_depth));
+	buffer->owner = 0;
+	buffer->rendered = 0;
+	buffer->invalid = 0;
+
+	m_buffers.append(buffer);
+
+	return buffer;
+}
+
+// Makes the audio thread start a new epoch, to be called after changes
+// of the set of Tracks which can be rendered ahead.
+void LookaheadRenderer::invalidate()
+{
+	m_epoch = m_epoch + 1;
+}
+
+// Returns once the renderer thread no longer reads from the ring buffers
+// of the ReadSources, after the audio thread has stopped the transport.
+void LookaheadRenderer::wait_until_idle()
+{
+	QMutexLocker locker(&m_mutex);
+}
+
+
+//
+//  Function called in RealTime AudioThread processing path
+//
+//  Returns false if the transport should not roll this cycle, because the
+//  renderer thread didn't fill the buffers of a new epoch yet.
+//
+bool LookaheadRenderer::prepare_cycle(nframes_t nframes)
+{
+	if (!m_active && !m_enabled) {
+		return true;
+	}
+
+	if (!m_active || m_epoch != m_seenEpoch) {
+		if (!start_epoch(nframes)) {
+			// The Tracks of the previous epoch stay with the
+			// renderer thread if there is one
+			return m_active;
+		}
+	}
+
+	if (m_holding) {
+		m_holdFrames += nframes;
+
+		// Don't hold on forever if the renderer thread can't keep up
+		if (m_holdFrames < m_depth) {
+			for (int i=0; i<m_ownedCount; ++i) {
+				if (m_owned[i]->rendered < m_readPos + nframes) {
+					return false;
+				}
+			}
+		}
+
+		m_holding = false;
+	}
+
+	return true;
+}
+
+//
+//  Function called in RealTime AudioThread processing path
+//
+bool LookaheadRenderer::start_epoch(nframes_t nframes)
+{
+	if (!m_mutex.tryLock()) {
+		m_lockRequested = 1;
+		return false;
+	}
+	m_lockRequested = 0;
+
+	bool restart = !m_active;
+	size_t previous = m_rtEpoch;
+
+	m_seenEpoch = m_epoch;
+	++m_rtEpoch;
+	m_ownedCount = 0;
+
+	if (restart) {
+		m_startLocation = m_sheet->get_transport_location();
+		m_rate = audiodevice().get_sample_rate();
+		m_readPos = 0;
+		m_holding = true;
+		m_holdFrames = 0;
+	}
+
+	// Edited Tracks restart half the depth ahead, the periods
+	// of the audio device have to fit in there
+	if (m_enabled && nframes <= m_depth / 4) {
+		apill_foreach(AudioTrack* track, AudioTrack*, m_sheet->m_rtAudioTracks) {
+			LookaheadBuffer* buffer = track->get_lookahead_buffer();
+			if (!buffer || !track->can_render_ahead() || m_ownedCount == MAX_TRACKS) {
+				continue;
+			}
+
+			// Tracks which were owned by the renderer thread
+			// already keep what was rendered for them
+			if (restart || buffer->owner != previous) {
+				buffer->rendered = m_readPos;
+				buffer->invalid = 0;
+			}
+
+			buffer->owner = m_rtEpoch;
+			m_owned[m_ownedCount++] = buffer;
+		}
+	}
+
+	m_active = 1;
+
+	m_mutex.unlock();
+
+	return true;
+}
+
+//
+//  Function called in RealTime AudioThread processing path
+//
+void LookaheadRenderer::finish_cycle(nframes_t nframes)
+{
+	if (m_active) {
+		m_readPos = m_readPos + nframes;
+	}
+}
+
+//
+//  Function called in RealTime AudioThread processing path
+//
+void LookaheadRenderer::transport_stopped()
+{
+	m_active = 0;
+}
+
+//
+//  Function called in RealTime AudioThread processing path
+//
+//  Copies the next nframes of buffer into bus, the part which
+//  wasn't rendered in time is silenced.
+//
+int LookaheadRenderer::read(LookaheadBuffer* buffer, AudioBus* bus, nframes_t nframes)
+{
+	size_t readPos = m_readPos;
+	size_t rendered = buffer->rendered;
+	nframes_t available = 0;
+
+	if (rendered > readPos) {
+		available = nframes_t(qMin(rendered - readPos, size_t(nframes)));
+	}
+
+	nframes_t offset = nframes_t(readPos % m_depth);
+	nframes_t first = qMin(available, m_depth - offset);
+
+	for (uint chan=0; chan<bus->get_channel_count(); ++chan) {
+		audio_sample_t* dst = bus->get_buffer(chan, nframes);
+
+		if (chan >= m_channels) {
+			memset(dst, 0, nframes * sizeof(audio_sample_t));
+			continue;
+		}
+
+		const audio_sample_t* src = buffer->data.constData() + chan * m_depth;
+
+		memcpy(dst, src + offset, first * sizeof(audio_sample_t));
+		memcpy(dst + first, src, (available - first) * sizeof(audio_sample_t));
+		memset(dst + available, 0, (nframes - available) * sizeof(audio_sample_t));
+	}
+
+	return available ? 1 : 0;
+}
+
+
+void LookaheadRenderer::run()
+{
+	TSession::set_thread_buffers(m_mixdown.data(), m_gainbuffer.data());
+
+	while (!m_stop) {
+		if (!m_rolling) {
+			// Nothing to render ahead of a transport that doesn't roll
+			m_waitMutex.lock();
+			while (!m_rolling && !m_stop) {
+				m_wakeup.wait(&m_waitMutex);
+			}
+			m_waitMutex.unlock();
+			continue;
+		}
+
+		// Let the audio thread take the lock when it's waiting for it
+		if (m_lockRequested || !render_pass()) {
+			msleep(1);
+		}
+	}
+
+	TSession::set_thread_buffers(nullptr, nullptr);
+}
+
+// Renders a block of each owned Track which has room for it,
+// returns false if there was nothing to render.
+bool LookaheadRenderer::render_pass()
+{
+	QMutexLocker locker(&m_mutex);
+
+	if (!m_active) {
+		return false;
+	}
+
+	bool busy = false;
+
+	for (int i=0; i<m_ownedCount && !m_lockRequested; ++i) {
+		busy |= render_block(m_owned[i]);
+	}
+
+	return busy;
+}
+
+bool LookaheadRenderer::render_block(LookaheadBuffer* buffer)
+{
+	size_t readPos = m_readPos;
+
+	if (buffer->invalid) {
+		buffer->invalid = 0;
+		// Play what was rendered before the edit for a little longer,
+		// that gives the DiskIO thread time to resync the clips.
+		size_t restart = readPos + m_depth / 2;
+		if (buffer->rendered > restart) {
+			buffer->rendered = restart;
+		}
+	}
+
+	if (buffer->rendered < readPos) {
+		// Fell behind the audio thread, continue at the transport
+		buffer->rendered = readPos;
+	}
+
+	size_t rendered = buffer->rendered;
+
+	if (rendered + BLOCK_SIZE > readPos + m_depth) {
+		return false;
+	}
+
+	TimeRef location = m_startLocation + TimeRef(nframes_t(rendered), m_rate);
+	AudioTrack* track = buffer->track;
+
+	tsar().lock_rt_lists();
+
+	// Wait for the DiskIO thread, unless the audio thread is about to run dry
+	if (!track->is_ready_for(location, BLOCK_SIZE) && (rendered - readPos) >= BLOCK_SIZE) {
+		tsar().unlock_rt_lists();
+		return false;
+	}
+
+	track->render_ahead(BLOCK_SIZE, location, m_renderBus, m_clipRenderBus);
+
+	tsar().unlock_rt_lists();
+
+	nframes_t offset = nframes_t(rendered % m_depth);
+	nframes_t first = qMin(nframes_t(BLOCK_SIZE), m_depth - offset);
+
+	for (uint chan=0; chan<m_channels; ++chan) {
+		const audio_sample_t* src = m_renderBus->get_buffer(chan, BLOCK_SIZE);
+		audio_sample_t* dst = buffer->data.data() + chan * m_depth;
+
+		memcpy(dst + offset, src, first * sizeof(audio_sample_t));
+		memcpy(dst, src + first, (BLOCK_SIZE - first) * sizeof(audio_sample_t));
+	}
+
+	buffer->rendered = rendered + BLOCK_SIZE;
+
+	return true;
+}
+
+//eof
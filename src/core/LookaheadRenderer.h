@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2026 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+#ifndef LOOKAHEAD_RENDERER_H
+#define LOOKAHEAD_RENDERER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <QVector>
+
+#include "defines.h"
+
+class Sheet;
+class AudioTrack;
+class AudioBus;
+
+// The rendered output of one AudioTrack, a ring buffer of depth frames
+// per channel. Positions are counted in frames since the transport started.
+struct LookaheadBuffer {
+	AudioTrack*		track;
+	QVector<audio_sample_t>	data;
+	size_t			owner;		// the epoch in which the renderer owns the track
+	volatile size_t		rendered;	// written by the renderer thread
+	volatile size_t		invalid;	// set by the gui thread on edits
+};
+
+// Anticipative processing: renders the AudioTracks of a Sheet which don't
+// depend on live input ahead of the transport in its own thread, into
+// buffers of Hardware/AnticipativeDepth frames. The audio thread only mixes
+// these buffers with the armed Tracks, so heavy plugin chains don't need to
+// fit in the period of the audio device anymore.
+//
+// Each start of the transport, seek, and change of the set of Tracks which
+// can be rendered ahead starts a new epoch, in which the audio thread hands
+// the Tracks over to the renderer thread. Edits of a Track make the renderer
+// render it again from half the depth after the transport location on.
+class LookaheadRenderer : public QThread
+{
+public:
+	LookaheadRenderer(Sheet* sheet);
+	~LookaheadRenderer();
+
+	static const nframes_t BLOCK_SIZE = 1024;
+	static const int MAX_TRACKS = 256;
+
+	void set_enabled(bool enabled);
+	void add_track(AudioTrack* track);
+	void invalidate();
+	void wait_until_idle();
+	void set_transport_rolling(bool rolling);
+	bool is_enabled() const {return m_enabled;}
+
+	// Audio thread only
+	bool prepare_cycle(nframes_t nframes);
+	void finish_cycle(nframes_t nframes);
+	void transport_stopped();
+	bool owns(LookaheadBuffer* buffer) const {return m_active && buffer->owner == m_rtEpoch;}
+	int read(LookaheadBuffer* buffer, AudioBus* bus, nframes_t nframes);
+
+protected:
+	void run();
+
+private:
+	Sheet*		m_sheet;
+	AudioBus*	m_renderBus;
+	AudioBus*	m_clipRenderBus;
+	QMutex		m_mutex;
+	// The renderer thread sleeps on m_wakeup while the transport is stopped
+	QMutex		m_waitMutex;
+	QWaitCondition	m_wakeup;
+	QList<LookaheadBuffer*>	m_buffers;
+	QVector<audio_sample_t>	m_mixdown;
+	QVector<audio_sample_t>	m_gainbuffer;
+	nframes_t	m_depth;
+	uint		m_channels;
+
+	// Only modified by the audio thread while it holds m_mutex
+	LookaheadBuffer* m_owned[MAX_TRACKS];
+	int		m_ownedCount;
+	TimeRef		m_startLocation;
+	uint		m_rate;
+	size_t		m_rtEpoch;
+
+	// Only accessed by the audio thread
+	size_t		m_seenEpoch;
+	nframes_t	m_holdFrames;
+	bool		m_holding;
+
+	volatile size_t	m_readPos;
+	volatile size_t	m_epoch;
+	volatile size_t	m_active;
+	volatile size_t	m_enabled;
+	volatile size_t	m_lockRequested;
+	volatile size_t	m_stop;
+	volatile size_t	m_rolling;
+
+	bool start_epoch(nframes_t nframes);
+	bool render_pass();
+	bool render_block(LookaheadBuffer* buffer);
+	LookaheadBuffer* create_buffer(AudioTrack* track);
+	AudioBus* create_bus(const QString& name);
+	void delete_bus(AudioBus* bus);
+	void stop_thread();
+};
+
+#endif
+
+//eof
@@ -29,6 +29,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "defines.h"
 #include "Mixer.h"
 #include "FileHelpers.h"
+#include "TConfig.h"
 #include <QFileInfo>
 #include <QDateTime>
 #include <QMutexLocker>
@@ -85,6 +86,10 @@ Peak::Peak(AudioSource* source)
         // peak data creation, no m_source needed!
         m_source = nullptr;
     }
+
+    if (m_source) {
+        connect(&mvf(), SIGNAL(blocksAvailable(QString)), this, SLOT(micro_view_blocks_available(QString)));
+    }
 }
 
 Peak::~Peak()
@@ -205,6 +210,13 @@ void Peak::start_peak_loading()
     pp().queue_task(this);
 }
 
+void Peak::micro_view_blocks_available(const QString& filename)
+{
+    if (m_source && m_source->get_filename() == filename) {
+        emit microViewDataAvailable();
+    }
+}
+
 
 int Peak::calculate_peaks(
         int chan,
@@ -261,8 +273,15 @@ int Peak::calculate_peaks(
             //            peakDataCount = data->headerdata.peakDataSizeForLevel[index] - offset;
         }
 
-        nframes_t readposition = data->headerdata.headerSize + (data->headerdata.peakDataOffsets[index] + offset) * sizeof(peak_data_t);
-        produced = data->peakreader->read_from(data->peakdataDecodeBuffer, readposition, peakDataCount);
+        // Use the in memory copy of this level if the PeakLevelCache has one,
+        // this avoids a seek and read in the peak file for each paint event.
+        data->peakdataDecodeBuffer->check_buffers_capacity(peakDataCount, 1);
+        produced = plc().read(data->fileName, index, offset, peakDataCount, data->peakdataDecodeBuffer->destination[0]);
+
+        if (produced < 0) {
+            nframes_t readposition = data->headerdata.headerSize + (data->headerdata.peakDataOffsets[index] + offset) * sizeof(peak_data_t);
+            produced = data->peakreader->read_from(data->peakdataDecodeBuffer, readposition, peakDataCount);
+        }
 
         if (produced != peakDataCount) {
             //			PERROR("Could not read in all peak data, peakDataCount is %d, read count is %d", peakDataCount, produced);
@@ -284,74 +303,104 @@ int Peak::calculate_peaks(
 
         // Micro view mode
     }
+    // Micro view mode: decoding is done by the MicroViewFetcher thread, if the
+    // samples are not cached yet, return and wait for the microViewDataAvailable() signal
+    uint rate = m_source->get_file_rate();
+    // the file sample rate can differ from the 44100 Hz Peak assumes
+    qreal framesPerPixel = framesPerPeak * qreal(rate) / qreal(44100);
+
     // Calculate the amount of frames to be read
-    nframes_t toRead = qRound(peakDataCount * framesPerPeak * qreal(m_source->get_file_rate()) / qreal(44100));
+    nframes_t startFrame = startlocation.to_frame(rate);
+    nframes_t toRead = nframes_t(ceil(peakDataCount * framesPerPixel)) + 1;
 
-    nframes_t readFrames = m_source->file_read(data->peakdataDecodeBuffer, startlocation, toRead);
+    data->peakdataDecodeBuffer->check_buffers_capacity(qMax(toRead, nframes_t(peakDataCount)), 1);
+    audio_sample_t* samples = data->peakdataDecodeBuffer->destination[0];
 
-    if (readFrames == 0) {
-        return NO_PEAKDATA_FOUND;
-    }
+    int result = mvf().read(m_source->get_filename(), m_source->get_decoder_type(), chan, startFrame, toRead, samples);
 
-    if ( readFrames != toRead) {
-        PWARN(QString("Unable to read nframes %1 (only %2 available)").arg(toRead).arg(readFrames).toLatin1().data());
+    if (result < 0) {
+        return PEAKDATA_PENDING;
     }
 
-    int count = 0;
-    audio_sample_t sample;
+    nframes_t readFrames = nframes_t(result);
+
+    if (readFrames == 0) {
+        return NO_PEAKDATA_FOUND;
+    }
 
     // MicroView needs a buffer to store the calculated peakdata
     // our decodebuffer's readbuffer is large enough for this purpose
     // and it's no problem to use it at this point in the process chain.
     float* peakdata = data->peakdataDecodeBuffer->readBuffer;
+    int count = 0;
 
-    ProcessData pd;
-    // the stepSize depends on the real file sample rate, Peak assumes 44100 Hz
-    // so if the file sample rate differs, the stepSize becomes the ratio of
-    // the file sample rate and 44100
-    pd.stepSize = TimeRef(qreal(44100) / m_source->get_file_rate(), m_source->get_file_rate());
-    pd.processRange = TimeRef(framesPerPeak, m_source->get_file_rate());
-
-    for (uint i=0; i < readFrames; i++) {
+    // For each pixel, find the minimum and maximum sample of the range it
+    // covers and keep the one with the largest amplitude.
+    for (; count < peakDataCount; ++count) {
+        nframes_t from = nframes_t(count * framesPerPixel);
+        nframes_t to = nframes_t((count + 1) * framesPerPixel);
 
-        pd.processLocation += pd.stepSize;
+        if (from >= readFrames) {
+            break;
+        }
+        if (to <= from) {
+            // less then one sample per pixel
+            to = from + 1;
+        }
+        if (to > readFrames) {
+            to = readFrames;
+        }
 
-        sample = data->peakdataDecodeBuffer->destination[chan][i];
+        float min = samples[from];
+        float max = samples[from];
+        Mixer::find_peaks(samples + from, to - from, &min, &max);
 
-        pd.normValue = f_max(pd.normValue, fabsf(sample));
+        peakdata[count] = (max > fabsf(min)) ? max : min;
+    }
 
-        if (sample > pd.peakUpperValue) {
-            pd.peakUpperValue = sample;
-        }
+    // 		printf("framesPerPeak, peakDataCount, generated, readFrames %f, %d, %d, %d\n", framesPerPeak, peakDataCount, count, readFrames);
 
-        if (sample < pd.peakLowerValue) {
-            pd.peakLowerValue = sample;
-        }
+    // Assign the supplied buffer to the 'real' peakdata buffer.
+    *buffer = peakdata;
 
-        if (pd.processLocation >= pd.nextDataPointLocation) {
+    return count;
+}
 
-            if (pd.peakUpperValue > fabs(pd.peakLowerValue)) {
-                peakdata[count] = pd.peakUpperValue;
-            } else {
-                peakdata[count] = pd.peakLowerValue;
-            }
 
-            pd.peakUpperValue = -10.0;
-            pd.peakLowerValue = 10.0;
+// Schedules loading of the cached zoom level used for framesPerPeak for all
+// channels. Returns true if the level data is available in memory (or no
+// cached level is involved), false if it still has to be loaded.
+bool Peak::prefetch_zoom_level(qreal framesPerPeak)
+{
+    if (m_permanentFailure || framesPerPeak < 64) {
+        return true;
+    }
 
-            pd.nextDataPointLocation += pd.processRange;
-            count++;
+    if (!m_peaksAvailable) {
+        if (read_header() < 0) {
+            // Peak data will be build first, nothing to wait for
+            return true;
         }
     }
 
-    // 		printf("framesPerPeak, peakDataCount, generated, readFrames %f, %d, %d, %d\n", framesPerPeak, peakDataCount, count, readFrames);
+    int highbit;
+    unsigned long nearestpow2 = nearest_power_of_two(qRound(framesPerPeak), highbit);
+    int index = cache_index_lut()->value(nearestpow2, -1);
 
-    // 		PROFILE_END("Peak calculate_peaks");
+    if (index < 0) {
+        return true;
+    }
 
-    // Assign the supplied buffer to the 'real' peakdata buffer.
-    *buffer = peakdata;
+    bool available = true;
 
-    return count;
+    foreach(ChannelData* data, m_channelData) {
+        qint64 fileOffset = data->headerdata.headerSize + qint64(data->headerdata.peakDataOffsets[index]) * sizeof(peak_data_t);
+        if (!plc().prefetch(data->fileName, index, fileOffset, data->headerdata.peakDataSizeForLevel[index])) {
+            available = false;
+        }
+    }
+
+    return available;
 }
 
 
@@ -500,6 +549,8 @@ int Peak::finish_processing()
 
         data->file.close();
 
+        plc().invalidate(data->fileName);
+
         delete [] saveBuffer;
         delete data->pd;
         data->pd = nullptr;
@@ -830,6 +881,326 @@ void PeakProcessor::free_peak(Peak * peak)
 }
 
 
+/******** MICRO VIEW FETCHER CLASS **********/
+/********************************************/
+
+MicroViewFetcher& mvf()
+{
+    static MicroViewFetcher fetcher;
+    return fetcher;
+}
+
+
+MicroViewFetcher::MicroViewFetcher()
+{
+    // The cache size is in MB, the cost of a block is its size in KB
+    int cacheSize = config().get_property("AudioClip", "MicroViewCacheSize", 32).toInt();
+    m_blocks.setMaxCost(cacheSize * 1024);
+    // Keeping decoders open avoids re-opening the file for each block
+    m_readers.setMaxCost(8);
+
+    m_thread = new QThread;
+    moveToThread(m_thread);
+    m_thread->start();
+
+    connect(this, SIGNAL(newRequest()), this, SLOT(process_requests()), Qt::QueuedConnection);
+}
+
+
+MicroViewFetcher::~MicroViewFetcher()
+{
+    m_thread->exit(0);
+
+    if (!m_thread->wait(1000)) {
+        m_thread->terminate();
+    }
+
+    delete m_thread;
+}
+
+
+// Called from the GUI thread: copies the samples of channel chan for the range
+// start, start + count into dest if all blocks covering the range are in the
+// cache, else schedules the missing blocks for decoding and returns -1.
+int MicroViewFetcher::read(const QString& filename, const QString& decoder, uint chan,
+                                 nframes_t start, nframes_t count, audio_sample_t* dest)
+{
+    QFileInfo info(filename);
+    FileKey file;
+    file.filename = filename;
+    file.size = info.size();
+    file.modified = info.lastModified().toMSecsSinceEpoch();
+
+    QMutexLocker locker(&m_mutex);
+
+    uint firstBlock = start / BLOCK_SIZE;
+    uint lastBlock = (start + count - 1) / BLOCK_SIZE;
+    bool complete = true;
+
+    for (uint index = firstBlock; index <= lastBlock; ++index) {
+        BlockKey key(file, index);
+        if (m_blocks.contains(key)) {
+            continue;
+        }
+
+        complete = false;
+
+        if (!m_pending.contains(key)) {
+            Request request;
+            request.file = file;
+            request.decoder = decoder;
+            request.blockIndex = index;
+            // Most recent requests come first, they are the ones visible now.
+            m_requests.prepend(request);
+            m_pending.insert(key);
+        }
+    }
+
+    // Drop requests for views that most likely scrolled out of sight
+    while (m_requests.size() > MAX_PENDING_REQUESTS) {
+        Request request = m_requests.takeLast();
+        m_pending.remove(BlockKey(request.file, request.blockIndex));
+    }
+
+    if (!complete) {
+        emit newRequest();
+        return -1;
+    }
+
+    nframes_t copied = 0;
+
+    for (uint index = firstBlock; index <= lastBlock; ++index) {
+        SampleBlock* block = m_blocks.object(BlockKey(file, index));
+        nframes_t blockStart = index * BLOCK_SIZE;
+        nframes_t offset = (start + copied) - blockStart;
+
+        if (chan >= uint(block->channels.size()) || offset >= block->frames) {
+            break;
+        }
+
+        nframes_t toCopy = qMin(block->frames - offset, count - copied);
+        memcpy(dest + copied, block->channels.at(chan).constData() + offset, toCopy * sizeof(audio_sample_t));
+        copied += toCopy;
+
+        if (block->frames < nframes_t(BLOCK_SIZE)) {
+            // end of file
+            break;
+        }
+    }
+
+    return int(copied);
+}
+
+
+void MicroViewFetcher::process_requests()
+{
+    DecodeBuffer decodebuffer;
+
+    forever {
+        m_mutex.lock();
+
+        if (m_requests.isEmpty()) {
+            m_mutex.unlock();
+            return;
+        }
+
+        Request request = m_requests.takeFirst();
+        m_mutex.unlock();
+
+        AbstractAudioReader* reader = m_readers.object(request.file);
+        if (!reader) {
+            reader = AbstractAudioReader::create_audio_reader(request.file.filename, request.decoder);
+            if (reader) {
+                m_readers.insert(request.file, reader, 1);
+            }
+        }
+
+        SampleBlock* block = new SampleBlock;
+        block->frames = 0;
+
+        if (reader) {
+            block->frames = reader->read_from(&decodebuffer, request.blockIndex * BLOCK_SIZE, BLOCK_SIZE);
+            for (uint chan = 0; chan < reader->get_num_channels(); ++chan) {
+                QVector<audio_sample_t> samples(int(block->frames));
+                memcpy(samples.data(), decodebuffer.destination[chan], block->frames * sizeof(audio_sample_t));
+                block->channels.append(samples);
+            }
+        }
+
+        int cost = int((block->frames * block->channels.size() * sizeof(audio_sample_t)) / 1024) + 1;
+
+        m_mutex.lock();
+        BlockKey key(request.file, request.blockIndex);
+        m_pending.remove(key);
+        m_blocks.insert(key, block, cost);
+        m_mutex.unlock();
+
+        emit blocksAvailable(request.file.filename);
+    }
+}
+
+
+/******** PEAK LEVEL CACHE CLASS **********/
+/******************************************/
+
+PeakLevelCache& plc()
+{
+    static PeakLevelCache cache;
+    return cache;
+}
+
+
+class PeakLevelCache::LevelLoader : public QRunnable
+{
+public:
+    LevelLoader(PeakLevelCache* cache, const LevelKey& key, int generation, qint64 fileOffset, int count)
+        : m_cache(cache)
+        , m_key(key)
+        , m_generation(generation)
+        , m_fileOffset(fileOffset)
+        , m_count(count)
+    {}
+
+    void run()
+    {
+        // The Peak object reads from its own QFile in the GUI thread, use
+        // a separate handle so both don't share the file position.
+        QFile file(m_key.first);
+        QVector<peak_data_t>* data = new QVector<peak_data_t>(m_count);
+
+        if (file.open(QIODevice::ReadOnly) && file.seek(m_fileOffset)) {
+            qint64 length = qint64(m_count) * sizeof(peak_data_t);
+            qint64 read = file.read(reinterpret_cast<char*>(data->data()), length);
+            data->resize(int(qMax(qint64(0), read) / qint64(sizeof(peak_data_t))));
+        } else {
+            data->clear();
+        }
+
+        m_cache->level_loaded(m_key, m_generation, data);
+    }
+
+private:
+    PeakLevelCache* m_cache;
+    LevelKey	m_key;
+    int		m_generation;
+    qint64		m_fileOffset;
+    int		m_count;
+};
+
+
+PeakLevelCache::PeakLevelCache()
+{
+    // The cache size is in MB, the cost of a level is its size in KB
+    int cacheSize = config().get_property("AudioClip", "PeakLevelCacheSize", 32).toInt();
+    m_levels.setMaxCost(cacheSize * 1024);
+    // A single level should never push out all the others
+    m_maxLevelCost = (cacheSize * 1024) / 8;
+}
+
+
+PeakLevelCache::~PeakLevelCache()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+
+// Returns true if the level is in memory, else schedules it for loading when
+// it's not too large to be cached at all and returns false.
+bool PeakLevelCache::prefetch(const QString& peakfile, int level, qint64 fileOffset, int count)
+{
+    QMutexLocker locker(&m_mutex);
+
+    LevelKey key(peakfile, level);
+
+    if (m_levels.contains(key)) {
+        return true;
+    }
+
+    int cost = int((qint64(count) * sizeof(peak_data_t)) / 1024) + 1;
+    if (count <= 0 || cost > m_maxLevelCost) {
+        // Will be read from the peak file directly, nothing to wait for
+        return true;
+    }
+
+    if (!m_pending.contains(key)) {
+        m_pending.insert(key);
+        m_pool.start(new LevelLoader(this, key, m_generations.value(peakfile), fileOffset, count));
+    }
+
+    return false;
+}
+
+
+// Copies count peak values starting at offset into dest, returns the amount of
+// copied values, or -1 if the level isn't in memory.
+int PeakLevelCache::read(const QString& peakfile, int level, int offset, int count, audio_sample_t* dest)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QVector<peak_data_t>* data = m_levels.object(LevelKey(peakfile, level));
+
+    if (!data) {
+        return -1;
+    }
+
+    if (offset >= data->size()) {
+        return 0;
+    }
+
+    int toCopy = qMin(count, data->size() - offset);
+    const peak_data_t* src = data->constData() + offset;
+
+    for (int i = 0; i < toCopy; ++i) {
+        dest[i] = float(src[i]);
+    }
+
+    return toCopy;
+}
+
+
+void PeakLevelCache::invalidate(const QString& peakfile)
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int level = 0; level < Peak::ZOOM_LEVELS - Peak::SAVING_ZOOM_FACTOR; ++level) {
+        m_levels.remove(LevelKey(peakfile, level));
+        // A loader that is still running reads the old file, let the
+        // next prefetch() schedule a new one
+        m_pending.remove(LevelKey(peakfile, level));
+    }
+
+    m_generations[peakfile]++;
+}
+
+
+// Called from a thread pool thread
+void PeakLevelCache::level_loaded(const LevelKey& key, int generation, QVector<peak_data_t>* data)
+{
+    m_mutex.lock();
+
+    if (generation != m_generations.value(key.first)) {
+        // The peak file was rewritten while we were loading
+        m_mutex.unlock();
+        delete data;
+        return;
+    }
+
+    m_pending.remove(key);
+
+    if (data->isEmpty()) {
+        delete data;
+    } else {
+        int cost = int((data->size() * sizeof(peak_data_t)) / 1024) + 1;
+        m_levels.insert(key, data, cost);
+    }
+
+    m_mutex.unlock();
+
+    emit levelsAvailable();
+}
+
+
 PPThread::PPThread(PeakProcessor * pp)
 {
     m_pp = pp;
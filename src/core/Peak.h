@@ -30,6 +30,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QFile>
 #include <QHash>
 #include <QPair>
+#include <QCache>
+#include <QSet>
+#include <QVector>
+#include <QThreadPool>
 
 #include "defines.h"
 
@@ -39,6 +43,7 @@ class Peak;
 class PPThread;
 class DecodeBuffer;
 class PeakDataReader;
+class AbstractAudioReader;
 
 class PeakProcessor : public QObject
 {
@@ -90,6 +95,115 @@ private:
 PeakProcessor& pp();
 
 
+// Decodes audio for micro view painting in a separate thread, and keeps
+// the decoded sample blocks in a LRU cache shared by all Peaks of a file.
+class MicroViewFetcher : public QObject
+{
+	Q_OBJECT
+
+public:
+	static const int BLOCK_SIZE = 16384;
+	static const int MAX_PENDING_REQUESTS = 64;
+
+	int read(const QString& filename, const QString& decoder, uint chan,
+		       nframes_t start, nframes_t count, audio_sample_t* dest);
+
+private:
+	// A file is identified by its size and modification time too, so
+	// blocks of a file which is rewritten or replaced are never served.
+	struct FileKey {
+		QString filename;
+		qint64	size;
+		qint64	modified;
+
+		bool operator==(const FileKey& other) const {
+			return filename == other.filename && size == other.size && modified == other.modified;
+		}
+		friend uint qHash(const FileKey& key) {
+			return qHash(key.filename) ^ qHash(key.size) ^ qHash(key.modified);
+		}
+	};
+
+	typedef QPair<FileKey, uint> BlockKey;
+
+	struct SampleBlock {
+		QVector<QVector<audio_sample_t> > channels;
+		nframes_t frames;
+	};
+
+	struct Request {
+		FileKey	file;
+		QString decoder;
+		uint	blockIndex;
+	};
+
+	QThread*	m_thread;
+	QMutex		m_mutex;
+	QCache<BlockKey, SampleBlock>		m_blocks;
+	QCache<FileKey, AbstractAudioReader>	m_readers;
+	QList<Request>	m_requests;
+	QSet<BlockKey>	m_pending;
+
+	MicroViewFetcher();
+	~MicroViewFetcher();
+	MicroViewFetcher(const MicroViewFetcher&);
+	// allow this function to create one instance
+	friend MicroViewFetcher& mvf();
+
+private slots:
+	void process_requests();
+
+signals:
+	void newRequest();
+	void blocksAvailable(const QString& filename);
+};
+
+// use this function to access the MicroViewFetcher
+MicroViewFetcher& mvf();
+
+
+// Keeps complete cached zoom levels of peak files in memory. Levels are
+// loaded by a thread pool, so the levels of all visible clips can be
+// prepared in parallel before a zoom change is applied.
+class PeakLevelCache : public QObject
+{
+	Q_OBJECT
+
+public:
+	bool prefetch(const QString& peakfile, int level, qint64 fileOffset, int count);
+	int read(const QString& peakfile, int level, int offset, int count, audio_sample_t* dest);
+	void invalidate(const QString& peakfile);
+
+private:
+	typedef QPair<QString, int> LevelKey;
+
+	class LevelLoader;
+	friend class LevelLoader;
+
+	QMutex		m_mutex;
+	QThreadPool	m_pool;
+	QCache<LevelKey, QVector<peak_data_t> >	m_levels;
+	QSet<LevelKey>	m_pending;
+	// Bumped by invalidate(), levels loaded before that are dropped
+	QHash<QString, int>	m_generations;
+	int		m_maxLevelCost;
+
+	void level_loaded(const LevelKey& key, int generation, QVector<peak_data_t>* data);
+
+	PeakLevelCache();
+	~PeakLevelCache();
+	PeakLevelCache(const PeakLevelCache&);
+	// allow this function to create one instance
+	friend PeakLevelCache& plc();
+
+signals:
+	void levelsAvailable();
+};
+
+// use this function to access the PeakLevelCache
+PeakLevelCache& plc();
+
+
 class Peak : public QObject
 {
 	Q_OBJECT
@@ -108,13 +222,15 @@ public:
 
 	enum { 	NO_PEAKDATA_FOUND = -1,
 		NO_PEAK_FILE = -2,
-  		PERMANENT_FAILURE = -3
+  		PERMANENT_FAILURE = -3,
+		PEAKDATA_PENDING = -4
 	};
 		
 	void process(uint channel, const audio_sample_t* buffer, nframes_t frames);
     int prepare_processing(uint rate);
 	int finish_processing();
 	int calculate_peaks(int chan, float** buffer, TimeRef startlocation, int peakDataCount, qreal framesPerPeak);
+	bool prefetch_zoom_level(qreal framesPerPeak);
 
 	void close();
 	
@@ -190,9 +306,13 @@ private:
 	friend class PeakProcessor;
 	friend class PeakDataReader;
 
+private slots:
+	void micro_view_blocks_available(const QString& filename);
+
 signals:
 	void finished();
 	void progress(int m_progress);
+	void microViewDataAvailable();
 };
 
 class PeakDataReader
@@ -24,6 +24,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QTextStream>
 #include <QMessageBox>
 #include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QMutexLocker>
 
 #include <cfloat>
 #include <unistd.h>
@@ -31,6 +34,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioBus.h"
 #include "AudioChannel.h"
 #include "AudioTrack.h"
+#include "AudioClip.h"
 #include "TAudioDeviceClient.h"
 #include "Project.h"
 #include "Sheet.h"
@@ -38,6 +42,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Information.h"
 #include "TInputEventDispatcher.h"
 #include "ResourcesManager.h"
+#include "DecodeCache.h"
 #include "Export.h"
 #include "AudioDevice.h"
 #include "TConfig.h"
@@ -53,6 +58,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #define PROJECT_FILE_VERSION 	3
 #define MASTER_OUT_SOFTWARE_BUS_ID 1
+#define EXPORT_BLOCK_SIZE 8192
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
 #include "Debugger.h"
@@ -81,6 +87,7 @@ Project::Project(const QString& title)
         m_activeSessionId = m_activeSheetId = -1;
 	engineer = "";
         m_keyboardArrowNavigationSpeed = 4;
+        m_latencyProfile = -1;
         set_is_project_session(true);
 
 	m_useResampling = config().get_property("Conversion", "DynamicResampling", true).toBool();
@@ -117,6 +124,7 @@ Project::Project(const QString& title)
         connect(this, SIGNAL(privateSheetAdded(Sheet*)), this, SLOT(sheet_added(Sheet*)));
 	connect(this, SIGNAL(exportFinished()), this, SLOT(export_finished()), Qt::QueuedConnection);
         connect(&audiodevice(), SIGNAL(driverParamsChanged()), this, SLOT(audiodevice_params_changed()), Qt::DirectConnection);
+        connect(&audiodevice(), SIGNAL(bufferSizeChanged()), this, SLOT(audiodevice_buffer_size_changed()), Qt::DirectConnection);
 }
 
 
@@ -125,6 +133,9 @@ Project::~Project()
 	PENTERDES;
 	cpointer().remove_contextitem(this);
 
+        // Pending decode jobs write into our project dir
+        decode_cache().stop();
+
         delete m_resourcesManager;
 
         foreach(Sheet* sheet, m_sheets) {
@@ -1207,17 +1218,35 @@ int Project::export_project(ExportSpecification* spec)
 	return 0;
 }
 
+// Renders the sheets of the list sheetsToRender, independent sheets are
+// rendered concurrently when more than one sheet is exported.
 int Project::start_export(ExportSpecification* spec)
 {
 	PMESG("Starting export, rate is %d bitdepth is %d", spec->sample_rate, spec->data_width );
 
-        spec->blocksize = audiodevice().get_buffer_size(); //32768;
+	overallExportProgress = 0;
+	m_sheetExportProgress.clear();
+	sheetsToRender.clear();
 
-	spec->dataF = new audio_sample_t[spec->blocksize * spec->channels];
-	audio_sample_t* readbuffer = new audio_sample_t[spec->blocksize * spec->channels];
+	if (spec->freezeTrack) {
+		Sheet* sheet = spec->freezeTrack->get_sheet();
+		sheetsToRender.append(sheet);
 
-	overallExportProgress = renderedSheets = 0;
-	sheetsToRender.clear();
+		// Sends aren't rendered when freezing, so large blocks are always fine
+		spec->blocksize = EXPORT_BLOCK_SIZE;
+		spec->resumeTransport = false;
+		spec->resumeTransportLocation = sheet->get_transport_location();
+		spec->renderfinished = (sheet->freeze_track(spec, spec->freezeTrack) > 0);
+
+		resume_sheet_transport(sheet, spec);
+
+		spec->running = false;
+		overallExportProgress = 0;
+
+		emit exportFinished();
+
+		return 1;
+	}
 
         // determine which sheets to export, store them in sheetsToRender
 	if (spec->allSheets) {
@@ -1231,65 +1260,35 @@ int Project::start_export(ExportSpecification* spec)
 		}
 	}
 
-        // process each sheet in the list sheetsToRender. here we set the renderpass mode,
-        // and then call Sheet::repare_export() and Sheet::render(), which do the actual
-        // processing.
-        foreach(Sheet* sheet, sheetsToRender) {
-                PMESG("Starting export for sheet %lld", sheet->get_id());
-		emit exportStartedForSheet(sheet);
-		spec->resumeTransport = false;
-                spec->resumeTransportLocation = sheet->get_transport_location();
-		sheet->readbuffer = readbuffer;
-		
-		if (spec->normalize) {
-                        // start one render pass in mode "CALC_NORM_FACTOR"
-			spec->peakvalue = 0.0;
-			spec->renderpass = ExportSpecification::CALC_NORM_FACTOR;
-			
-			
-			if (sheet->prepare_export(spec) < 0) {
-				PERROR("Failed to prepare sheet for export");
-				continue;
-			}
-			
-                        sheet->start_export(spec);
-			
-            spec->normvalue = (1.0f - FLT_EPSILON) / spec->peakvalue;
-			
-            if (spec->peakvalue > 1.0f) {
-				info().critical(tr("Detected clipping in exported audio! (%1)")
-						.arg(coefficient_to_dbstring(spec->peakvalue)));
-			}
-			
-			if (!spec->breakout) {
-				info().information(tr("calculated norm factor: %1").arg(coefficient_to_dbstring(spec->normvalue)));
-			}
-		}
-
-                // start the real render pass in mode "WRITE_TO_HARDDISK"
-		spec->renderpass = ExportSpecification::WRITE_TO_HARDDISK;
-		
-                // first call Sheet::prepare_export()...
-		if (sheet->prepare_export(spec) < 0) {
-			PERROR("Failed to prepare sheet for export");
+	// Render and encode in large blocks instead of audio device periods
+	// to keep the per block overhead low, if all sheets allow it.
+	// Sheets which send to buses outside the sheet share those buses,
+	// so they can't be rendered at the same time either.
+	bool selfContained = true;
+	foreach(Sheet* sheet, sheetsToRender) {
+		if (!sheet->can_render_in_large_blocks()) {
+			selfContained = false;
 			break;
 		}
-		
-                // ... then start the render process and wait until it's finished
-                sheet->start_export(spec);
-		
-		if (!QMetaObject::invokeMethod(sheet, "set_transport_pos",  Qt::QueuedConnection, Q_ARG(TimeRef, spec->resumeTransportLocation))) {
-			printf("Invoking Sheet::set_transport_pos() failed\n");
-		}
-		if (spec->resumeTransport) {
-			if (!QMetaObject::invokeMethod(sheet, "start_transport",  Qt::QueuedConnection)) {
-				printf("Invoking Sheet::start_transport() failed\n");
+	}
+	spec->blocksize = selfContained ? EXPORT_BLOCK_SIZE : audiodevice().get_buffer_size();
+
+	spec->renderfinished = true;
+
+	if (sheetsToRender.size() > 1 && selfContained) {
+		export_sheets_in_parallel(spec);
+	} else {
+		spec->dataF = new audio_sample_t[spec->blocksize * spec->channels];
+
+		foreach(Sheet* sheet, sheetsToRender) {
+			if (export_sheet(sheet, spec) < 1) {
+				spec->renderfinished = false;
+				break;
 			}
 		}
-		if (spec->breakout) {
-			break;
-		}
-		renderedSheets++;
+
+		delete [] spec->dataF;
+		spec->dataF = nullptr;
 	}
 
 	PMESG("Export Finished");
@@ -1297,18 +1296,226 @@ int Project::start_export(ExportSpecification* spec)
 	spec->running = false;
 	overallExportProgress = 0;
 	
-	delete [] spec->dataF;
-	delete [] readbuffer;
-    spec->dataF = nullptr;
-
 	emit exportFinished();
 
 	return 1;
 }
 
+// Sets the renderpass mode and calls Sheet::prepare_export() and Sheet::start_export(),
+// which do the actual processing. Returns 1 if the next sheet can be exported, 0 if
+// the user aborted the export, and -1 if the sheet could not be prepared or rendered.
+int Project::export_sheet(Sheet* sheet, ExportSpecification* spec)
+{
+	PMESG("Starting export for sheet %lld", sheet->get_id());
+	emit exportStartedForSheet(sheet);
+	spec->resumeTransport = false;
+	spec->resumeTransportLocation = sheet->get_transport_location();
+	
+	// start the render pass in mode "WRITE_TO_HARDDISK", a normalized sheet
+	// is rendered once into a spool file and written from there when the
+	// norm factor is known.
+	spec->peakvalue = 0.0;
+	spec->renderpass = ExportSpecification::WRITE_TO_HARDDISK;
+	
+	// first call Sheet::prepare_export()...
+	if (sheet->prepare_export(spec) < 0) {
+		PERROR("Failed to prepare sheet for export");
+		return -1;
+	}
+	
+	// ... then start the render process and wait until it's finished
+	int result = sheet->start_export(spec);
+	
+	if (spec->normalize) {
+		if (spec->peakvalue > 1.0f) {
+			info().critical(tr("Detected clipping in exported audio! (%1)")
+					.arg(coefficient_to_dbstring(spec->peakvalue)));
+		}
+		
+		if (!spec->breakout) {
+			info().information(tr("calculated norm factor: %1").arg(coefficient_to_dbstring(spec->normvalue)));
+		}
+	}
+	
+	resume_sheet_transport(sheet, spec);
+
+	if (spec->breakout) {
+		return 0;
+	}
+	
+	return (result < 0) ? -1 : 1;
+}
+
+// Restores the transport position of sheet from before the export, and
+// starts the transport again if it was rolling.
+void Project::resume_sheet_transport(Sheet* sheet, ExportSpecification* spec)
+{
+	if (!QMetaObject::invokeMethod(sheet, "set_transport_pos",  Qt::QueuedConnection, Q_ARG(TimeRef, spec->resumeTransportLocation))) {
+		printf("Invoking Sheet::set_transport_pos() failed\n");
+	}
+	if (spec->resumeTransport) {
+		if (!QMetaObject::invokeMethod(sheet, "start_transport",  Qt::QueuedConnection)) {
+			printf("Invoking Sheet::start_transport() failed\n");
+		}
+	}
+}
+
+struct SheetExportQueue {
+	QMutex				mutex;
+	QList<Sheet*>			sheets;
+	QList<ExportSpecification*>	specs;
+	ExportSpecification*		spec;
+};
+
+// Each worker renders sheets from the queue with its own copy of the
+// ExportSpecification, the export state in it is per sheet.
+class Project::SheetExporter : public QRunnable
+{
+public:
+	SheetExporter(Project* project, SheetExportQueue* queue)
+		: m_project(project)
+		, m_queue(queue)
+	{}
+
+	void run()
+	{
+		ExportSpecification* spec = new ExportSpecification(*m_queue->spec);
+		spec->dataF = new audio_sample_t[spec->blocksize * spec->channels];
+
+		m_queue->mutex.lock();
+		m_queue->specs.append(spec);
+		m_queue->mutex.unlock();
+
+		forever {
+			m_queue->mutex.lock();
+			if (m_queue->sheets.isEmpty() || spec->breakout) {
+				m_queue->mutex.unlock();
+				break;
+			}
+			Sheet* sheet = m_queue->sheets.takeFirst();
+			m_queue->mutex.unlock();
+
+			// Like the sequential export, don't start any more sheets
+			// once one fails or the user aborted.
+			if (m_project->export_sheet(sheet, spec) < 1) {
+				m_queue->mutex.lock();
+				m_queue->spec->renderfinished = false;
+				m_queue->sheets.clear();
+				m_queue->mutex.unlock();
+				break;
+			}
+		}
+
+		m_queue->mutex.lock();
+		m_queue->specs.removeAll(spec);
+		m_queue->mutex.unlock();
+
+		delete [] spec->dataF;
+		delete spec;
+	}
+
+private:
+	Project*		m_project;
+	SheetExportQueue*	m_queue;
+};
+
+// Sheets have their own DiskIO, buses and transport location, so they
+// can be rendered at the same time. The calling export thread forwards
+// stop requests from the UI to the workers until all sheets are done.
+void Project::export_sheets_in_parallel(ExportSpecification* spec)
+{
+	SheetExportQueue queue;
+	queue.sheets = sheetsToRender;
+	queue.spec = spec;
+
+	int workers = qBound(1, QThread::idealThreadCount(), sheetsToRender.size());
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(workers);
+
+	for (int i = 0; i < workers; ++i) {
+		pool.start(new SheetExporter(this, &queue));
+	}
+
+	while (!pool.waitForDone(100)) {
+		QMutexLocker locker(&queue.mutex);
+		foreach(ExportSpecification* workerSpec, queue.specs) {
+			workerSpec->stop = spec->stop;
+			workerSpec->breakout = spec->breakout;
+		}
+	}
+}
+
 void Project::export_finished()
 {
         connect_to_audio_device();
+
+        if (m_freezeSpec) {
+                finish_freeze();
+        }
+}
+
+/**
+ * 	Renders the clips, plugins and fader of \a track in the export thread,
+ *	the track plays the rendered file once that's done. See AudioTrack::toggle_freeze()
+ * @return 0 if the freeze was started, -1 otherwise
+ */
+int Project::freeze_track(AudioTrack* track)
+{
+        if (m_freezeSpec || (m_exportThread && m_exportThread->isRunning())) {
+                info().information(tr("Export already in progress, can't freeze Track %1").arg(track->get_name()));
+                return -1;
+        }
+
+        ExportSpecification* spec = new ExportSpecification;
+        spec->freezeTrack = track;
+        spec->exportdir = track->get_sheet()->get_audio_sources_dir();
+        spec->writerType = "sndfile";
+        spec->extraFormat["filetype"] = "wav";
+        spec->data_width = 1;	// 1 means float
+        spec->channels = 2;
+        spec->sample_rate = audiodevice().get_sample_rate();
+        spec->dither_type = GDitherNone;
+        spec->isRecording = false;
+        spec->renderfinished = false;
+
+        m_freezeSpec = spec;
+
+        if (export_project(spec) == -1) {
+                m_freezeSpec = nullptr;
+                delete spec;
+                return -1;
+        }
+
+        return 0;
+}
+
+// Called in the GUI thread once the frozen file of a track is rendered
+void Project::finish_freeze()
+{
+        ExportSpecification* spec = m_freezeSpec;
+        m_freezeSpec = nullptr;
+
+        AudioTrack* track = spec->freezeTrack;
+        QString fileName = spec->name + ".wav";
+
+        if (spec->renderfinished) {
+                ReadSource* source = m_resourcesManager->import_source(spec->exportdir, fileName);
+                if (source) {
+                        AudioClip* clip = m_resourcesManager->new_audio_clip(spec->name);
+                        m_resourcesManager->set_source_for_clip(clip, source);
+                        clip->set_sheet(track->get_sheet());
+                        clip->set_track_start_location(spec->startLocation);
+                        track->set_frozen_clip(clip);
+                }
+        } else {
+                QFile::remove(spec->exportdir + fileName);
+                if (!spec->stop) {
+                        info().warning(tr("Freezing Track %1 failed").arg(track->get_name()));
+                }
+        }
+
+        delete spec;
 }
 
 /* returns the total time of the data that will be written to CD */
@@ -1421,13 +1628,25 @@ uint Project::get_bitdepth( ) const
 	return m_bitDepth;
 }
 
-void Project::set_sheet_export_progress(int progress)
+// Called from the export threads, the overall progress is the mean
+// progress of all sheets which are being exported.
+void Project::set_sheet_export_progress(Sheet* sheet, int progress)
 {
-	overallExportProgress = (progress / sheetsToRender.count()) + 
-			(renderedSheets * (100 / sheetsToRender.count()) );
+	QMutexLocker locker(&m_exportMutex);
+
+	m_sheetExportProgress.insert(sheet, progress);
+
+	int total = 0;
+	foreach(int sheetProgress, m_sheetExportProgress) {
+		total += sheetProgress;
+	}
+	overallExportProgress = total / qMax(1, sheetsToRender.count());
+	int overall = overallExportProgress;
 
-	emit sheetExportProgressChanged(progress);
-	emit overallExportProgressChanged(overallExportProgress);
+	locker.unlock();
+
+	emit sheetExportProgressChanged(sheet, progress);
+	emit overallExportProgressChanged(overall);
 }
 
 void Project::set_export_message(const QString& message)
@@ -1570,6 +1789,95 @@ void Project::audiodevice_params_changed()
         }
 }
 
+// Called from within the audio thread, the hardware buses keep their channels
+void Project::audiodevice_buffer_size_changed()
+{
+        uint bufferSize = audiodevice().get_buffer_size();
+        foreach(AudioChannel* channel, m_softwareAudioChannels) {
+                channel->set_buffer_size(bufferSize);
+        }
+
+        AudioBus* bus = m_masterOutBusTrack->get_process_bus();
+        for(uint i=0; i<bus->get_channel_count(); i++) {
+                AudioChannel* chan = bus->get_channel(i);
+                if (chan && chan->get_buffer_size() < bufferSize) {
+                        chan->set_buffer_size(bufferSize);
+                }
+        }
+}
+
+/**
+ * 	Switches the audio device to the period buffer size of the tracking or mixing
+ *	\a profile, set by Hardware/TrackingBufferSize and Hardware/MixingBufferSize.
+ *	The driver keeps running, see AudioDevice::change_buffer_size().
+ * @return 1 on success, -1 while recording or exporting, or if the buffer size can't be changed
+ */
+int Project::set_latency_profile(int profile)
+{
+        foreach(Sheet* sheet, m_sheets) {
+                if (sheet->is_recording()) {
+                        info().information(tr("Can't change the latency profile while recording"));
+                        return -1;
+                }
+        }
+
+        if (m_exportThread && m_exportThread->isRunning()) {
+                info().information(tr("Can't change the latency profile while exporting"));
+                return -1;
+        }
+
+        int bufferSize;
+        if (profile == TRACKING_PROFILE) {
+                bufferSize = config().get_property("Hardware", "TrackingBufferSize", 64).toInt();
+        } else {
+                bufferSize = config().get_property("Hardware", "MixingBufferSize", 2048).toInt();
+        }
+
+        if (bufferSize <= 0 || audiodevice().change_buffer_size(nframes_t(bufferSize)) < 0) {
+                return -1;
+        }
+
+        if (profile != m_latencyProfile) {
+                QString name = (profile == TRACKING_PROFILE) ? tr("Tracking") : tr("Mixing");
+                info().information(tr("Latency profile: %1 (%2 frames)").arg(name).arg(bufferSize));
+        }
+
+        m_latencyProfile = profile;
+
+        return 1;
+}
+
+TCommand* Project::toggle_latency_profile()
+{
+        set_latency_profile((m_latencyProfile == TRACKING_PROFILE) ? MIXING_PROFILE : TRACKING_PROFILE);
+
+        return nullptr;
+}
+
+// Uses the tracking profile as long as any track is armed, if Hardware/AutoLatencyProfile
+// is set. Recording Sheets are left alone, this is called again when recording stopped.
+void Project::update_latency_profile()
+{
+        if (!config().get_property("Hardware", "AutoLatencyProfile", false).toBool()) {
+                return;
+        }
+
+        bool armed = false;
+        foreach(Sheet* sheet, m_sheets) {
+                if (sheet->is_recording()) {
+                        return;
+                }
+                if (sheet->any_audio_track_armed()) {
+                        armed = true;
+                }
+        }
+
+        int profile = armed ? TRACKING_PROFILE : MIXING_PROFILE;
+        if (profile != m_latencyProfile) {
+                set_latency_profile(profile);
+        }
+}
+
 void Project::setup_default_hardware_buses()
 {
         int number = 1;
@@ -1667,6 +1975,7 @@ void Project::sheet_removed(Sheet *sheet)
 void Project::sheet_added(Sheet *sheet)
 {
         m_sheets.append(sheet);
+        connect(sheet, SIGNAL(recordingStateChanged()), this, SLOT(update_latency_profile()));
         emit sheetAdded(sheet);
 }
 
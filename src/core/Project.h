@@ -24,6 +24,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include <QString>
 #include <QList>
+#include <QHash>
+#include <QMutex>
 #include <QDomNode>
 #include "TSession.h"
 #include "APILinkedList.h"
@@ -34,6 +36,7 @@ class AudioBus;
 class AudioChannel;
 class Sheet;
 class Track;
+class AudioTrack;
 class ResourcesManager;
 struct ExportSpecification;
 class ExportThread;
@@ -120,7 +123,7 @@ public :
 	void set_message(const QString& pMessage);
 	void set_upc_ean(const QString& pUPC);
 	void set_genre(int pGenre);
-	void set_sheet_export_progress(int pogress);
+	void set_sheet_export_progress(Sheet* sheet, int progress);
         void set_export_message(const QString &message);
         void set_current_session(qint64 id);
 	void set_import_dir(const QString& dir);
@@ -142,9 +145,17 @@ public :
 	int load(const QString &projectfile = "");
 	int export_project(ExportSpecification* spec);
 	int start_export(ExportSpecification* spec);
+	int freeze_track(AudioTrack* track);
+        int set_latency_profile(int profile);
+        int get_latency_profile() const {return m_latencyProfile;}
 	int create_cdrdao_toc(ExportSpecification* spec);
         TimeRef get_cd_totaltime(ExportSpecification*);
 
+	enum {
+		MIXING_PROFILE,
+		TRACKING_PROFILE
+	};
+
 	enum {
 		SETTING_XML_CONTENT_FAILED = -1,
   		PROJECT_FILE_COULD_NOT_BE_OPENED = -2,
@@ -159,7 +170,9 @@ public :
 
 public slots:
         void track_property_changed();
+        void update_latency_profile();
         TCommand* remove_child_session();
+        TCommand* toggle_latency_profile();
 
 private:
 	Project(const QString& title);
@@ -170,6 +183,7 @@ private:
         APILinkedList           m_RtSheets;
 	ResourcesManager* 	m_resourcesManager;
         ExportThread*           m_exportThread;
+        ExportSpecification*    m_freezeSpec{};
         TAudioDeviceClient*	m_audiodeviceClient;
         SpectralMeter*          m_spectralMeter;
         CorrelationMeter*       m_correlationMeter;
@@ -188,6 +202,7 @@ private:
 	QString		m_importDir;
 	QString		m_discid;
 	int		m_genre{};
+	int		m_latencyProfile;
 	QString		m_upcEan;
 	QString		m_performer;
 	QString		m_arranger;
@@ -202,8 +217,9 @@ private:
         bool            m_sheetsAreTrackFolder{};
 
 	int		overallExportProgress{};
-	int 		renderedSheets{};
 	QList<Sheet* > 	sheetsToRender;
+	QHash<Sheet*, int> m_sheetExportProgress;
+	QMutex		m_exportMutex;
 
         qint64 		m_activeSheetId;
         qint64          m_activeSessionId;
@@ -211,6 +227,13 @@ private:
         int create(int sheetcount, int numtracks);
 	int create_audiosources_dir();
 	int create_peakfiles_dir();
+	int export_sheet(Sheet* sheet, ExportSpecification* spec);
+	void export_sheets_in_parallel(ExportSpecification* spec);
+	void resume_sheet_transport(Sheet* sheet, ExportSpecification* spec);
+	void finish_freeze();
+
+	class SheetExporter;
+	friend class SheetExporter;
 
         void prepare_audio_device(QDomDocument doc);
 	
@@ -218,6 +241,7 @@ private:
 
 private slots:
         void audiodevice_params_changed();
+        void audiodevice_buffer_size_changed();
 	void private_add_sheet(Sheet* sheet);
 	void private_remove_sheet(Sheet* sheet);
         void sheet_removed(Sheet* sheet);
@@ -231,7 +255,7 @@ signals:
 	void sheetAdded(Sheet*);
         void privateSheetRemoved(Sheet*);
         void sheetRemoved(Sheet*);
-        void sheetExportProgressChanged(int );
+        void sheetExportProgressChanged(Sheet* sheet, int progress);
 	void overallExportProgressChanged(int );
 	void exportFinished();
 	void exportStartedForSheet(Sheet* );
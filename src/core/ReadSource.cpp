@@ -29,7 +29,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Utils.h"
 #include "Sheet.h"
 #include "AudioDevice.h"
+#include "Mixer.h"
+#include "ResourcesManager.h"
+#include "DecodeCache.h"
+#include "Tsar.h"
 #include <QFile>
+#include <QFileInfo>
 #include "TConfig.h"
 #include <climits>
 
@@ -120,19 +125,22 @@ void ReadSource::private_init()
     m_clip = nullptr;
     m_audioReader = nullptr;
     m_bufferstatus = nullptr;
+	
+	connect(this, SIGNAL(residentDataSet(ResidentSourceData*)),
+		this, SLOT(resident_data_set(ResidentSourceData*)));
 }
 
 
 ReadSource::~ReadSource()
 {
 	PENTERDES;
-	for(int i=0; i<m_buffers.size(); ++i) {
-		delete m_buffers.at(i);
-	}
+	reader_pool().reader_closed(this);
+	release_rt_buffers();
 	
 	if (m_audioReader) {
 		delete m_audioReader;
 	}
+	set_used_cache_file(QString());
 	
 	if (m_bufferstatus) {
 		delete m_bufferstatus;
@@ -152,6 +160,10 @@ QDomNode ReadSource::get_state( QDomDocument doc )
 	node.setAttribute("length", m_length.universal_frame());
 	node.setAttribute("rate", m_rate);
 	node.setAttribute("decoder", m_decodertype);
+	node.setAttribute("frames", m_fileFrames);
+	node.setAttribute("filebitdepth", m_fileBitDepth);
+	node.setAttribute("filesize", m_fileSize);
+	node.setAttribute("filemodified", m_fileModified);
 
 	return node;
 }
@@ -172,6 +184,10 @@ int ReadSource::set_state( const QDomNode & node )
     m_origBitDepth = e.attribute("origbitdepth", "0").toUInt();
 	m_wasRecording = e.attribute("wasrecording", "0").toInt();
 	m_decodertype = e.attribute("decoder", "");
+	m_fileFrames = e.attribute("frames", "0").toUInt();
+	m_fileBitDepth = e.attribute("filebitdepth", "0").toUInt();
+	m_fileSize = e.attribute("filesize", "0").toLongLong();
+	m_fileModified = e.attribute("filemodified", "0").toLongLong();
 	
 	// For older project files, this should properly detect if the 
 	// audio source was a recording or not., in fact this should suffice
@@ -196,6 +212,9 @@ int ReadSource::init( )
 	
 	m_bufferstatus = new BufferStatus;
 	
+	// The file rate as stored in the format index
+	uint indexedRate = m_rate;
+	
 	// Fake the samplerate, until it's set by an AudioReader!
 	if (project) {
 		m_rate = m_outputRate = project->get_rate();
@@ -217,7 +236,9 @@ int ReadSource::init( )
 		return (m_error = INVALID_CHANNEL_COUNT);
 	}
 	
-	if ( ! QFile::exists(m_fileName)) {
+	QFileInfo fileInfo(m_fileName);
+	
+	if ( ! fileInfo.exists()) {
 		return (m_error = FILE_DOES_NOT_EXIST);
 	}
 	
@@ -227,46 +248,122 @@ int ReadSource::init( )
 	m_bufferUnderRunDetected = m_wasActivated = 0;
 	m_active = 0;
 	
+	// A source whose format index still matches the file on disk is opened
+	// on first use, so loading a project doesn't open every audio file.
+	bool indexValid = !m_decodertype.isEmpty() && indexedRate > 0 && m_fileFrames > 0 &&
+			  fileInfo.size() == m_fileSize &&
+			  fileInfo.lastModified().toMSecsSinceEpoch() == m_fileModified;
+	
+	if (indexValid) {
+		m_rate = indexedRate;
+	} else {
+		m_fileFrames = 0;
+		if (!open_reader()) {
+			return m_error;
+		}
+	}
+	
+	set_output_rate(m_rate);
+	
+	return 1;
+}
+
+
+// Opens the audio reader if it isn't open yet, and (re)sets the format
+// index from it when it was opened on the source file itself.
+// Callers using m_audioReader afterwards have to hold m_readerMutex, so
+// the ReaderPool can't close it in the meantime.
+bool ReadSource::open_reader()
+{
+	QMutexLocker locker(&m_readerMutex);
+	
+	if (m_audioReader) {
+		reader_pool().reader_used(this);
+		return true;
+	}
+	
+	if (m_silent || m_error) {
+		return false;
+	}
+	
+	ResampleAudioReader* reader = nullptr;
+	
+	if (!m_fileFrames) {
+		reader = new ResampleAudioReader(m_fileName, m_decodertype);
+		
+		if (!reader->is_valid()) {
+			delete reader;
+			m_error = COULD_NOT_OPEN_FILE;
+			return false;
+		}
+		
+		QFileInfo fileInfo(m_fileName);
+		m_decodertype = reader->decoder_type();
+		m_channelCount = reader->get_num_channels();
+		m_rate = reader->get_file_rate();
+		m_fileFrames = reader->get_nframes();
+		m_fileBitDepth = reader->get_bit_depth();
+		m_fileSize = fileInfo.size();
+		m_fileModified = fileInfo.lastModified().toMSecsSinceEpoch();
+	}
+	
+	// Stream from the resampled or decoded copy of the source, if there is one
+	set_used_cache_file(QString());
+	QString cacheFile = decode_cache().get_cache_file(this, reader_output_rate());
+	if (!cacheFile.isEmpty()) {
+		ResampleAudioReader* cacheReader = open_cache_file(cacheFile);
+		if (cacheReader) {
+			delete reader;
+			reader = cacheReader;
+			set_used_cache_file(cacheFile);
+		}
+	}
+	
+	if (!reader) {
+		reader = new ResampleAudioReader(m_fileName, m_decodertype);
+		
+		if (!reader->is_valid()) {
+			delete reader;
+			m_error = COULD_NOT_OPEN_FILE;
+			return false;
+		}
+	}
+	
 	// There should be another config option for ConverterType to use for export (higher quality)
 	//converter_type = config().get_property("Conversion", "ExportResamplingConverterType", 0).toInt();
-	m_audioReader = new ResampleAudioReader(m_fileName, m_decodertype);
-	
-	if (!m_audioReader->is_valid()) {
-//		PERROR("ReadSource:: audio reader is not valid! (reader channel count: %d, nframes: %d", m_audioReader->get_num_channels(), m_audioReader->get_nframes());
-		delete m_audioReader;
-        m_audioReader = nullptr;
-		return (m_error = COULD_NOT_OPEN_FILE);
+	if (m_diskio) {
+		reader->set_resample_decode_buffer(m_diskio->get_resample_decode_buffer());
+		reader->set_converter_type(m_diskio->get_resample_quality());
+	} else {
+		int converter_type = config().get_property("Conversion", "RTResamplingConverterType", DEFAULT_RESAMPLE_QUALITY).toInt();
+		reader->set_converter_type(converter_type);
 	}
 	
-	int converter_type = config().get_property("Conversion", "RTResamplingConverterType", DEFAULT_RESAMPLE_QUALITY).toInt();
-	m_audioReader->set_converter_type(converter_type);
+	m_audioReader = reader;
 	
-	set_output_rate(m_audioReader->get_file_rate());
+	set_output_rate(m_outputRate);
 	
-	// (re)set the decoder type
-	m_decodertype = m_audioReader->decoder_type();
-	m_channelCount = m_audioReader->get_num_channels();
+	reader_pool().reader_opened(this);
 	
-	// @Ben: I thought we support any channel count now ??
-//        if (m_channelCount > 2) {
-//                PERROR("ReadAudioSource: file contains %d channels; only 2 channels are supported", m_channelCount);
-//                delete m_audioReader;
-//                m_audioReader = 0;
-//                return (m_error = INVALID_CHANNEL_COUNT);
-//        }
+	return true;
+}
 
-	// Never reached, it's allready checked in AbstractAudioReader::is_valid() which was allready called!
-	if (m_channelCount == 0) {
-//		PERROR("ReadAudioSource: not a valid channel count: %d", m_channelCount);
-		delete m_audioReader;
-        m_audioReader = nullptr;
-		return (m_error = ZERO_CHANNELS);
+
+// Called by the ReaderPool, closes our reader unless it's in use right now.
+// It's reopened on the next read, reads always pass their start position.
+bool ReadSource::close_idle_reader()
+{
+	if (!m_readerMutex.tryLock()) {
+		return false;
 	}
 	
-	m_rate = m_audioReader->get_file_rate();
-	m_length = m_audioReader->get_length();
+	delete m_audioReader;
+	m_audioReader = nullptr;
+	set_used_cache_file(QString());
 	
-	return 1;
+	m_readerMutex.unlock();
+	
+	return true;
 }
 
 
@@ -274,12 +371,18 @@ void ReadSource::set_output_rate(int rate)
 {
 	Q_ASSERT(rate > 0);
 	
+	QMutexLocker locker(&m_readerMutex);
+	
+	bool useResampling = config().get_property("Conversion", "DynamicResampling", true).toBool();
+	
 	if (! m_audioReader) {
-		printf("ReadSource::set_output_rate: No audioreader!\n");
+		// Do what the audio reader would do, until it's opened
+		uint readerRate = useResampling ? uint(rate) : m_rate;
+		m_outputRate = rate;
+		m_length = TimeRef(TimeRef(m_fileFrames, m_rate).to_frame(readerRate), readerRate);
 		return;
 	}
 	
-	bool useResampling = config().get_property("Conversion", "DynamicResampling", true).toBool();
 	if (useResampling) {
 		m_audioReader->set_output_rate(rate);
 	} else {
@@ -296,10 +399,14 @@ void ReadSource::set_output_rate(int rate)
 }
 
 
-int ReadSource::file_read(DecodeBuffer* buffer, const TimeRef& start, nframes_t cnt) const
+int ReadSource::file_read(DecodeBuffer* buffer, const TimeRef& start, nframes_t cnt)
 {
 //	PROFILE_START;
-	Q_ASSERT(m_audioReader);
+	QMutexLocker locker(&m_readerMutex);
+	
+	if (!open_reader()) {
+		return 0;
+	}
 	nframes_t result = m_audioReader->read_from(buffer, start, cnt);
 //	PROFILE_END("ReadSource::fileread");
 	return result;
@@ -308,7 +415,11 @@ int ReadSource::file_read(DecodeBuffer* buffer, const TimeRef& start, nframes_t
 
 int ReadSource::file_read(DecodeBuffer * buffer, nframes_t start, nframes_t cnt)
 {
-	Q_ASSERT(m_audioReader);
+	QMutexLocker locker(&m_readerMutex);
+	
+	if (!open_reader()) {
+		return 0;
+	}
 	return m_audioReader->read_from(buffer, start, cnt);
 }
 
@@ -330,9 +441,11 @@ void ReadSource::set_audio_clip(AudioClip* clip)
 	m_clip = clip;
 }
 
-nframes_t ReadSource::get_nframes( ) const
+nframes_t ReadSource::get_nframes( )
 {
-	if (!m_audioReader) {
+	QMutexLocker locker(&m_readerMutex);
+	
+	if (!open_reader()) {
 		return 0;
 	}
 	return m_audioReader->get_nframes();
@@ -355,6 +468,9 @@ int ReadSource::set_file(const QString & filename)
 	set_dir(dir);
 	set_name(name);
 	
+	// The format index belongs to the old file
+	m_fileFrames = 0;
+	
 	if (init() < 0) {
 		return -1;
 	}
@@ -393,7 +509,7 @@ int ReadSource::rb_read(audio_sample_t** dst, TimeRef& start, nframes_t count)
 	
 	if (start != m_rbRelativeFileReadPos) {
 		
-		TimeRef availabletime(nframes_t(m_buffers.at(0)->read_space()), m_outputRate);
+		TimeRef availabletime(rb_read_space(), m_outputRate);
 /*		printf("rb_read:: m_rbRelativeFileReadPos, start: %lld, %lld\n", m_rbRelativeFileReadPos.universal_frame(), start.universal_frame());
 		printf("rb_read:: availabletime %d\n", availabletime.to_frame(m_outputRate));*/
 		
@@ -403,8 +519,8 @@ int ReadSource::rb_read(audio_sample_t** dst, TimeRef& start, nframes_t count)
 			if (availabletime < advance) {
 				printf("available < advance !!!!!!!\n");
 			}
-			for (int i=m_buffers.size()-1; i>=0; --i) {
-				m_buffers.at(i)->increment_read_ptr(advance.to_frame(m_outputRate));
+			for (int i=m_rtBuffers.size()-1; i>=0; --i) {
+				m_rtBuffers.at(i)->increment_read_ptr(advance.to_frame(m_outputRate) * m_bytesPerSample);
 			}
 			
 			m_rbRelativeFileReadPos += advance;
@@ -421,7 +537,7 @@ int ReadSource::rb_read(audio_sample_t** dst, TimeRef& start, nframes_t count)
 	
 	for (int chan=0; chan<m_channelCount; ++chan) {
 		
-		readcount = m_buffers.at(chan)->read(dst[chan], count);
+		readcount = rb_read_channel(chan, dst[chan], count);
 
 		if (readcount != count) {
 			PMESG("readcount, count: %d, %d", readcount, count);
@@ -436,6 +552,64 @@ int ReadSource::rb_read(audio_sample_t** dst, TimeRef& start, nframes_t count)
 }
 
 
+// Called by the reader of the ring buffers: returns true if rb_read() can
+// read count frames from start without a resync. Starts a resync and returns
+// false if start is outside the range the ring buffers can still deliver.
+bool ReadSource::rb_ready_for(const TimeRef& start, nframes_t count)
+{
+	if (m_channelCount == 0 || is_resident()) {
+		return true;
+	}
+
+	if ( ! m_rbReady || m_rtBuffers.isEmpty()) {
+		return false;
+	}
+
+	TimeRef end = start + TimeRef(count, m_outputRate);
+	TimeRef diff = m_rbRelativeFileReadPos - start;
+	nframes_t available = rb_read_space();
+
+	// The same rounding tolerance as rb_read() uses
+	if (diff.to_frame(m_outputRate) == 0) {
+		return available >= count;
+	}
+
+	if ( (start > m_rbRelativeFileReadPos) &&
+	     (end <= m_rbRelativeFileReadPos + TimeRef(available + rb_write_space(), m_outputRate)) ) {
+		// Ahead of the read position, the DiskIO thread is still filling in
+		return (m_rbRelativeFileReadPos + TimeRef(available, m_outputRate)) > end;
+	}
+
+	TimeRef synclocation = start + m_clip->get_track_start_location() + m_clip->get_source_start_location();
+	start_resync(synclocation);
+
+	return false;
+}
+
+
+// Called from the audio thread for sources which are kept in memory as a whole
+int ReadSource::resident_read(audio_sample_t** dst, const TimeRef& start, nframes_t count)
+{
+	ResidentSourceData* data = m_rtResidentData;
+	TimeRef location = start;
+	nframes_t position = location.to_frame(m_outputRate);
+	
+	if (!data || position >= data->frames) {
+		return 0;
+	}
+	
+	if (count > data->frames - position) {
+		count = data->frames - position;
+	}
+	
+	for (int chan=0; chan<m_channelCount; ++chan) {
+		memcpy(dst[chan], data->channels.at(chan).constData() + position, count * sizeof(audio_sample_t));
+	}
+	
+	return count;
+}
+
+
 int ReadSource::rb_file_read(DecodeBuffer* buffer, nframes_t cnt)
 {
 	nframes_t readFrames = file_read(buffer, m_rbFileReadPos, cnt);
@@ -478,8 +652,8 @@ void ReadSource::rb_seek_to_file_position(TimeRef& position)
 // 	printf("rb_seek_to_file_position:: seeking to relative pos: %d\n", fileposition);
 	
 	// The content of our buffers is no longer valid, so we empty them
-	for (int i=0; i<m_buffers.size(); ++i) {
-		m_buffers.at(i)->reset();
+	for (int i=0; i<m_rtBuffers.size(); ++i) {
+		m_rtBuffers.at(i)->reset();
 	}
 	
 	m_rbFileReadPos = fileposition;
@@ -504,7 +678,7 @@ void ReadSource::process_ringbuffer(DecodeBuffer* buffer, bool seeking)
 	}
 	
 	// Calculate the number of samples we can write into the buffer
-	int writeSpace = m_buffers.at(0)->write_space();
+	int writeSpace = rb_write_space();
 
 	// The amount of chunks which can be 'read'
 	int chunkCount = (int)(writeSpace / m_chunkSize);
@@ -533,6 +707,18 @@ void ReadSource::process_ringbuffer(DecodeBuffer* buffer, bool seeking)
 		}
 	}
 	
+	QMutexLocker locker(&m_readerMutex);
+	
+	if (!open_reader()) {
+		return;
+	}
+	
+	// Switch over to the decoded copy of a compressed source once it's
+	// written, the ring buffers don't care where the samples come from.
+	if (m_cacheFileReady) {
+		switch_to_cache_file();
+	}
+	
 	// Check if the resample quality has changed, it's a safe place here
 	// to reconfigure the audioreaders resample quality.
 	// This allows on the fly changing of the resample quality :)
@@ -545,8 +731,8 @@ void ReadSource::process_ringbuffer(DecodeBuffer* buffer, bool seeking)
 	
 	// and write it to the ringbuffer
 	if (toWrite) {
-		for (int i=m_buffers.size()-1; i>=0; --i) {
-			m_buffers.at(i)->write(buffer->destination[i], toWrite);
+		for (int i=m_rtBuffers.size()-1; i>=0; --i) {
+			rb_write_channel(i, buffer->destination[i], toWrite);
 		}
 	}
 }
@@ -579,7 +765,9 @@ void ReadSource::sync(DecodeBuffer* buffer)
 	PENTER2;
 // 	printf("source::sync: %s\n", QS_C(m_fileName));
 	
-	if (!m_audioReader) {
+	QMutexLocker locker(&m_readerMutex);
+	
+	if (!open_reader()) {
 		return;
 	}
 	
@@ -597,7 +785,7 @@ void ReadSource::sync(DecodeBuffer* buffer)
 	// doesn't fill it consitently, and thus giving audible artifacts.
 	process_ringbuffer(buffer);
 	
-	if (m_buffers.at(0)->write_space() == 0) {
+	if (rb_write_space() == 0) {
 		finish_resync();
 	}
 	
@@ -612,11 +800,13 @@ void ReadSource::prepare_rt_buffers( )
 	
 	Q_ASSERT(m_clip);
 	
-	for (int i=0; i<m_buffers.size();++i) {
-		delete m_buffers.at(i);
-	}
+	release_rt_buffers();
 	
-	m_buffers.clear();
+	// Short sources are decoded once and played from memory, they don't
+	// need ring buffers once the decoded data is handed to the audio thread.
+	// We may be called from the DiskIO thread, Tsar events can only be
+	// added from the GUI thread.
+	QMetaObject::invokeMethod(this, "update_resident_data", Qt::QueuedConnection);
 
 	float size = config().get_property("Hardware", "readbuffersize", 1.0).toDouble();
 
@@ -626,13 +816,176 @@ void ReadSource::prepare_rt_buffers( )
         // have chunck sizes that are multiples of 4KB ?
         m_chunkSize = m_bufferSize / DiskIO::bufferdividefactor;
 
+	// Integer PCM data converted to float by the decoder converts back
+	// without loss, as long as it isn't resampled, see get_bit_depth().
+	bool resampled = m_outputRate != m_rate && config().get_property("Conversion", "DynamicResampling", true).toBool();
+	switch (resampled ? 0 : m_fileBitDepth) {
+		case 16: m_bytesPerSample = 2; break;
+		case 24: m_bytesPerSample = 3; break;
+		default: m_bytesPerSample = sizeof(audio_sample_t);
+	}
+
+	// The ring buffers themselves are acquired from the ReadBufferPool
+	// by get_buffer_status() once the transport approaches our clip.
+}
+
+// Called from the DiskIO thread only
+bool ReadSource::acquire_rt_buffers(const TimeRef& syncLocation)
+{
 	for (int i=0; i<m_channelCount; ++i) {
-		m_buffers.append(new RingBufferNPT<float>(m_bufferSize));
+		RingBufferNPT<char>* buffer = readbuffer_pool().acquire(m_bufferSize * m_bytesPerSample);
+		if (!buffer) {
+			release_rt_buffers();
+			if (!m_bufferBudgetExceeded) {
+				qWarning("ReadSource: read buffer budget exhausted, %s will not be played", QS_C(m_name));
+				m_bufferBudgetExceeded = true;
+			}
+			return false;
+		}
+		m_rtBuffers.append(buffer);
+	}
+	
+	m_bufferBudgetExceeded = false;
+	
+	// Fill the new buffers from the transport location on
+	m_syncPos = syncLocation;
+	m_syncInProgress = false;
+	m_needSync = 1;
+	
+	return true;
+}
+
+// Called when the source isn't (yet) part of the realtime processing,
+// or by finish_rt_buffers_release() once it's safe to do so.
+void ReadSource::release_rt_buffers()
+{
+	// Make sure rb_read() no longer touches the buffers
+	m_rbReady = 0;
+	m_releasePending = false;
+	
+	for (int i=0; i<m_rtBuffers.size(); ++i) {
+		readbuffer_pool().release(m_rtBuffers.at(i));
+	}
+	
+	m_rtBuffers.clear();
+}
+
+// Called from the DiskIO thread only. The audio thread (and the LookaheadRenderer)
+// may be reading from our buffers right now, so we only stop them from starting
+// a new read, and hand back the buffers after they completed their current one.
+void ReadSource::request_rt_buffers_release()
+{
+	m_rbReady = 0;
+	m_releaseCycle = audiodevice().get_cycle_count();
+	m_releasePending = true;
+}
+
+// Called from the DiskIO thread only, returns true if the buffers were released.
+bool ReadSource::finish_rt_buffers_release()
+{
+	// A cycle that started before m_rbReady was reset may still be running
+	// when the cycle count is incremented once, after a second increment
+	// the audio thread has seen m_rbReady = 0 for a full cycle. Without a
+	// running audio thread the count doesn't advance, nor is anyone reading.
+	if (audiodevice().run_audio_thread() && audiodevice().get_cycle_count() - m_releaseCycle < 2) {
+		return false;
+	}
+	
+	// The LookaheadRenderer reads while holding the rt lists lock
+	tsar().lock_rt_lists();
+	release_rt_buffers();
+	tsar().unlock_rt_lists();
+	
+	return true;
+}
+
+nframes_t ReadSource::rb_read_space()
+{
+	return nframes_t(m_rtBuffers.at(0)->read_space() / m_bytesPerSample);
+}
+
+nframes_t ReadSource::rb_write_space()
+{
+	return nframes_t(m_rtBuffers.at(0)->write_space() / m_bytesPerSample);
+}
+
+static void convert_to_float(const char* src, audio_sample_t* dst, nframes_t count, uint bytesPerSample)
+{
+	switch (bytesPerSample) {
+		case 2: Mixer::convert_s16_to_float(reinterpret_cast<const short*>(src), dst, count); break;
+		case 3: Mixer::convert_s24_to_float(reinterpret_cast<const unsigned char*>(src), dst, count); break;
+		default: memcpy(dst, src, count * sizeof(audio_sample_t));
+	}
+}
+
+static void convert_from_float(const audio_sample_t* src, char* dst, nframes_t count, uint bytesPerSample)
+{
+	if (bytesPerSample == 2) {
+		short* out = reinterpret_cast<short*>(dst);
+		for (nframes_t i=0; i<count; ++i) {
+			out[i] = short(qBound(-32768L, lrintf(src[i] * 32768.0f), 32767L));
+		}
+	} else if (bytesPerSample == 3) {
+		unsigned char* out = reinterpret_cast<unsigned char*>(dst);
+		for (nframes_t i=0; i<count; ++i) {
+			long value = qBound(-8388608L, lrintf(src[i] * 8388608.0f), 8388607L);
+			out[0] = (unsigned char)(value);
+			out[1] = (unsigned char)(value >> 8);
+			out[2] = (unsigned char)(value >> 16);
+			out += 3;
+		}
+	} else {
+		memcpy(dst, src, count * sizeof(audio_sample_t));
+	}
+}
+
+// Called from the audio thread: converts count samples of channel chan
+// straight from the ring buffer memory into dst
+nframes_t ReadSource::rb_read_channel(int chan, audio_sample_t* dst, nframes_t count)
+{
+	RingBufferNPT<char>* rb = m_rtBuffers.at(chan);
+	RingBufferNPT<char>::rw_vector vec;
+	rb->get_read_vector(&vec);
+	
+	nframes_t available = nframes_t((vec.len[0] + vec.len[1]) / m_bytesPerSample);
+	if (count > available) {
+		count = available;
+	}
+	
+	nframes_t first = qMin(count, nframes_t(vec.len[0] / m_bytesPerSample));
+	convert_to_float(vec.buf[0], dst, first, m_bytesPerSample);
+	if (count > first) {
+		convert_to_float(vec.buf[1], dst + first, count - first, m_bytesPerSample);
+	}
+	
+	rb->increment_read_ptr(count * m_bytesPerSample);
+	
+	return count;
+}
+
+// Called from the DiskIO thread, count may not exceed rb_write_space()
+void ReadSource::rb_write_channel(int chan, const audio_sample_t* src, nframes_t count)
+{
+	RingBufferNPT<char>* rb = m_rtBuffers.at(chan);
+	RingBufferNPT<char>::rw_vector vec;
+	rb->get_write_vector(&vec);
+	
+	nframes_t first = qMin(count, nframes_t(vec.len[0] / m_bytesPerSample));
+	convert_from_float(src, vec.buf[0], first, m_bytesPerSample);
+	if (count > first) {
+		convert_from_float(src + first, vec.buf[1], count - first, m_bytesPerSample);
 	}
+	
+	rb->increment_write_ptr(count * m_bytesPerSample);
+}
 
-        // FIXME: does this really make sense to do still ? :
-        TimeRef synclocation = m_clip->get_sheet()->get_transport_location();
-        start_resync(synclocation);
+BufferStatus* ReadSource::idle_buffer_status()
+{
+	m_bufferstatus->fillStatus =  100;
+	m_bufferstatus->needSync = false;
+	m_bufferstatus->bufferUnderRun = false;
+	m_bufferstatus->priority = 0;
+	return m_bufferstatus;
 }
 
 BufferStatus* ReadSource::get_buffer_status()
@@ -641,13 +994,41 @@ BufferStatus* ReadSource::get_buffer_status()
 		return m_bufferstatus;
 	}
 	
-	int freespace = m_buffers.at(0)->write_space();
+	// Played from memory, the ring buffers are no longer needed
+	if (is_resident()) {
+		if (!m_rtBuffers.isEmpty() && !m_releasePending) {
+			request_rt_buffers_release();
+		}
+		if (m_releasePending) {
+			finish_rt_buffers_release();
+		}
+		return idle_buffer_status();
+	}
 	
 // 	printf("m_rbFileReadPos, m_length %lld, %lld\n", m_rbFileReadPos.universal_frame(), m_length.universal_frame());
 	TimeRef transport = m_clip->get_sheet()->get_transport_location();
 	TimeRef syncstartlocation = m_clip->get_track_start_location();
 	bool transportBeforeSyncStartLocation = transport < (syncstartlocation - (3 * UNIVERSAL_SAMPLE_RATE));
 	bool transportAfterClipEndLocation = transport > (m_clip->get_track_end_location() + (3 * UNIVERSAL_SAMPLE_RATE));
+	bool transportNearClip = !(transportBeforeSyncStartLocation || transportAfterClipEndLocation);
+	
+	// Buffers that are on their way back to the pool can't be reused
+	if (m_releasePending && !finish_rt_buffers_release()) {
+		return idle_buffer_status();
+	}
+	
+	// Only clips close to the transport location hold ring buffers, so memory
+	// usage scales with the amount of clips being played, not the project size.
+	if (m_rtBuffers.isEmpty()) {
+		if ( ! (transportNearClip && m_active && acquire_rt_buffers(transport)) ) {
+			return idle_buffer_status();
+		}
+	} else if (!transportNearClip) {
+		request_rt_buffers_release();
+		return idle_buffer_status();
+	}
+	
+	int freespace = rb_write_space();
 			
 	if (m_rbFileReadPos >= m_length || !m_active || transportBeforeSyncStartLocation || transportAfterClipEndLocation) {
 		m_bufferstatus->fillStatus =  100;
@@ -675,8 +1056,9 @@ void ReadSource::set_active(bool active)
 
 uint ReadSource::get_file_rate() const
 {
-	if (m_audioReader) {
-		return m_audioReader->get_file_rate();
+	// Don't touch the reader, the ReaderPool may close it any time
+	if (m_fileFrames) {
+		return m_rate;
 	} else {
 		PERROR("ReadSource::get_file_rate(), but no audioreader available!!");
 	}
@@ -687,6 +1069,9 @@ uint ReadSource::get_file_rate() const
 void ReadSource::set_diskio(DiskIO * diskio)
 {
 	m_diskio = diskio;
+	
+	QMutexLocker locker(&m_readerMutex);
+	
 	set_output_rate(m_diskio->get_output_rate());
 	
 	if (m_audioReader) {
@@ -694,9 +1079,184 @@ void ReadSource::set_diskio(DiskIO * diskio)
 		m_audioReader->set_converter_type(m_diskio->get_resample_quality());
 	}
 	
+	// Have compressed sources decoded and sources at another rate resampled
+	// once in the background, process_ringbuffer() switches over to the
+	// cache file when it's ready.
+	if (!m_silent && !m_error) {
+		if (DecodeCache::is_compressed(m_decodertype) || reader_output_rate() != m_rate) {
+			connect(&decode_cache(), SIGNAL(cacheFileReady(qint64,QString)),
+				this, SLOT(decode_cache_ready(qint64,QString)), Qt::UniqueConnection);
+		}
+		QString cacheFile = decode_cache().request(this, reader_output_rate());
+		if (!cacheFile.isEmpty()) {
+			decode_cache_ready(m_id, cacheFile);
+		}
+	}
+	
 	prepare_rt_buffers();
 }
 
+// The rate our audio reader delivers its samples at
+uint ReadSource::reader_output_rate() const
+{
+	bool useResampling = config().get_property("Conversion", "DynamicResampling", true).toBool();
+	return useResampling ? m_outputRate : m_rate;
+}
+
+// Returns a reader on the decode cache file of this source, which is set up
+// like our current reader, or 0 if the cache file turns out to be stale.
+ResampleAudioReader* ReadSource::open_cache_file(const QString& cacheFile)
+{
+	ResampleAudioReader* reader = new ResampleAudioReader(cacheFile, "sndfile");
+	
+	bool valid = reader->is_valid() && reader->get_num_channels() == uint(m_channelCount);
+	if (valid) {
+		// The cache file is either at our file rate, or resampled
+		uint cacheRate = reader->get_file_rate();
+		nframes_t frames = (cacheRate == m_rate) ? m_fileFrames : TimeRef(m_fileFrames, m_rate).to_frame(cacheRate);
+		valid = (reader->get_nframes() == frames);
+	}
+	
+	if (!valid) {
+		qWarning("ReadSource: removing stale decode cache file %s", QS_C(cacheFile));
+		delete reader;
+		QFile::remove(cacheFile);
+		return nullptr;
+	}
+	
+	if (m_audioReader) {
+		reader->set_converter_type(m_audioReader->get_convertor_type());
+		reader->set_output_rate(m_audioReader->get_output_rate());
+	}
+	
+	return reader;
+}
+
+// Called from the DiskIO thread with m_readerMutex held. The ring buffers keep
+// their sample width, integer sources convert back from a float cache without
+// loss as long as it isn't resampled.
+void ReadSource::switch_to_cache_file()
+{
+	m_cacheFileReady = 0;
+	
+	if (m_cacheFileName == m_usedCacheFile) {
+		return;
+	}
+	
+	ResampleAudioReader* reader = open_cache_file(m_cacheFileName);
+	if (!reader) {
+		return;
+	}
+	
+	// Don't trade a copy at our playback rate for one that still needs resampling
+	uint rate = reader_output_rate();
+	if (!m_usedCacheFile.isEmpty() && m_audioReader && m_audioReader->get_file_rate() == rate && reader->get_file_rate() != rate) {
+		delete reader;
+		return;
+	}
+	
+	if (m_diskio) {
+		reader->set_resample_decode_buffer(m_diskio->get_resample_decode_buffer());
+	}
+	
+	delete m_audioReader;
+	m_audioReader = reader;
+	set_used_cache_file(m_cacheFileName);
+}
+
+// Keeps the DecodeCache from evicting the cache file we stream from
+void ReadSource::set_used_cache_file(const QString& cacheFile)
+{
+	if (cacheFile == m_usedCacheFile) {
+		return;
+	}
+	
+	if (!m_usedCacheFile.isEmpty()) {
+		decode_cache().file_closed(m_usedCacheFile);
+	}
+	if (!cacheFile.isEmpty()) {
+		decode_cache().file_opened(cacheFile);
+	}
+	
+	m_usedCacheFile = cacheFile;
+}
+
+void ReadSource::decode_cache_ready(qint64 sourceId, const QString& cacheFile)
+{
+	if (sourceId != m_id) {
+		return;
+	}
+	
+	QMutexLocker locker(&m_readerMutex);
+	
+	if (cacheFile == m_usedCacheFile) {
+		return;
+	}
+	
+	m_cacheFileName = cacheFile;
+	m_cacheFileReady = 1;
+}
+
+// Picks up the decoded data of short sources at our output rate, the
+// ResourcesManager decodes it in the background if needed.
+void ReadSource::update_resident_data()
+{
+	if (!m_diskio || m_channelCount == 0) {
+		return;
+	}
+	
+	ResourcesManager* manager = resources_manager();
+	if (!manager) {
+		return;
+	}
+	
+	connect(manager, SIGNAL(residentDataReady(qint64,uint)),
+		this, SLOT(resident_data_ready(qint64,uint)), Qt::UniqueConnection);
+	
+	// Data at another rate must not be played, stream from disk until
+	// the data at our output rate is ready
+	set_resident_data(manager->get_resident_data(this, m_outputRate));
+}
+
+void ReadSource::resident_data_ready(qint64 sourceId, uint rate)
+{
+	if (sourceId != m_id || rate != m_outputRate) {
+		return;
+	}
+	
+	update_resident_data();
+}
+
+// Called from the GUI thread only
+void ReadSource::set_resident_data(QSharedPointer<ResidentSourceData> data)
+{
+	if (data == m_residentData) {
+		return;
+	}
+	
+	// The audio thread may play from the current data until our event is processed
+	if (m_residentData) {
+		m_retiredResidentData.append(m_residentData);
+	}
+	m_residentData = data;
+	
+	THREAD_SAVE_INVOKE_AND_EMIT_SIGNAL(this, data.data(), private_set_resident_data(ResidentSourceData*), residentDataSet(ResidentSourceData*));
+}
+
+// Called from the audio thread by Tsar
+void ReadSource::private_set_resident_data(ResidentSourceData* data)
+{
+	m_rtResidentData = data;
+}
+
+void ReadSource::resident_data_set(ResidentSourceData* data)
+{
+	// Older data may still be used if a newer switch is pending
+	if (data == m_residentData.data()) {
+		m_retiredResidentData.clear();
+	}
+}
+
 QString ReadSource::get_error_string() const
 {
 	switch(m_error) {
@@ -25,6 +25,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "AudioSource.h"
 
 #include <QDomDocument>
+#include <QSharedPointer>
+#include <QMutex>
 
 
 class ResampleAudioReader;
@@ -32,6 +34,7 @@ class AudioClip;
 struct BufferStatus;
 class DecodeBuffer;
 class DiskIO;
+struct ResidentSourceData;
 
 class ReadSource : public AudioSource
 {
@@ -56,9 +59,12 @@ public :
 	QDomNode get_state(QDomDocument doc);
 
 	int rb_read(audio_sample_t** dest, TimeRef& start, nframes_t cnt);
+	bool rb_ready_for(const TimeRef& start, nframes_t cnt);
+	int resident_read(audio_sample_t** dest, const TimeRef& start, nframes_t cnt);
+	bool is_resident() const {return m_rtResidentData != nullptr;}
 	void rb_seek_to_file_position(TimeRef& position);
 	
-	int file_read(DecodeBuffer* buffer, const TimeRef& start, nframes_t cnt) const;
+	int file_read(DecodeBuffer* buffer, const TimeRef& start, nframes_t cnt);
 	int file_read(DecodeBuffer* buffer, nframes_t start, nframes_t cnt);
 
 	int init();
@@ -69,10 +75,11 @@ public :
 	
 	void set_audio_clip(AudioClip* clip);
 	void set_diskio(DiskIO* diskio);
-	nframes_t get_nframes() const;
+	nframes_t get_nframes();
     uint get_file_rate() const;
     uint get_output_rate() const {return m_outputRate;}
 	const TimeRef& get_length() const {return m_length;}
+	QString get_decoder_type() const {return m_decodertype;}
 	
 	void sync(DecodeBuffer* buffer);
 	void process_ringbuffer(DecodeBuffer* buffer, bool seeking=false);
@@ -84,6 +91,8 @@ public :
 	
 private:
     ResampleAudioReader*	m_audioReader{};
+	// Guards m_audioReader against being closed by the ReaderPool
+	QMutex			m_readerMutex{QMutex::Recursive};
     AudioClip* 		m_clip{};
     DiskIO*			m_diskio{};
     int			m_refcount{};
@@ -98,25 +107,79 @@ private:
     volatile size_t		m_wasActivated{};
     volatile size_t		m_bufferUnderRunDetected{};
     bool			m_syncInProgress{};
+    bool			m_bufferBudgetExceeded{};
+    bool			m_releasePending{};
+    size_t			m_releaseCycle{};
 	
 	mutable TimeRef		m_length;
 	QString			m_decodertype;
+	
+	// Format index, stored in the project file. It allows init() to
+	// skip opening the file as long as its size and mtime don't change.
+    nframes_t			m_fileFrames{};
+    uint			m_fileBitDepth{};
+    qint64			m_fileSize{};
+    qint64			m_fileModified{};
     uint			m_outputRate{};
 	
     BufferStatus*		m_bufferstatus{};
 	
+	// Ring buffers store the samples at the bit depth of the source file
+	// (16, packed 24 bit or float), rb_read() converts them to floats.
+	QList<RingBufferNPT<char>*>	m_rtBuffers;
+    uint			m_bytesPerSample{};
+	
+	// m_residentData is owned by the GUI thread, the audio thread plays from
+	// m_rtResidentData, which is handed over to it by Tsar. Previous data is
+	// kept in m_retiredResidentData until the audio thread switched over.
+	QSharedPointer<ResidentSourceData>	m_residentData;
+	QList<QSharedPointer<ResidentSourceData> > m_retiredResidentData;
+	ResidentSourceData* volatile	m_rtResidentData{};
+	
+	// Compressed sources and sources at another rate then the output rate
+	// switch to their decoded or resampled copy in the project's
+	// decodecache dir once the DecodeCache has written it.
+	QString			m_cacheFileName;
+	QString			m_usedCacheFile;
+    volatile size_t		m_cacheFileReady{};
+	
 	int ref() { return m_refcount++;}
 	
 	void private_init();
+	bool open_reader();
+	bool close_idle_reader();
 	void start_resync(TimeRef& position);
 	void finish_resync();
 	int rb_file_read(DecodeBuffer* buffer, nframes_t cnt);
+	bool acquire_rt_buffers(const TimeRef& syncLocation);
+	void release_rt_buffers();
+	void request_rt_buffers_release();
+	bool finish_rt_buffers_release();
+	BufferStatus* idle_buffer_status();
+	nframes_t rb_read_space();
+	nframes_t rb_write_space();
+	nframes_t rb_read_channel(int chan, audio_sample_t* dst, nframes_t count);
+	void rb_write_channel(int chan, const audio_sample_t* src, nframes_t count);
+	uint reader_output_rate() const;
+	ResampleAudioReader* open_cache_file(const QString& cacheFile);
+	void set_used_cache_file(const QString& cacheFile);
+	void switch_to_cache_file();
+	void set_resident_data(QSharedPointer<ResidentSourceData> data);
 
 	friend class ResourcesManager;
+	friend class ReaderPool;
 	friend class ProjectConverter;
 
+private slots:
+	void decode_cache_ready(qint64 sourceId, const QString& cacheFile);
+	void update_resident_data();
+	void resident_data_ready(qint64 sourceId, uint rate);
+	void private_set_resident_data(ResidentSourceData* data);
+	void resident_data_set(ResidentSourceData* data);
+
 signals:
 	void stateChanged();
+	void residentDataSet(ResidentSourceData* data);
 };
 
 #endif
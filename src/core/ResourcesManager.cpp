@@ -28,6 +28,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Sheet.h"
 #include "Utils.h"
 #include "AudioDevice.h"
+#include "ResampleAudioReader.h"
+#include "TConfig.h"
 
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
@@ -50,6 +52,9 @@ ResourcesManager::ResourcesManager(Project* project)
 ResourcesManager::~ResourcesManager()
 {
 	PENTERDES;
+	m_residentPool.clear();
+	m_residentPool.waitForDone();
+	
 	foreach(SourceData* data, m_sources) {
 		if (! data->source->ref()) {
 			delete data->source;
@@ -239,6 +244,128 @@ ReadSource * ResourcesManager::get_readsource(qint64 id)
 }
 
 
+// Decodes a short source into memory, in a thread of the resident pool
+class ResourcesManager::ResidentDecoder : public QRunnable
+{
+public:
+	ResidentDecoder(ResourcesManager* manager, const ResidentKey& key, const QString& fileName, const QString& decoder)
+		: m_manager(manager)
+		, m_key(key)
+		, m_fileName(fileName)
+		, m_decoder(decoder)
+	{}
+	
+	void run()
+	{
+		// Use a reader of our own, the ReadSource's reader shares its
+		// resample buffer with the DiskIO thread.
+		ResampleAudioReader reader(m_fileName, m_decoder);
+		if (!reader.is_valid()) {
+			m_manager->resident_data_decoded(m_key, QSharedPointer<ResidentSourceData>());
+			return;
+		}
+		reader.set_converter_type(config().get_property("Conversion", "RTResamplingConverterType", DEFAULT_RESAMPLE_QUALITY).toInt());
+		reader.set_output_rate(m_key.second);
+		
+		QSharedPointer<ResidentSourceData> data(new ResidentSourceData);
+		data->channels.resize(int(reader.get_num_channels()));
+		data->frames = 0;
+		
+		DecodeBuffer buffer;
+		const nframes_t chunkSize = 16384;
+		
+		forever {
+			nframes_t read = reader.read_from(&buffer, data->frames, chunkSize);
+			if (read == 0) {
+				break;
+			}
+			for (int chan = 0; chan < data->channels.size(); ++chan) {
+				QVector<audio_sample_t>& samples = data->channels[chan];
+				samples.resize(int(data->frames + read));
+				memcpy(samples.data() + data->frames, buffer.destination[chan], read * sizeof(audio_sample_t));
+			}
+			data->frames += read;
+			if (read < chunkSize) {
+				break;
+			}
+		}
+		
+		m_manager->resident_data_decoded(m_key, data);
+	}
+	
+private:
+	ResourcesManager*	m_manager;
+	ResidentKey		m_key;
+	QString			m_fileName;
+	QString			m_decoder;
+};
+
+
+/**
+ * 	Get the decoded samples of \a source at sample rate \a rate, if the source
+	is shorter then Hardware/residentsourcelength (in seconds).
+	Clips using such a source are played straight from memory, so they don't
+	need a ring buffer, nor DiskIO processing.
+
+	The samples are decoded in the background on the first request, a null
+	pointer is returned until residentDataReady() is emitted. The samples are
+	shared with all later requests as long as a ReadSource holds on to them.
+
+	Note: This function is thread save.
+ * @param source The ReadSource to decode
+ * @param rate The sample rate the samples should have
+ * @return The decoded samples, or a null pointer if the source is too long
+ *	or not decoded yet
+ */
+QSharedPointer<ResidentSourceData> ResourcesManager::get_resident_data(ReadSource* source, uint rate)
+{
+	double maxLength = config().get_property("Hardware", "residentsourcelength", 4.0).toDouble();
+	TimeRef length = source->get_length();
+	nframes_t frames = length.to_frame(rate);
+	
+	if (source->get_channel_count() == 0 || frames == 0 || frames > nframes_t(maxLength * rate)) {
+		return QSharedPointer<ResidentSourceData>();
+	}
+	
+	QMutexLocker locker(&m_residentMutex);
+	
+	ResidentKey key(source->get_id(), rate);
+	QSharedPointer<ResidentSourceData> data = m_residentSources.value(key).toStrongRef();
+	
+	if (data) {
+		// The caller holds on to it from now on
+		m_decodedResidents.remove(key);
+		return data;
+	}
+	
+	if (!m_pendingResidents.contains(key)) {
+		m_pendingResidents.insert(key);
+		m_residentPool.start(new ResidentDecoder(this, key, source->get_filename(), source->get_decoder_type()));
+	}
+	
+	return QSharedPointer<ResidentSourceData>();
+}
+
+// Called from a thread of the resident pool
+void ResourcesManager::resident_data_decoded(const ResidentKey& key, QSharedPointer<ResidentSourceData> data)
+{
+	QMutexLocker locker(&m_residentMutex);
+	
+	m_pendingResidents.remove(key);
+	
+	if (!data) {
+		return;
+	}
+	
+	m_residentSources.insert(key, data.toWeakRef());
+	m_decodedResidents.insert(key, data);
+	
+	locker.unlock();
+	
+	emit residentDataReady(key.first, key.second);
+}
+
+
 /**
  * 	Get the AudioClip with id \a id
 
@@ -27,6 +27,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QList>
 #include <QDomDocument>
 #include <QObject>
+#include <QMutex>
+#include <QPair>
+#include <QSharedPointer>
+#include <QVector>
+#include <QSet>
+#include <QThreadPool>
+
+#include "defines.h"
 
 
 class AudioSource;
@@ -34,6 +42,13 @@ class ReadSource;
 class AudioClip;
 class Project;
 
+// The decoded samples of a source that is short enough to be kept in memory
+// as a whole. Shared by all ReadSources of the source using the same rate.
+struct ResidentSourceData {
+	QVector<QVector<audio_sample_t> >	channels;
+	nframes_t				frames;
+};
+
 class ResourcesManager : public QObject
 {
 	Q_OBJECT
@@ -65,6 +80,7 @@ public:
 	bool is_source_in_use(qint64 id) const;
 
 	ReadSource* get_readsource(qint64 id);
+	QSharedPointer<ResidentSourceData> get_resident_data(ReadSource* source, uint rate);
 	
 	
 	QList<ReadSource*> get_all_audio_sources() const;
@@ -90,6 +106,19 @@ private:
 	QHash<qint64, SourceData* >	m_sources;
 	QHash<qint64, ClipData* >	m_clips;
 	ReadSource*			m_silentReadSource;
+	typedef QPair<qint64, uint> ResidentKey;
+	
+	class ResidentDecoder;
+	friend class ResidentDecoder;
+	
+	QHash<ResidentKey, QWeakPointer<ResidentSourceData> > m_residentSources;
+	// Decoded data nobody picked up yet, residentDataReady() was emitted for it
+	QHash<ResidentKey, QSharedPointer<ResidentSourceData> > m_decodedResidents;
+	QSet<ResidentKey>		m_pendingResidents;
+	QMutex				m_residentMutex;
+	QThreadPool			m_residentPool;
+	
+	void resident_data_decoded(const ResidentKey& key, QSharedPointer<ResidentSourceData> data);
 	
 	
 signals:
@@ -98,6 +127,7 @@ signals:
 	void clipAdded(AudioClip* clip);
 	void sourceAdded(ReadSource* source);
 	void sourceRemoved(ReadSource* source);
+	void residentDataReady(qint64 sourceId, uint rate);
 };
 
 
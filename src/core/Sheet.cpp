@@ -24,9 +24,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QTemporaryFile>
+
+#include <cfloat>
 #include <QList>
 #include <QMap>
+#include <QSet>
 #include <QRegExp>
+#include <QVarLengthArray>
 #include <QDebug>
 
 #include <commands.h>
@@ -47,6 +52,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Peak.h"
 #include "Export.h"
 #include "DiskIO.h"
+#include "LookaheadRenderer.h"
 #include "WriteSource.h"
 #include "AudioClipManager.h"
 #include "Tsar.h"
@@ -122,6 +128,7 @@ Sheet::~Sheet()
 	delete [] mixdown;
 	delete [] gainbuffer;
 
+	delete m_lookahead;
 	delete m_diskio;
         delete m_masterOutBusTrack;
 	delete m_renderBus;
@@ -157,6 +164,7 @@ void Sheet::init()
 	connect(this, SIGNAL(seekStart()), m_diskio, SLOT(seek()), Qt::QueuedConnection);
 	connect(this, SIGNAL(prepareRecording()), this, SLOT(prepare_recording()));
 	connect(&audiodevice(), SIGNAL(driverParamsChanged()), this, SLOT(audiodevice_params_changed()), Qt::DirectConnection);
+	connect(&audiodevice(), SIGNAL(bufferSizeChanged()), this, SLOT(audiodevice_params_changed()), Qt::DirectConnection);
 	connect(m_diskio, SIGNAL(seekFinished()), this, SLOT(seek_finished()), Qt::QueuedConnection);
 	connect (m_diskio, SIGNAL(readSourceBufferUnderRun()), this, SLOT(handle_diskio_readbuffer_underrun()));
 	connect (m_diskio, SIGNAL(writeSourceBufferOverRun()), this, SLOT(handle_diskio_writebuffer_overrun()));
@@ -176,6 +184,13 @@ void Sheet::init()
         busConfig.name = "Sheet Clip Render Bus";
         m_clipRenderBus = new AudioBus(busConfig);
 
+        m_lookahead = new LookaheadRenderer(this);
+        m_lookahead->set_enabled(config().get_property("Hardware", "AnticipativeProcessing", false).toBool());
+        connect(this, SIGNAL(trackAdded(Track*)), this, SLOT(lookahead_track_added(Track*)));
+        connect(this, SIGNAL(trackRemoved(Track*)), this, SLOT(invalidate_lookahead()));
+        connect(this, SIGNAL(transportStarted()), this, SLOT(lookahead_transport_started()));
+        connect(this, SIGNAL(transportStopped()), this, SLOT(lookahead_transport_stopped()));
+
         m_masterOutBusTrack = new MasterOutSubGroup(this, tr("Sheet Master"));
         m_masterOutBusTrack->set_gain(0.5);
         resize_buffer(audiodevice().get_buffer_size());
@@ -362,6 +377,9 @@ int Sheet::prepare_export(ExportSpecification* spec)
 			}
 			printf("Sheet::prepare_export: had to wait %d process cycles before the transport was stopped\n", count);
 		}
+
+		// The export reads the clips from here on
+		m_lookahead->wait_until_idle();
 		
 		m_rendering = true;
 	}
@@ -445,6 +463,162 @@ int Sheet::prepare_export(ExportSpecification* spec)
 	return 1;
 }
 
+// Offline rendering can use larger blocks then the audio device period, as
+// long as no track sends to a bus outside this sheet. The buses of the sheet
+// are resized for the export, those of the project and audio device are not.
+bool Sheet::can_render_in_large_blocks() const
+{
+        QList<AudioBus*> sheetBuses;
+        sheetBuses.append(m_masterOutBusTrack->get_process_bus());
+        foreach(TBusTrack* busTrack, m_busTracks) {
+                sheetBuses.append(busTrack->get_process_bus());
+        }
+
+        foreach(Track* track, get_tracks()) {
+                QList<TSend*> sends = track->get_post_sends() + track->get_pre_sends();
+                foreach(TSend* send, sends) {
+                        if (!sheetBuses.contains(send->get_bus())) {
+                                return false;
+                        }
+                }
+        }
+
+        return true;
+}
+
+// Creates an encoder for each export target of spec, or one for the format
+// of spec itself if no targets are set. Each encoder runs in its own thread.
+static int create_encoders(ExportSpecification* spec, QList<ExportEncoder*>& encoders)
+{
+        if (spec->targets.isEmpty()) {
+                encoders.append(new ExportEncoder(spec));
+        } else {
+                // The file extension follows from the writer type and file type,
+                // targets which would write to the same file get numbered.
+                QSet<QString> fileNames;
+                foreach(const ExportTarget& target, spec->targets) {
+                        ExportTarget unique = target;
+                        QString format = target.writerType + ":" + target.extraFormat.value("filetype") + ":";
+                        for (int i = 2; fileNames.contains(format + unique.nameSuffix); ++i) {
+                                unique.nameSuffix = target.nameSuffix + "-" + QString::number(i);
+                        }
+                        fileNames.insert(format + unique.nameSuffix);
+                        encoders.append(new ExportEncoder(spec, &unique));
+                }
+        }
+
+        foreach(ExportEncoder* encoder, encoders) {
+                if (encoder->prepare_export() == -1) {
+                        qDeleteAll(encoders);
+                        encoders.clear();
+                        return -1;
+                }
+        }
+
+        return 1;
+}
+
+int Sheet::start_encoders(ExportSpecification* spec)
+{
+        return create_encoders(spec, m_exportEncoders);
+}
+
+// Hands the rendered block in spec->dataF to all encoders
+int Sheet::encode(ExportSpecification* spec, nframes_t nframes)
+{
+        int result = 0;
+
+        foreach(ExportEncoder* encoder, m_exportEncoders) {
+                if (encoder->process(spec->dataF, nframes, spec->pos)) {
+                        result = -1;
+                }
+        }
+
+        return result;
+}
+
+int Sheet::finish_encoders()
+{
+        int result = 1;
+
+        foreach(ExportEncoder* encoder, m_exportEncoders) {
+                if (encoder->finish_export() < 0) {
+                        result = -1;
+                }
+                delete encoder;
+        }
+        m_exportEncoders.clear();
+
+        return result;
+}
+
+// Stems are tapped from the post fader signal of every track and bus while
+// the sheet is rendered, so all of them are written in the same render pass
+// as the mix. Stems are named after the cd track, numbered in track order.
+int Sheet::start_stem_encoders(ExportSpecification* spec)
+{
+        QList<Track*> tracks = get_tracks();
+
+        for (int i = 0; i < tracks.size(); ++i) {
+                Track* track = tracks.at(i);
+                QString trackName = track->get_name();
+                trackName.replace('/', '_');
+
+                ExportSpecification stemSpec(*spec);
+                stemSpec.name = QString("%1-%2-%3").arg(spec->name).arg(i + 1, 2, 10, QChar('0')).arg(trackName);
+
+                ExportStem* stem = new ExportStem;
+                stem->track = track;
+                stem->buffer.resize(int(spec->blocksize * spec->channels));
+                m_exportStems.append(stem);
+
+                if (create_encoders(&stemSpec, stem->encoders) == -1) {
+                        finish_stem_encoders();
+                        return -1;
+                }
+
+                track->set_stem_buffer(stem->buffer.data(), spec->channels);
+        }
+
+        return 1;
+}
+
+// Hands the rendered stems to their encoders. Muted tracks and buses don't
+// reach their stem tap, their stems are written as silence.
+int Sheet::encode_stems(ExportSpecification* spec, nframes_t nframes)
+{
+        int result = 0;
+
+        foreach(ExportStem* stem, m_exportStems) {
+                foreach(ExportEncoder* encoder, stem->encoders) {
+                        if (encoder->process(stem->buffer.constData(), nframes, spec->pos)) {
+                                result = -1;
+                        }
+                }
+        }
+
+        return result;
+}
+
+int Sheet::finish_stem_encoders()
+{
+        int result = 1;
+
+        foreach(ExportStem* stem, m_exportStems) {
+                stem->track->set_stem_buffer(nullptr, 0);
+                foreach(ExportEncoder* encoder, stem->encoders) {
+                        if (encoder->finish_export() < 0) {
+                                result = -1;
+                        }
+                        delete encoder;
+                }
+                delete stem;
+        }
+        m_exportStems.clear();
+
+        return result;
+}
+
 int Sheet::finish_audio_export()
 {
         delete renderDecodeBuffer;
@@ -461,6 +635,10 @@ int Sheet::start_export(ExportSpecification* spec)
         QString message;
         float peakvalue = 0.0;
 
+        if (spec->normalize && spec->renderpass == ExportSpecification::WRITE_TO_HARDDISK) {
+                return start_normalized_export(spec);
+        }
+
         spec->markers = m_timeline->get_cdtrack_list(spec);
 
         for (int i = 0; i < spec->markers.size()-1; ++i) {
@@ -475,11 +653,11 @@ int Sheet::start_export(ExportSpecification* spec)
 
 
                 if (spec->renderpass == ExportSpecification::WRITE_TO_HARDDISK) {
-                        m_exportSource = new WriteSource(spec);
-
-                        if (m_exportSource->prepare_export() == -1) {
-                                delete m_exportSource;
-                                m_exportSource = nullptr;
+                        if (start_encoders(spec) == -1) {
+                                return -1;
+                        }
+                        if (spec->stems && start_stem_encoders(spec) == -1) {
+                                finish_encoders();
                                 return -1;
                         }
 
@@ -497,9 +675,8 @@ int Sheet::start_export(ExportSpecification* spec)
                 spec->peakvalue = peakvalue;
 
                 if (spec->renderpass == ExportSpecification::WRITE_TO_HARDDISK) {
-                        m_exportSource->finish_export();
-                        delete m_exportSource;
-                        m_exportSource = nullptr;
+                        finish_encoders();
+                        finish_stem_encoders();
                 }
         }
 
@@ -507,10 +684,235 @@ int Sheet::start_export(ExportSpecification* spec)
         return 1;
 }
 
+// Renders the clips, plugins and fader of track alone into a file in the
+// audio sources dir, the frozen track plays that file instead. The render
+// range is that of the track, its sends and mute state are ignored.
+int Sheet::freeze_track(ExportSpecification* spec, AudioTrack* track)
+{
+        if (prepare_export(spec) < 0) {
+                return -1;
+        }
+
+        TimeRef startlocation(LONG_LONG_MAX);
+        TimeRef endlocation;
+        track->get_render_range(startlocation, endlocation);
+
+        // Reverbs and delays ring on after the last clip, keep rendering
+        // until the track stayed silent for a second, or the tail reaches
+        // Project/FreezeTailLength seconds.
+        uint rate = audiodevice().get_sample_rate();
+        int tailSeconds = qMax(0, config().get_property("Project", "FreezeTailLength", 30).toInt());
+        TimeRef clipsEnd = endlocation;
+        endlocation = endlocation + TimeRef(nframes_t(tailSeconds) * rate, rate);
+
+        spec->startLocation = startlocation;
+        spec->endLocation   = endlocation;
+        spec->cdTrackStart  = startlocation;
+        spec->cdTrackEnd    = endlocation;
+        spec->totalTime     = endlocation - startlocation;
+        spec->pos           = startlocation;
+        spec->name          = QString("%1-%2-frozen-%3").arg(m_name).arg(track->get_name()).arg(create_id());
+        spec->name.replace('/', '_');
+        m_transportLocation = startlocation;
+
+        m_project->set_export_message(tr("Freezing Track %1").arg(track->get_name()));
+
+        ExportEncoder encoder(spec);
+        if (encoder.prepare_export() == -1) {
+                finish_audio_export();
+                return -1;
+        }
+
+        QVector<audio_sample_t> buffer(int(spec->blocksize * spec->channels));
+        track->set_stem_buffer(buffer.data(), spec->channels);
+
+        int result = 1;
+        int progress;
+        nframes_t silentFrames = 0;
+
+        while (!spec->stop && silentFrames < rate) {
+                nframes_t diff = (spec->endLocation - spec->pos).to_frame(int(rate));
+                nframes_t nframes = std::min(diff, nframes_t(spec->blocksize));
+
+                if (nframes == 0) {
+                        break;
+                }
+
+                buffer.fill(0.0f);
+                track->render_freeze(spec->blocksize);
+                m_transportLocation.add_frames(spec->blocksize, int(rate));
+
+                if (encoder.process(buffer.constData(), nframes, spec->pos)) {
+                        result = -1;
+                        break;
+                }
+
+                if (spec->pos >= clipsEnd) {
+                        // -90 dB counts as silence
+                        float peak = Mixer::compute_peak(buffer.constData(), nframes * spec->channels, 0.0f);
+                        silentFrames = (peak < 0.0000316f) ? silentFrames + nframes : 0;
+                }
+
+                spec->pos.add_frames(nframes, int(rate));
+
+                progress = int(double( 100 * (spec->pos - spec->startLocation).universal_frame()) / (spec->totalTime.universal_frame()));
+                if (progress > spec->progress) {
+                        spec->progress = progress;
+                        m_project->set_sheet_export_progress(this, progress);
+                }
+        }
+
+        track->set_stem_buffer(nullptr, 0);
+
+        if (encoder.finish_export() < 0) {
+                result = -1;
+        }
+
+        finish_audio_export();
+
+        if (spec->stop && result > 0) {
+                result = 0;
+        }
+
+        return result;
+}
+
+// Normalizing needs the peak value of the whole sheet before the first sample
+// can be written. Instead of rendering everything twice, each cd track is
+// rendered once into a float spool file while the peak is tracked, and the
+// tracks are written from their spool files once the norm factor is known.
+int Sheet::start_normalized_export(ExportSpecification* spec)
+{
+        QList<QTemporaryFile*> spools;
+        int result = 1;
+
+        spec->markers = m_timeline->get_cdtrack_list(spec);
+        spec->peakvalue = 0.0;
+        spec->renderpass = ExportSpecification::CALC_NORM_FACTOR;
+
+        for (int i = 0; i < spec->markers.size()-1 && !spec->stop; ++i) {
+                QTemporaryFile* spool = new QTemporaryFile(spec->exportdir + "/.traverso-export-XXXXXX.spool");
+                spools.append(spool);
+
+                if (!spool->open()) {
+                        info().warning(tr("Unable to create a temporary file for normalizing in %1").arg(spec->exportdir));
+                        result = -1;
+                        break;
+                }
+
+                spec->progress      = 0;
+                spec->cdTrackStart  = cd_to_timeref(timeref_to_cd(spec->markers.at(i)->get_when()));
+                spec->cdTrackEnd    = cd_to_timeref(timeref_to_cd(spec->markers.at(i+1)->get_when()));
+                spec->name          = m_timeline->format_cdtrack_name(spec->markers.at(i), i+1);
+                spec->totalTime     = spec->cdTrackEnd - spec->cdTrackStart;
+                spec->pos           = spec->cdTrackStart;
+                m_transportLocation = spec->cdTrackStart;
+
+                // Stems keep the levels of the mix, so they are written
+                // right away instead of being spooled for normalizing.
+                if (spec->stems && start_stem_encoders(spec) == -1) {
+                        result = -1;
+                        break;
+                }
+
+                m_project->set_export_message(QString(tr("Rendering Sheet %1 - Track %2 of %3")).arg(m_name).arg(i+1).arg(spec->markers.size()-1));
+
+                m_exportSpool = spool;
+                while(render(spec) > 0) {}
+                m_exportSpool = nullptr;
+
+                if (finish_stem_encoders() < 0) {
+                        result = -1;
+                        break;
+                }
+
+                if (spool->error() != QFile::NoError) {
+                        info().warning(tr("Unable to write to temporary file %1").arg(spool->fileName()));
+                        result = -1;
+                        break;
+                }
+        }
+
+        spec->normvalue = (1.0f - FLT_EPSILON) / spec->peakvalue;
+        spec->renderpass = ExportSpecification::WRITE_TO_HARDDISK;
+
+        for (int i = 0; i < spools.size() && result > 0 && !spec->stop; ++i) {
+                spec->progress      = 0;
+                spec->cdTrackStart  = cd_to_timeref(timeref_to_cd(spec->markers.at(i)->get_when()));
+                spec->cdTrackEnd    = cd_to_timeref(timeref_to_cd(spec->markers.at(i+1)->get_when()));
+                spec->name          = m_timeline->format_cdtrack_name(spec->markers.at(i), i+1);
+                spec->totalTime     = spec->cdTrackEnd - spec->cdTrackStart;
+                spec->pos           = spec->cdTrackStart;
+
+                if (start_encoders(spec) == -1) {
+                        result = -1;
+                        break;
+                }
+
+                m_project->set_export_message(QString(tr("Writing Sheet %1 - Track %2 of %3")).arg(m_name).arg(i+1).arg(spec->markers.size()-1));
+
+                if (write_from_spool(spec, spools.at(i)) < 0) {
+                        result = -1;
+                }
+
+                if (finish_encoders() < 0) {
+                        result = -1;
+                }
+        }
+
+        qDeleteAll(spools);
+
+        finish_audio_export();
+        return result;
+}
+
+// Feeds the spooled audio of one cd track to the ExportEncoders in the same
+// blocks as render() would, so the result equals a two pass export.
+int Sheet::write_from_spool(ExportSpecification* spec, QFile* spool)
+{
+        int progress;
+        uint rate = audiodevice().get_sample_rate();
+        int bufsize = int(spec->blocksize * spec->channels);
+
+        if (!spool->seek(0)) {
+                return -1;
+        }
+
+        while (!spec->stop) {
+                nframes_t diff = (spec->cdTrackEnd - spec->pos).to_frame(int(rate));
+                nframes_t nframes = std::min(diff, nframes_t(spec->blocksize));
+
+                if (nframes == 0) {
+                        break;
+                }
+
+                qint64 bytes = qint64(nframes) * spec->channels * sizeof(audio_sample_t);
+                if (spool->read(reinterpret_cast<char*>(spec->dataF), bytes) != bytes) {
+                        PERROR("Sheet::write_from_spool: spool file is truncated");
+                        return -1;
+                }
+
+                Mixer::apply_gain_to_buffer(spec->dataF, nframes_t(bufsize), spec->normvalue);
+
+                if (encode(spec, nframes)) {
+                        return -1;
+                }
+
+                spec->pos.add_frames(nframes, int(rate));
+
+                progress = int(double( 100 * (spec->pos - spec->cdTrackStart).universal_frame()) / (spec->totalTime.universal_frame()));
+                if (progress > spec->progress) {
+                        spec->progress = progress;
+                        m_project->set_sheet_export_progress(this, progress);
+                }
+        }
+
+        return 1;
+}
+
 int Sheet::render(ExportSpecification* spec)
 {
 	int chn;
-    int x;
         int progress = 0;
 
         nframes_t diff = (spec->cdTrackEnd - spec->pos).to_frame(int(audiodevice().get_sample_rate()));
@@ -528,46 +930,57 @@ int Sheet::render(ExportSpecification* spec)
 
 	/* do the usual stuff */
 
+	foreach(ExportStem* stem, m_exportStems) {
+		stem->buffer.fill(0.0f);
+	}
+
 	process_export(nframes);
 
 	/* and now export the results */
 
 	nframes = this_nframes;
 
-    memset (spec->dataF, 0, sizeof (spec->dataF[0]) * nframes * ulong(spec->channels));
-
 	/* foreach output channel ... */
 
-	float* buf;
 	AudioBus* masterOutBus = m_masterOutBusTrack->get_process_bus();
+	QVarLengthArray<const audio_sample_t*, 8> channelBuffers(spec->channels);
 
 	for (chn = 0; chn < spec->channels; ++chn) {
-		buf = masterOutBus->get_buffer(chn, nframes);
+		channelBuffers[chn] = masterOutBus->get_buffer(chn, nframes);
 
-		if (!buf) {
+		if (!channelBuffers[chn]) {
 			// Seem we are exporting at least to Stereo from an AudioBus with only one channel...
 			// Use the first channel..
-			buf = masterOutBus->get_buffer(0, nframes);
-		}
-
-        for (x = 0; x < int(nframes); ++x) {
-			spec->dataF[chn+(x*spec->channels)] = buf[x];
+			channelBuffers[chn] = masterOutBus->get_buffer(0, nframes);
 		}
 	}
 
+	Mixer::interleave(channelBuffers.constData(), spec->dataF, nframes, uint(spec->channels));
+
 
     int bufsize = int(int(spec->blocksize) * spec->channels);
 	if (spec->normalize) {
 		if (spec->renderpass == ExportSpecification::CALC_NORM_FACTOR) {
             spec->peakvalue = Mixer::compute_peak(spec->dataF, nframes_t(bufsize), spec->peakvalue);
+
+			if (m_exportSpool) {
+				qint64 bytes = qint64(nframes) * spec->channels * sizeof(audio_sample_t);
+				if (m_exportSpool->write(reinterpret_cast<const char*>(spec->dataF), bytes) != bytes) {
+					return -1;
+				}
+			}
 		}
 	}
 	
+	if (!m_exportStems.isEmpty() && encode_stems(spec, nframes)) {
+		return -1;
+	}
+
 	if (spec->renderpass == ExportSpecification::WRITE_TO_HARDDISK) {
 		if (spec->normalize) {
             Mixer::apply_gain_to_buffer(spec->dataF, nframes_t(bufsize), spec->normvalue);
 		}
-		if (m_exportSource->process (nframes)) {
+		if (encode(spec, nframes)) {
                         return -1;
 		}
 	}
@@ -581,7 +994,7 @@ int Sheet::render(ExportSpecification* spec)
         // old progress value, to avoid a flood of progress changed signals!
         if (progress > spec->progress) {
                 spec->progress = progress;
-                m_project->set_sheet_export_progress(progress);
+                m_project->set_sheet_export_progress(this, progress);
         }
 
         return 1;
@@ -707,6 +1120,7 @@ int Sheet::process( nframes_t nframes )
 {
 	if (m_startSeek) {
                 printf("process: starting seek\n");
+		m_lookahead->transport_stopped();
 		start_seek();
 		return 0;
 	}
@@ -724,12 +1138,18 @@ int Sheet::process( nframes_t nframes )
         m_transport = 0;
 		m_realtimepath = false;
 		m_stopTransport = false;
+		m_lookahead->transport_stopped();
 		
                 RT_THREAD_EMIT(this, nullptr, transportStopped())
 
 		return 0;
     }
 
+	// Hold the transport until the buffers of the anticipative Tracks are filled
+	if (!m_lookahead->prepare_cycle(nframes)) {
+		return 0;
+	}
+
 	// zero the m_masterOut buffers
         m_masterOutBusTrack->get_process_bus()->silence_buffers(nframes);
         apill_foreach(TBusTrack* busTrack, TBusTrack*, m_rtBusTracks) {
@@ -751,6 +1171,7 @@ int Sheet::process( nframes_t nframes )
 
 	// update the transport location
     m_transportLocation.add_frames(nframes, int(audiodevice().get_sample_rate()));
+	m_lookahead->finish_cycle(nframes);
 
 	if (!processResult) {
 		return 0;
@@ -804,6 +1225,9 @@ void Sheet::resize_buffer(nframes_t size)
         buses.append(m_masterOutBusTrack->get_process_bus());
         buses.append(m_renderBus);
         buses.append(m_clipRenderBus);
+        foreach(TBusTrack* busTrack, m_busTracks) {
+                buses.append(busTrack->get_process_bus());
+        }
         foreach(AudioBus* bus, buses) {
                 for(int i=0; i<bus->get_channel_count(); i++) {
                         if (AudioChannel* chan = bus->get_channel(i)) {
@@ -1212,6 +1636,34 @@ void Sheet::config_changed()
 	if (m_diskio->get_resample_quality() != quality) {
 		m_diskio->set_resample_quality(quality);
 	}
+
+	m_lookahead->set_enabled(config().get_property("Hardware", "AnticipativeProcessing", false).toBool());
+}
+
+// Starts a new epoch of the LookaheadRenderer, to be called when
+// the set of Tracks which can be rendered ahead might have changed.
+void Sheet::invalidate_lookahead()
+{
+	m_lookahead->invalidate();
+}
+
+void Sheet::lookahead_transport_started()
+{
+	m_lookahead->set_transport_rolling(true);
+}
+
+void Sheet::lookahead_transport_stopped()
+{
+	m_lookahead->set_transport_rolling(false);
+}
+
+void Sheet::lookahead_track_added(Track* track)
+{
+	if (track->get_type() == Track::AUDIOTRACK) {
+		m_lookahead->add_track(static_cast<AudioTrack*>(track));
+	}
+
+	m_lookahead->invalidate();
 }
 
 
@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "TSession.h"
 #include <QDomNode>
 #include <QTimer>
+#include <QVector>
 #include "defines.h"
 #include "APILinkedList.h"
 
@@ -32,9 +33,11 @@ class Project;
 class AudioTrack;
 class AudioSource;
 class WriteSource;
+class ExportEncoder;
 class AudioTrack;
 class AudioClip;
 class DiskIO;
+class LookaheadRenderer;
 class AudioClipManager;
 class TAudioDeviceClient;
 class AudioBus;
@@ -44,6 +47,7 @@ class Snappable;
 class DecodeBuffer;
 class TBusTrack;
 class Track;
+class QFile;
 
 struct ExportSpecification;
 
@@ -69,6 +73,7 @@ public:
 	AudioClipManager* get_audioclip_manager() const;
 	AudioBus* get_render_bus() const {return m_renderBus;}
 	AudioBus* get_clip_render_bus() const {return m_clipRenderBus;}
+	LookaheadRenderer* get_lookahead_renderer() const {return m_lookahead;}
         AudioTrack* get_audio_track_for_index(int index);
         QString get_audio_sources_dir() const;
         TimeRef get_last_location() const;
@@ -93,6 +98,8 @@ public:
 	int prepare_export(ExportSpecification* spec);
 	int render(ExportSpecification* spec);
         int start_export(ExportSpecification* spec);
+        int freeze_track(ExportSpecification* spec, AudioTrack* track);
+        bool can_render_in_large_blocks() const;
 
         void solo_track(Track* track);
 	void create(int tracksToCreate);
@@ -105,7 +112,6 @@ public:
         bool is_recording() const {return m_recording;}
 	bool is_smaller_then(APILinkedListNode* node) {Q_UNUSED(node); return false;}
 
-        audio_sample_t*		readbuffer{};
         DecodeBuffer*		renderDecodeBuffer{};
 
 #if defined (THREAD_CHECK)
@@ -113,14 +119,23 @@ public:
 #endif
 
 private:
+        struct ExportStem {
+                Track*			track;
+                QVector<audio_sample_t>	buffer;
+                QList<ExportEncoder*>	encoders;
+        };
+
         QList<AudioClip*>	m_recordingClips;
 	QTimer			m_skipTimer;
 	Project*		m_project;
-    WriteSource*		m_exportSource{};
+    QList<ExportEncoder*>	m_exportEncoders;
+    QList<ExportStem*>	m_exportStems;
+    QFile*			m_exportSpool{};
         TAudioDeviceClient*	m_audiodeviceClient{};
         AudioBus*		m_renderBus{};
     AudioBus*		m_clipRenderBus{};
     DiskIO*			m_diskio{};
+    LookaheadRenderer*	m_lookahead{};
     AudioClipManager*	m_acmanager{};
 	QList<TimeRef>		m_xposList;
         QString                 m_audioSourcesDir;
@@ -150,6 +165,14 @@ private:
 	void init();
 
 	int finish_audio_export();
+	int start_normalized_export(ExportSpecification* spec);
+	int write_from_spool(ExportSpecification* spec, QFile* spool);
+	int start_encoders(ExportSpecification* spec);
+	int encode(ExportSpecification* spec, nframes_t nframes);
+	int finish_encoders();
+	int start_stem_encoders(ExportSpecification* spec);
+	int encode_stems(ExportSpecification* spec, nframes_t nframes);
+	int finish_stem_encoders();
 	void start_seek();
         void initiate_seek_start(TimeRef location);
 	void start_transport_rolling(bool realtime);
@@ -159,12 +182,14 @@ private:
         void resize_buffer(nframes_t size);
 
 	friend class AudioClipManager;
+	friend class LookaheadRenderer;
 
 public slots :
 	void seek_finished();
         void audiodevice_params_changed();
         void set_gain(float gain);
         void set_transport_pos(TimeRef location);
+        void invalidate_lookahead();
 
 
 	TCommand* next_skip_pos();
@@ -188,6 +213,9 @@ private slots:
 	void prepare_recording();
 	void clip_finished_recording(AudioClip* clip);
 	void config_changed();
+	void lookahead_track_added(Track* track);
+	void lookahead_transport_started();
+	void lookahead_transport_stopped();
 };
 
 #endif
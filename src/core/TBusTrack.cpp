@@ -144,6 +144,8 @@ int TBusTrack::process(nframes_t nframes)
 
     process_post_sends(nframes);
 
+    process_stem(nframes);
+
     m_processBus->silence_buffers(nframes);
 
     return 1;
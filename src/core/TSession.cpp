@@ -35,6 +35,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 #include "Debugger.h"
 
+// Scratch buffers of the calling thread, see TSession::set_thread_buffers()
+static thread_local audio_sample_t* threadMixdown = nullptr;
+static thread_local audio_sample_t* threadGainBuffer = nullptr;
+
 TSession::TSession(TSession *parentSession)
 	: ContextItem()
 {
@@ -243,6 +247,29 @@ TimeRef TSession::get_last_location() const
 	return TimeRef();
 }
 
+/**
+ * 	Makes the gain and fade curves processed in the calling thread use
+ *	\a mixdown and \a gainbuffer as scratch buffers, instead of those of
+ *	the session they belong to. Used by the LookaheadRenderer, which renders
+ *	concurrently with the audio thread and in larger blocks then the session
+ *	buffers can hold. Pass null buffers to use those of the session again.
+ */
+void TSession::set_thread_buffers(audio_sample_t* mixdown, audio_sample_t* gainbuffer)
+{
+	threadMixdown = mixdown;
+	threadGainBuffer = gainbuffer;
+}
+
+audio_sample_t* TSession::get_mixdown_buffer() const
+{
+	return threadMixdown ? threadMixdown : mixdown;
+}
+
+audio_sample_t* TSession::get_gain_buffer() const
+{
+	return threadGainBuffer ? threadGainBuffer : gainbuffer;
+}
+
 TimeRef TSession::get_transport_location() const
 {
 	if (m_parentSession) {
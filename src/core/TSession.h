@@ -90,6 +90,10 @@ public:
 	audio_sample_t* 	mixdown{};
 	audio_sample_t*		gainbuffer{};
 
+	audio_sample_t* get_mixdown_buffer() const;
+	audio_sample_t* get_gain_buffer() const;
+	static void set_thread_buffers(audio_sample_t* mixdown, audio_sample_t* gainbuffer);
+
 	enum Mode {
 		EDIT = 1,
 		EFFECTS = 2
@@ -462,6 +462,13 @@ void TShortcutManager::loadFunctions()
 	function->commandName = "AudioTrackSilenceOthers";
     registerFunction(function);
 
+	function = new TFunction();
+	function->object = "AudioTrack";
+	function->slotsignature = "toggle_freeze";
+	function->m_description = tr("Freeze: On/Off");
+	function->commandName = "AudioTrackToggleFreeze";
+    registerFunction(function);
+
 	function = new TFunction();
 	function->object = "FadeCurve";
 	function->slotsignature = "set_mode";
@@ -994,6 +1001,13 @@ void TShortcutManager::loadFunctions()
 	function->commandName = "ProjectSave";
     registerFunction(function);
 
+	function = new TFunction();
+	function->object = "Project";
+	function->slotsignature = "toggle_latency_profile";
+	function->setDescription(tr("Latency Profile: Tracking/Mixing"));
+	function->commandName = "ProjectToggleLatencyProfile";
+    registerFunction(function);
+
 	function = new TFunction();
 	function->object = "CurveView";
 	function->slotsignature = "select_lazy_selected_node";
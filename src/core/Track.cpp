@@ -34,6 +34,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "TBusTrack.h"
 #include "TSend.h"
 
+#include <QVarLengthArray>
+
 #include "Debugger.h"
 
 Track::Track(TSession* session)
@@ -436,6 +438,35 @@ void Track::add_input_bus(const QString &name)
         }
 }
 
+/**
+ * 	Stem exports pass an interleaved \a buffer with room for \a channels
+ *	channels of a whole render block, process_stem() copies the post fader
+ *	signal of this Track into it. Pass a null \a buffer to stop tapping.
+ */
+void Track::set_stem_buffer(audio_sample_t* buffer, uint channels)
+{
+        m_stemBuffer = buffer;
+        m_stemChannels = channels;
+}
+
+// Interleaves the process bus into the stem buffer, a mono
+// process bus is copied into all channels of the stem.
+void Track::process_stem(nframes_t nframes)
+{
+        if (!m_stemBuffer) {
+                return;
+        }
+
+        uint busChannels = m_processBus->get_channel_count();
+        QVarLengthArray<const audio_sample_t*, 8> channelBuffers(int(m_stemChannels));
+
+        for (uint chan = 0; chan < m_stemChannels; ++chan) {
+                channelBuffers[int(chan)] = m_processBus->get_buffer(chan < busChannels ? chan : 0, nframes);
+        }
+
+        Mixer::interleave(channelBuffers.constData(), m_stemBuffer, nframes, m_stemChannels);
+}
+
 void Track::process_post_sends(nframes_t nframes)
 {
         apill_foreach(TSend* postSend, TSend*, m_postSends) {
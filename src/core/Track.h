@@ -85,6 +85,8 @@ public:
         TSend* get_send(qint64 sendId);
         virtual void add_input_bus(AudioBus* bus);
 
+        void set_stem_buffer(audio_sample_t* buffer, uint channels);
+
 
 protected:
         VUMonitors      m_vumonitors;
@@ -102,7 +104,12 @@ protected:
         AudioBus*       m_inputBus;
         QString         m_busInName;
 
+        // Only set during stem exports
+        audio_sample_t* m_stemBuffer{};
+        uint            m_stemChannels{};
+
         void process_post_sends(nframes_t nframes);
+        void process_stem(nframes_t nframes);
         void process_pre_sends(nframes_t nframes);
         void remove_input_bus(AudioBus* bus);
 
@@ -32,11 +32,37 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "Utils.h"
 #include "DiskIO.h"
 
+#include <QRunnable>
+#include <QThreadPool>
+
 // Always put me below _all_ includes, this is needed
 // in case we run with memory leak detection enabled!
 #include "Debugger.h"
 
 
+// Encodes compressed recordings, so DiskIO only has to copy the recorded
+// data out of the ring buffers. Each WriteSource has at most one job queued
+// at a time, so the blocks of a file are encoded in order.
+static QThreadPool& encoder_pool()
+{
+	static QThreadPool pool;
+	return pool;
+}
+
+class WriteSource::EncodeJob : public QRunnable
+{
+public:
+	EncodeJob(WriteSource* source) : m_source(source) {}
+
+	void run() {
+		m_source->encode_queued();
+	}
+
+private:
+	WriteSource* m_source;
+};
+
+
 WriteSource::WriteSource( ExportSpecification* specification )
 	: AudioSource(specification->exportdir, specification->name)
 	, m_spec(specification)
@@ -63,9 +89,17 @@ WriteSource::~WriteSource()
 	if (m_writer) {
 		delete m_writer;
 	}
+
+	qDeleteAll(m_encodeQueue);
+	qDeleteAll(m_freeEncodeBlocks);
 }
 
 int WriteSource::process (nframes_t nframes)
+{
+	return process(m_spec->dataF, nframes);
+}
+
+int WriteSource::process (audio_sample_t* data, nframes_t nframes)
 {
     float* float_buffer = nullptr;
     uint chn;
@@ -102,7 +136,7 @@ int WriteSource::process (nframes_t nframes)
 
 					/* first time, append new data from dataF into the m_leftoverF buffer */
 
-					memcpy (m_leftoverF + (m_leftover_frames * m_channelCount), m_spec->dataF, nframes * m_channelCount * sizeof(float));
+					memcpy (m_leftoverF + (m_leftover_frames * m_channelCount), data, nframes * m_channelCount * sizeof(float));
 					m_src_data.input_frames = nframes + m_leftover_frames;
 				} else {
 
@@ -115,7 +149,7 @@ int WriteSource::process (nframes_t nframes)
 				}
 			} else {
 
-				m_src_data.data_in = m_spec->dataF;
+				m_src_data.data_in = data;
 				m_src_data.input_frames = nframes;
 
 			}
@@ -147,7 +181,7 @@ int WriteSource::process (nframes_t nframes)
 
 			to_write = nframes;
 			m_leftover_frames = 0;
-			float_buffer = m_spec->dataF;
+			float_buffer = data;
 		}
 
 		if (m_output_data) {
@@ -158,9 +192,7 @@ int WriteSource::process (nframes_t nframes)
 		case 8:
 		case 16:
 		case 24:
-			for (chn = 0; chn < m_channelCount; ++chn) {
-				gdither_runf (m_dither, chn, to_write, float_buffer, m_output_data);
-			}
+			gdither_runf_interleaved (m_dither, to_write, float_buffer, m_output_data);
 			/* and export to disk */
 			written = m_writer->write(m_output_data, to_write);
 			break;
@@ -221,6 +253,7 @@ int WriteSource::prepare_export()
 	m_sampleRate = audiodevice().get_sample_rate();
 	m_channelCount = m_spec->channels;
 	m_processPeaks = false;
+	m_encodeInPool = m_spec->isRecording && m_spec->writerType != "sndfile";
     m_diskio = nullptr;
     m_dataF2 = m_leftoverF = nullptr;
     m_dither = nullptr;
@@ -443,7 +476,11 @@ int WriteSource::rb_file_write(nframes_t cnt)
 			}
 		}
 		
-		process(read);
+		if (m_encodeInPool) {
+			queue_encode(m_spec->dataF, read);
+		} else {
+			process(read);
+		}
 	}
 	
 	for (chan=0; chan<m_channelCount; ++chan) {
@@ -467,6 +504,13 @@ void WriteSource::process_ringbuffer(audio_sample_t* buffer)
 	if (! m_isRecording ) {
 		PMESG("Writing remaining  (%d) samples to ringbuffer", readSpace);
 		rb_file_write(readSpace);
+		if (m_encodeInPool) {
+			// The encoder pool closes the file once it has caught up
+			m_diskio->unregister_write_source(this);
+			m_diskio = nullptr;
+			finish_encode();
+			return;
+		}
 		finish_export();
 		return;
 	}
@@ -478,6 +522,7 @@ void WriteSource::prepare_rt_buffers( )
 {
 	m_bufferSize = m_sampleRate * DiskIO::writebuffertime;
 	m_chunkSize = m_bufferSize / DiskIO::bufferdividefactor;
+	m_maxQueuedFrames = m_bufferSize * 4;
 	for (int i=0; i<m_channelCount; ++i) {
 		m_buffers.append(new RingBufferNPT<audio_sample_t>(m_bufferSize));
 	}
@@ -489,3 +534,121 @@ void WriteSource::set_diskio( DiskIO * io )
 	prepare_rt_buffers();
 }
 
+
+/**
+ * 	Queues \a nframes interleaved frames for the encoder pool. If the encoder
+ *	falls too far behind, the frames are spilled to a raw float file instead,
+ *	and read back once the encoder gets to them. Runs in the DiskIO thread.
+ */
+void WriteSource::queue_encode(const audio_sample_t* interleaved, nframes_t nframes)
+{
+	QMutexLocker locker(&m_encodeMutex);
+
+	EncodeBlock* block = m_freeEncodeBlocks.isEmpty() ? new EncodeBlock : m_freeEncodeBlocks.takeLast();
+	block->nframes = nframes;
+	block->spilled = (m_queuedFrames + nframes) > m_maxQueuedFrames;
+
+	locker.unlock();
+
+	qint64 bytes = qint64(nframes) * m_channelCount * sizeof(audio_sample_t);
+
+	if (block->spilled) {
+		if (!m_spillFile.isOpen()) {
+			m_spillFile.setFileName(m_fileName + ".spill");
+			if (m_spillFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+				PWARN(QString("WriteSource: encoder falls behind, spilling to %1").arg(m_spillFile.fileName()).toLatin1().data());
+			}
+		}
+		if (!m_spillFile.isOpen() ||
+		    m_spillFile.write(reinterpret_cast<const char*>(interleaved), bytes) != bytes ||
+		    !m_spillFile.flush()) {
+			// Keep it in memory then
+			block->spilled = false;
+		}
+	}
+
+	if (!block->spilled) {
+		block->data.resize(int(nframes * m_channelCount));
+		memcpy(block->data.data(), interleaved, size_t(bytes));
+	}
+
+	locker.relock();
+
+	if (!block->spilled) {
+		m_queuedFrames += nframes;
+	}
+	m_encodeQueue.enqueue(block);
+
+	if (!m_encodeScheduled) {
+		m_encodeScheduled = true;
+		encoder_pool().start(new EncodeJob(this));
+	}
+}
+
+// Called from the DiskIO thread once the last frames are queued
+void WriteSource::finish_encode()
+{
+	QMutexLocker locker(&m_encodeMutex);
+
+	m_encodeFinishing = true;
+
+	if (!m_encodeScheduled) {
+		m_encodeScheduled = true;
+		encoder_pool().start(new EncodeJob(this));
+	}
+}
+
+void WriteSource::encode_queued()
+{
+	forever {
+		m_encodeMutex.lock();
+		if (m_encodeQueue.isEmpty()) {
+			m_encodeScheduled = false;
+			bool finishing = m_encodeFinishing;
+			m_encodeMutex.unlock();
+
+			if (finishing) {
+				if (m_spillFile.isOpen()) {
+					m_spillReader.close();
+					m_spillFile.remove();
+				}
+				// emits exportFinished(), we might be deleted after this
+				finish_export();
+			}
+			return;
+		}
+		EncodeBlock* block = m_encodeQueue.dequeue();
+		bool failed = m_encodeFailed;
+		m_encodeMutex.unlock();
+
+		int result = 0;
+
+		if (!failed && block->spilled) {
+			qint64 bytes = qint64(block->nframes) * m_channelCount * sizeof(audio_sample_t);
+			block->data.resize(int(block->nframes * m_channelCount));
+
+			if (!m_spillReader.isOpen()) {
+				m_spillReader.setFileName(m_spillFile.fileName());
+				m_spillReader.open(QIODevice::ReadOnly);
+			}
+			if (m_spillReader.read(reinterpret_cast<char*>(block->data.data()), bytes) != bytes) {
+				PERROR(QString("WriteSource: could not read back %1").arg(m_spillReader.fileName()));
+				result = -1;
+			}
+		}
+
+		if (!failed && result == 0) {
+			result = process(block->data.data(), block->nframes);
+		}
+
+		m_encodeMutex.lock();
+		if (result < 0) {
+			m_encodeFailed = true;
+		}
+		if (!block->spilled) {
+			m_queuedFrames -= block->nframes;
+		}
+		m_freeEncodeBlocks.append(block);
+		m_encodeMutex.unlock();
+	}
+}
@@ -27,6 +27,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "gdither.h"
 #include <samplerate.h>
 
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QVector>
+
 struct ExportSpecification;
 class Peak;
 class DiskIO;
@@ -51,6 +56,7 @@ public :
 	Peak* get_peak() {return m_peak;}
 
 	int process(nframes_t nframes);
+	int process(audio_sample_t* data, nframes_t nframes);
 	
 	int prepare_export();
 	int finish_export();
@@ -82,9 +88,35 @@ private:
 	float*		m_leftoverF{};
 	float*		m_dataF2{};
 	void*           m_output_data{};
+
+	// Compressed recordings are encoded by a thread pool, DiskIO only
+	// queues the recorded frames, see queue_encode()
+	class EncodeJob;
+	friend class EncodeJob;
+
+	struct EncodeBlock {
+		QVector<audio_sample_t>	data;
+		nframes_t		nframes;
+		bool			spilled;
+	};
+
+	bool			m_encodeInPool{};
+	QMutex			m_encodeMutex;
+	QQueue<EncodeBlock*>	m_encodeQueue;
+	QList<EncodeBlock*>	m_freeEncodeBlocks;
+	nframes_t		m_queuedFrames{};
+	nframes_t		m_maxQueuedFrames{};
+	bool			m_encodeScheduled{};
+	bool			m_encodeFinishing{};
+	bool			m_encodeFailed{};
+	QFile			m_spillFile;
+	QFile			m_spillReader;
 	
 	
 	void prepare_rt_buffers();
+	void queue_encode(const audio_sample_t* interleaved, nframes_t nframes);
+	void finish_encode();
+	void encode_queued();
 	
 signals:
 	void exportFinished();
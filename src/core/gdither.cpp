@@ -45,8 +45,15 @@
 #endif
 
 #include <sys/types.h>
+#include <climits>
+#include <cstring>
 #include "defines.h"
 
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (USE_XMMINTRIN) && defined (__SSE2__)
+#define GDITHER_SSE2 1
+#include <emmintrin.h>
+#endif
+
 /* Lipshitz's minimally audible FIR, only really works for 46kHz-ish signals */
 static const float shaped_bs[] = { 2.033f, -2.165f, 1.959f, -1.590f, 0.6149f };
 
@@ -73,6 +80,7 @@ GDither gdither_new(GDitherType type, uint32_t channels,
     s->type = type;
     s->channels = channels;
     s->bit_depth = (int)bit_depth;
+    s->rnd = GDITHER_RND_SEED;
 
     if (dither_depth <= 0 || dither_depth > (int)bit_depth) {
 	dither_depth = (int)bit_depth;
@@ -153,6 +161,7 @@ void gdither_free(GDither s)
     if (s) {
 	free(s->tri_state);
 	free(s->shaped_state);
+	free(s->noise);
 	free(s);
     }
 }
@@ -163,7 +172,8 @@ inline static void gdither_innner_loop(const GDitherType dt,
     const uint32_t post_scale, const int bit_depth,
     const uint32_t channel, const uint32_t length, float *ts,
 
-    GDitherShapedState *ss, float *x, void *y, const int clamp_u,
+    GDitherShapedState *ss, uint32_t *rnd, float *x, void *y,
+    const int clamp_u,
 
     const int clamp_l)
 {
@@ -239,7 +249,8 @@ inline static void gdither_innner_loop_fp(const GDitherType dt,
     const float post_scale, const int bit_depth,
     const uint32_t channel, const uint32_t length, float *ts,
 
-    GDitherShapedState *ss, float *x, void *y, const int clamp_u,
+    GDitherShapedState *ss, uint32_t *rnd, float *x, void *y,
+    const int clamp_u,
 
     const int clamp_l)
 {
@@ -386,83 +397,459 @@ void gdither_runf(GDither s, uint32_t channel, uint32_t length,
 	switch (s->type) {
 	case GDitherNone:
 	    gdither_innner_loop(GDitherNone, s->channels, 128.0f, SCALE_U8,
-				1, 8, channel, length, NULL, NULL, x, y,
+				1, 8, channel, length, NULL, NULL, &s->rnd, x, y,
 				MAX_U8, MIN_U8);
 	    break;
 	case GDitherRect:
 	    gdither_innner_loop(GDitherRect, s->channels, 128.0f, SCALE_U8,
-				1, 8, channel, length, NULL, NULL, x, y,
+				1, 8, channel, length, NULL, NULL, &s->rnd, x, y,
 				MAX_U8, MIN_U8);
 	    break;
 	case GDitherTri:
 	    gdither_innner_loop(GDitherTri, s->channels, 128.0f, SCALE_U8,
 				1, 8, channel, length, s->tri_state,
-				NULL, x, y, MAX_U8, MIN_U8);
+				NULL, &s->rnd, x, y, MAX_U8, MIN_U8);
 	    break;
 	case GDitherShaped:
 	    gdither_innner_loop(GDitherShaped, s->channels, 128.0f, SCALE_U8,
 			        1, 8, channel, length, NULL,
-				ss, x, y, MAX_U8, MIN_U8);
+				ss, &s->rnd, x, y, MAX_U8, MIN_U8);
 	    break;
 	}
     } else if (s->bit_depth  == 16 &&  s->dither_depth == 16) {
 	switch (s->type) {
 	case GDitherNone:
 	    gdither_innner_loop(GDitherNone, s->channels, 0.0f, SCALE_S16,
-				1, 16, channel, length, NULL, NULL, x, y,
+				1, 16, channel, length, NULL, NULL, &s->rnd, x, y,
 				MAX_S16, MIN_S16);
 	    break;
 	case GDitherRect:
 	    gdither_innner_loop(GDitherRect, s->channels, 0.0f, SCALE_S16,
-				1, 16, channel, length, NULL, NULL, x, y,
+				1, 16, channel, length, NULL, NULL, &s->rnd, x, y,
 				MAX_S16, MIN_S16);
 	    break;
 	case GDitherTri:
 	    gdither_innner_loop(GDitherTri, s->channels, 0.0f, SCALE_S16,
 				1, 16, channel, length, s->tri_state,
-				NULL, x, y, MAX_S16, MIN_S16);
+				NULL, &s->rnd, x, y, MAX_S16, MIN_S16);
 	    break;
 	case GDitherShaped:
 	    gdither_innner_loop(GDitherShaped, s->channels, 0.0f,
 				SCALE_S16, 1, 16, channel, length, NULL,
-				ss, x, y, MAX_S16, MIN_S16);
+				ss, &s->rnd, x, y, MAX_S16, MIN_S16);
 	    break;
 	}
     } else if (s->bit_depth == 32 && s->dither_depth == 24) {
 	switch (s->type) {
 	case GDitherNone:
 	    gdither_innner_loop(GDitherNone, s->channels, 0.0f, SCALE_S24,
-				256, 32, channel, length, NULL, NULL, x,
+				256, 32, channel, length, NULL, NULL, &s->rnd, x,
 				y, MAX_S24, MIN_S24);
 	    break;
 	case GDitherRect:
 	    gdither_innner_loop(GDitherRect, s->channels, 0.0f, SCALE_S24,
-				256, 32, channel, length, NULL, NULL, x,
+				256, 32, channel, length, NULL, NULL, &s->rnd, x,
 				y, MAX_S24, MIN_S24);
 	    break;
 	case GDitherTri:
 	    gdither_innner_loop(GDitherTri, s->channels, 0.0f, SCALE_S24,
 				256, 32, channel, length, s->tri_state,
-				NULL, x, y, MAX_S24, MIN_S24);
+				NULL, &s->rnd, x, y, MAX_S24, MIN_S24);
 	    break;
 	case GDitherShaped:
 	    gdither_innner_loop(GDitherShaped, s->channels, 0.0f, SCALE_S24,
 				256, 32, channel, length,
-				NULL, ss, x, y, MAX_S24, MIN_S24);
+				NULL, ss, &s->rnd, x, y, MAX_S24, MIN_S24);
 	    break;
 	}
     } else if (s->bit_depth == GDitherFloat || s->bit_depth == GDitherDouble) {
 	gdither_innner_loop_fp(s->type, s->channels, s->bias, s->scale,
 			    s->post_scale_fp, s->bit_depth, channel, length,
-			    s->tri_state, ss, x, y, s->clamp_u, s->clamp_l);
+			    s->tri_state, ss, &s->rnd, x, y, s->clamp_u, s->clamp_l);
     } else {
 	/* no special case handling, just process it from the struct */
 
 	gdither_innner_loop(s->type, s->channels, s->bias, s->scale,
 			    s->post_scale, s->bit_depth, channel,
-			    length, s->tri_state, ss, x, y, s->clamp_u,
+			    length, s->tri_state, ss, &s->rnd, x, y, s->clamp_u,
 			    s->clamp_l);
     }
 }
 
+void gdither_runf_interleaved_ref(GDither s, uint32_t length, float *x,
+				   void *y)
+{
+    uint32_t chn;
+
+    if (!s) {
+	return;
+    }
+
+    for (chn = 0; chn < s->channels; chn++) {
+	gdither_runf(s, chn, length, x, y);
+    }
+}
+
+#if defined (GDITHER_SSE2)
+
+/* Four steps of the noise generator at once, a^4 and c * (1 + a + a^2 + a^3)
+ * (mod 2^32) of GDITHER_RND_MUL (a) and GDITHER_RND_ADD (c) */
+#define GDITHER_RND_MUL4 2007447089u
+#define GDITHER_RND_ADD4 4143921812u
+
+/* SSE2 has no 32 bit multiply which keeps the low half */
+static inline __m128i gdither_mullo_epi32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			      _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* Both 16 bit halves convert exactly, so the sum is rounded only once, just
+ * like the unsigned to float conversion in gdither_noise() */
+static inline __m128 gdither_noise_to_float(__m128i r)
+{
+    __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r, 16)),
+			   _mm_set1_ps(65536.0f));
+    __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(r, _mm_set1_epi32(0xffff)));
+
+    return _mm_mul_ps(_mm_add_ps(hi, lo), _mm_set1_ps(2.3283064365387e-10f));
+}
+
+/* Writes the next count values of gdither_noise() to dst */
+static void gdither_noise_fill(uint32_t *rnd, float *dst, uint32_t count)
+{
+    uint32_t i = 0;
+
+    if (count >= 4) {
+	uint32_t r0 = *rnd * GDITHER_RND_MUL + GDITHER_RND_ADD;
+	uint32_t r1 = r0 * GDITHER_RND_MUL + GDITHER_RND_ADD;
+	uint32_t r2 = r1 * GDITHER_RND_MUL + GDITHER_RND_ADD;
+	uint32_t r3 = r2 * GDITHER_RND_MUL + GDITHER_RND_ADD;
+	const __m128i mul = _mm_set1_epi32((int)GDITHER_RND_MUL4);
+	const __m128i add = _mm_set1_epi32((int)GDITHER_RND_ADD4);
+	__m128i state = _mm_setr_epi32((int)r0, (int)r1, (int)r2, (int)r3);
+	__m128i last = state;
+
+	for (; i + 4 <= count; i += 4) {
+	    _mm_storeu_ps(dst + i, gdither_noise_to_float(state));
+	    last = state;
+	    state = _mm_add_epi32(gdither_mullo_epi32(state, mul), add);
+	}
+
+	*rnd = (uint32_t)_mm_cvtsi128_si32(
+			_mm_shuffle_epi32(last, _MM_SHUFFLE(3, 3, 3, 3)));
+    }
+
+    for (; i < count; i++) {
+	dst[i] = gdither_noise(rnd);
+    }
+}
+
+/* (float)lrintf() of each lane, including the LONG_MIN it returns for NaN
+ * and for values outside the range of a long */
+static inline __m128 gdither_rint_ps(__m128 tmp)
+{
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 exact = _mm_set1_ps(8388608.0f);
+    const __m128 long_min = _mm_set1_ps((float)LONG_MIN);
+    __m128 small, r, invalid;
+
+    /* from 2^23 on every float is an integer already */
+    small = _mm_cmplt_ps(_mm_and_ps(tmp, abs_mask), exact);
+    r = _mm_or_ps(_mm_and_ps(small, _mm_cvtepi32_ps(_mm_cvtps_epi32(tmp))),
+		  _mm_andnot_ps(small, tmp));
+
+    invalid = _mm_or_ps(_mm_cmpnlt_ps(tmp, _mm_sub_ps(_mm_setzero_ps(), long_min)),
+			_mm_cmplt_ps(tmp, long_min));
+
+    return _mm_or_ps(_mm_andnot_ps(invalid, r), _mm_and_ps(invalid, long_min));
+}
+
+/* Rounds like lrintf(), clamps and applies the post scale */
+static inline __m128i gdither_quantise(__m128 tmp, const __m128 lo,
+				       const __m128 hi, const int shift)
+{
+    __m128i q = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(gdither_rint_ps(tmp), lo), hi));
+
+    return shift ? _mm_slli_epi32(q, 8) : q;
+}
+
+static inline void gdither_store(__m128i q, const int bit_depth, void *y,
+				 uint32_t i, uint32_t count)
+{
+    int16_t o16[4];
+    int32_t o32[4];
+
+    if (bit_depth == GDither16bit) {
+	__m128i packed = _mm_packs_epi32(q, q);
+	if (count == 4) {
+	    _mm_storel_epi64((__m128i*)((int16_t*)y + i), packed);
+	} else {
+	    _mm_storel_epi64((__m128i*)o16, packed);
+	    memcpy((int16_t*)y + i, o16, count * sizeof(int16_t));
+	}
+    } else {
+	if (count == 4) {
+	    _mm_storeu_si128((__m128i*)((int32_t*)y + i), q);
+	} else {
+	    _mm_storeu_si128((__m128i*)o32, q);
+	    memcpy((int32_t*)y + i, o32, count * sizeof(int32_t));
+	}
+    }
+}
+
+/* Loads count (1 - 4) floats, the other lanes are zero */
+static inline __m128 gdither_load(const float *x, uint32_t count)
+{
+    float in[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    if (count == 4) {
+	return _mm_loadu_ps(x);
+    }
+    if (count == 2) {
+	return _mm_castpd_ps(_mm_load_sd((const double*)x));
+    }
+    memcpy(in, x, count * sizeof(float));
+
+    return _mm_loadu_ps(in);
+}
+
+/* None, rectangular and triangular dither of the whole interleaved block.
+ * noise holds the rectangular noise in frame order, for triangular dither
+ * it holds the previous frame's noise followed by the noise of this block */
+inline static void gdither_sse2_loop(const GDitherType dt, const float scale,
+    const int bit_depth, const int shift, const uint32_t channels,
+    const uint32_t total, const float *noise, float *x, void *y,
+    const int clamp_u, const int clamp_l)
+{
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 lo = _mm_set1_ps((float)clamp_l);
+    const __m128 hi = _mm_set1_ps((float)clamp_u);
+    uint32_t i, count;
+
+    for (i = 0; i < total; i += 4) {
+	count = total - i < 4 ? total - i : 4;
+
+	__m128 tmp = _mm_mul_ps(gdither_load(x + i, count), vscale);
+
+	switch (dt) {
+	case GDitherRect:
+	    tmp = _mm_sub_ps(tmp, gdither_load(noise + i, count));
+	    break;
+	case GDitherTri:
+	    tmp = _mm_sub_ps(tmp, _mm_sub_ps(
+		    gdither_load(noise + channels + i, count),
+		    gdither_load(noise + i, count)));
+	    break;
+	default:
+	    break;
+	}
+
+	gdither_store(gdither_quantise(tmp, lo, hi, shift), bit_depth, y, i,
+		      count);
+    }
+}
+
+/* Noise shaped dither, one frame at a time with a channel in each lane. The
+ * FIR is summed in the same order as gdither_innner_loop() does */
+inline static void gdither_sse2_shaped_loop(const float scale,
+    const int bit_depth, const int shift, const uint32_t channels,
+    const uint32_t length, GDitherShapedState *ss, const float *noise,
+    float *x, void *y, const int clamp_u, const int clamp_l)
+{
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 lo = _mm_set1_ps((float)clamp_l);
+    const __m128 hi = _mm_set1_ps((float)clamp_u);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 b0 = _mm_set1_ps(shaped_bs[0]);
+    const __m128 b1 = _mm_set1_ps(shaped_bs[1]);
+    const __m128 b2 = _mm_set1_ps(shaped_bs[2]);
+    const __m128 b3 = _mm_set1_ps(shaped_bs[3]);
+    const __m128 b4 = _mm_set1_ps(shaped_bs[4]);
+    __m128 buffer[GDITHER_SH_BUF_SIZE];
+    float lanes[4];
+    uint32_t phase = ss[0].phase;
+    uint32_t pos, chn, k, i;
+
+    for (k = 0; k < GDITHER_SH_BUF_SIZE; k++) {
+	for (chn = 0; chn < 4; chn++) {
+	    lanes[chn] = chn < channels ? ss[chn].buffer[k] : 0.0f;
+	}
+	buffer[k] = _mm_loadu_ps(lanes);
+    }
+
+    for (pos = 0, i = 0; pos < length; pos++, i += channels) {
+	__m128 tmp = _mm_mul_ps(gdither_load(x + i, channels), vscale);
+	__m128 ideal = tmp;
+
+	buffer[phase] = _mm_mul_ps(gdither_load(noise + i, channels), half);
+	__m128 fir = _mm_mul_ps(buffer[phase], b0);
+	fir = _mm_add_ps(fir, _mm_mul_ps(
+		buffer[(phase - 1) & GDITHER_SH_BUF_MASK], b1));
+	fir = _mm_add_ps(fir, _mm_mul_ps(
+		buffer[(phase - 2) & GDITHER_SH_BUF_MASK], b2));
+	fir = _mm_add_ps(fir, _mm_mul_ps(
+		buffer[(phase - 3) & GDITHER_SH_BUF_MASK], b3));
+	fir = _mm_add_ps(fir, _mm_mul_ps(
+		buffer[(phase - 4) & GDITHER_SH_BUF_MASK], b4));
+	tmp = _mm_add_ps(tmp, fir);
+
+	phase = (phase + 1) & GDITHER_SH_BUF_MASK;
+	buffer[phase] = _mm_sub_ps(gdither_rint_ps(tmp), ideal);
+
+	gdither_store(gdither_quantise(tmp, lo, hi, shift), bit_depth, y, i,
+		      channels);
+    }
+
+    for (k = 0; k < GDITHER_SH_BUF_SIZE; k++) {
+	_mm_storeu_ps(lanes, buffer[k]);
+	for (chn = 0; chn < channels; chn++) {
+	    ss[chn].buffer[k] = lanes[chn];
+	}
+    }
+    for (chn = 0; chn < channels; chn++) {
+	ss[chn].phase = phase;
+    }
+}
+
+static int gdither_reserve_noise(GDither s, uint32_t size)
+{
+    float *noise;
+
+    if (s->noise_size >= size) {
+	return 0;
+    }
+
+    noise = (float*) realloc(s->noise, size * sizeof(float));
+    if (!noise) {
+	return -1;
+    }
+
+    s->noise = noise;
+    s->noise_size = size;
+
+    return 0;
+}
+
+/* Returns 0 if the format isn't handled here */
+static int gdither_sse2_runf_interleaved(GDither s, uint32_t length, float *x,
+					 void *y)
+{
+    const uint32_t channels = s->channels;
+    const uint32_t total = length * channels;
+    float *noise = NULL;
+    float scale;
+    int clamp_u, clamp_l, shift;
+    uint32_t chn, pos;
+
+    if (s->bit_depth == 16 && s->dither_depth == 16) {
+	scale = SCALE_S16;
+	clamp_u = MAX_S16;
+	clamp_l = MIN_S16;
+	shift = 0;
+    } else if (s->bit_depth == 32 && s->dither_depth == 24) {
+	scale = SCALE_S24;
+	clamp_u = MAX_S24;
+	clamp_l = MIN_S24;
+	shift = 8;
+    } else {
+	return 0;
+    }
+
+    if (s->type == GDitherShaped) {
+	if (channels > 4) {
+	    return 0;
+	}
+	for (chn = 1; chn < channels; chn++) {
+	    if (s->shaped_state[chn].phase != s->shaped_state[0].phase) {
+		return 0;
+	    }
+	}
+    }
+
+    if (s->type != GDitherNone) {
+	/* the noise is generated in the order gdither_runf() consumes it,
+	 * channel after channel, and then reordered to frames */
+	if (gdither_reserve_noise(s, 2 * total + channels) < 0) {
+	    return 0;
+	}
+
+	gdither_noise_fill(&s->rnd, s->noise, total);
+	noise = s->noise + total;
+
+	if (s->type == GDitherTri) {
+	    for (chn = 0; chn < channels; chn++) {
+		noise[chn] = s->tri_state[chn];
+	    }
+	    noise += channels;
+	}
+
+	for (chn = 0; chn < channels; chn++) {
+	    const float *src = s->noise + chn * length;
+	    for (pos = 0; pos < length; pos++) {
+		noise[pos * channels + chn] = src[pos];
+	    }
+	}
+
+	if (s->type == GDitherTri) {
+	    const __m128 half = _mm_set1_ps(0.5f);
+	    for (pos = 0; pos + 4 <= total; pos += 4) {
+		_mm_storeu_ps(noise + pos,
+			      _mm_sub_ps(_mm_loadu_ps(noise + pos), half));
+	    }
+	    for (; pos < total; pos++) {
+		noise[pos] -= 0.5f;
+	    }
+	    if (length) {
+		for (chn = 0; chn < channels; chn++) {
+		    s->tri_state[chn] = noise[total - channels + chn];
+		}
+	    }
+	    noise -= channels;
+	}
+    }
+
+    switch (s->type) {
+    case GDitherNone:
+	gdither_sse2_loop(GDitherNone, scale, s->bit_depth, shift, channels,
+			  total, NULL, x, y, clamp_u, clamp_l);
+	break;
+    case GDitherRect:
+	gdither_sse2_loop(GDitherRect, scale, s->bit_depth, shift, channels,
+			  total, noise, x, y, clamp_u, clamp_l);
+	break;
+    case GDitherTri:
+	gdither_sse2_loop(GDitherTri, scale, s->bit_depth, shift, channels,
+			  total, noise, x, y, clamp_u, clamp_l);
+	break;
+    case GDitherShaped:
+	gdither_sse2_shaped_loop(scale, s->bit_depth, shift, channels, length,
+				 s->shaped_state, noise, x, y, clamp_u,
+				 clamp_l);
+	break;
+    }
+
+    return 1;
+}
+
+#endif
+
+void gdither_runf_interleaved(GDither s, uint32_t length, float *x, void *y)
+{
+    if (!s) {
+	return;
+    }
+
+#if defined (GDITHER_SSE2)
+    if (gdither_sse2_runf_interleaved(s, length, x, y)) {
+	return;
+    }
+#endif
+
+    gdither_runf_interleaved_ref(s, length, x, y);
+}
+
 /* vi:set ts=8 sts=4 sw=4: */
@@ -82,6 +82,18 @@ void gdither_free(GDither s);
 void gdither_runf(GDither s, uint32_t channel, uint32_t length,
 		   float *x, void *y);
 
+/* Applies dithering to all channels of the supplied interleaved signal.
+ *
+ * length is the number of frames in x. The output is identical to calling
+ * gdither_runf() for channel 0 up to channels-1 in turn, the common 16 and
+ * 24 bit cases are processed with SSE2 when available.
+ */
+void gdither_runf_interleaved(GDither s, uint32_t length, float *x, void *y);
+
+/* The plain C version of gdither_runf_interleaved(), for reference */
+void gdither_runf_interleaved_ref(GDither s, uint32_t length, float *x,
+				   void *y);
+
 /* see gdither_runf, but input argument is double format */
 void gdither_run(GDither s, uint32_t channel, uint32_t length,
 		   double *x, void *y);
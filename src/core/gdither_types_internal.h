@@ -66,6 +66,13 @@ typedef struct GDither_s {
     int   clamp_l;
     float *tri_state;
     GDitherShapedState *shaped_state;
+
+    /* state of the noise generator, see noise.h */
+    uint32_t rnd;
+
+    /* scratch space of gdither_runf_interleaved() */
+    float *noise;
+    uint32_t noise_size;
 } *GDither;
 
 #ifdef __cplusplus
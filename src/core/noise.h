@@ -3,17 +3,24 @@
 
 /* Can be overrriden with any code that produces whitenoise between 0.0f and
  * 1.0f, eg (random() / (float)RAND_MAX) should be a good source of noise, but
- * its expensive */
+ * its expensive. The default generator advances rnd, the generator state of
+ * the GDither instance in use. */
 #ifndef GDITHER_NOISE
-#define GDITHER_NOISE gdither_noise()
+#define GDITHER_NOISE gdither_noise(rnd)
 #endif
 
-inline static float gdither_noise()
+/* Every GDither instance starts its own sequence, so the encoders of
+ * different threads don't share state, see gdither_noise_fill() */
+#define GDITHER_RND_SEED 23232323u
+
+#define GDITHER_RND_MUL 196314165u
+#define GDITHER_RND_ADD 907633515u
+
+inline static float gdither_noise(uint32_t *rnd)
 {
-    static uint32_t rnd = 23232323;
-    rnd = (rnd * 196314165) + 907633515;
+    *rnd = (*rnd * GDITHER_RND_MUL) + GDITHER_RND_ADD;
 
-    return rnd * 2.3283064365387e-10f;
+    return *rnd * 2.3283064365387e-10f;
 }
 
 #endif
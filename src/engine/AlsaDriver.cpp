@@ -1435,6 +1435,16 @@ int AlsaDriver::bufsize(nframes_t nframes)
     return reset_parameters (nframes, user_nperiods,frame_rate);
 }
 
+// The stream has to be stopped, start() restarts it with the new period size
+int AlsaDriver::set_period_size(nframes_t nframes)
+{
+    if (bufsize(nframes) < 0) {
+        return -1;
+    }
+
+    return TAudioDriver::set_period_size(frames_per_cycle);
+}
+
 int AlsaDriver::_read(nframes_t nframes)
 {
     snd_pcm_uframes_t contiguous;
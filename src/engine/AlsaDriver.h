@@ -59,6 +59,7 @@ public:
 	int attach();
 	int detach();
 	int bufsize(nframes_t nframes);
+	int set_period_size(nframes_t nframes);
 	int restart();
 	int setup(bool capture=true, bool playback=true, const QString& pcmName="hw:0", const QString& dither="None");
         bool supports_software_channels() {return false;}
@@ -160,8 +160,13 @@ AudioDevice::AudioDevice()
     m_rate = 0;
     m_bitdepth = 0;
     m_xrunCount = 0;
+    m_pendingBufferSize = 0;
+    m_bufferSwitchState = SWITCH_IDLE;
+    m_bufferSwitchCycles = 0;
+    m_bufferSwitchPeriods = 0;
     m_cpuTime = new RingBufferNPT<trav_time_t>(4096);
     m_cycleStartTime = {};
+    m_cycleCount = 0;
     m_lastCpuReadTime = {};
 
     m_driverType = tr("No Driver Loaded");
@@ -270,6 +275,9 @@ int AudioDevice::run_cycle( nframes_t nframes, float delayed_usecs )
 
     post_run_cycle();
 
+    // Lets other threads find out that a complete cycle has finished
+    m_cycleCount++;
+
     return 1;
 }
 
@@ -285,6 +293,10 @@ int AudioDevice::run_one_cycle( nframes_t nframes, float  )
         client->process(nframes);
     }
 
+    if (m_pendingBufferSize || m_bufferSwitchState != SWITCH_IDLE) {
+        process_buffer_size_switch(nframes);
+    }
+
     if (m_driver->write(nframes) < 0) {
         qDebug("driver write failed!");
         return -1;
@@ -298,6 +310,140 @@ void AudioDevice::delay( float  )
 {
 }
 
+static void apply_gain_ramp(audio_sample_t* buffer, nframes_t nframes, float from, float to)
+{
+    float step = (to - from) / nframes;
+    for (nframes_t i = 0; i < nframes; ++i) {
+        buffer[i] *= from + step * i;
+    }
+}
+
+// Runs in the audio thread after the clients processed the cycle. The output is
+// faded out, followed by silence until the audio still queued in the hardware
+// buffer has been played, so the switch in switch_buffer_size() doesn't cut off
+// any audio. The first cycle at the new buffer size is faded in again.
+void AudioDevice::process_buffer_size_switch(nframes_t nframes)
+{
+    QList<AudioChannel*> channels = m_driver->get_playback_channels();
+
+    switch (m_bufferSwitchState) {
+    case SWITCH_IDLE:
+        foreach(AudioChannel* chan, channels) {
+            apply_gain_ramp(chan->get_buffer(nframes), nframes, 1.0f, 0.0f);
+        }
+        m_bufferSwitchCycles = m_bufferSwitchPeriods;
+        m_bufferSwitchState = SWITCH_SILENCE;
+        break;
+    case SWITCH_SILENCE:
+        foreach(AudioChannel* chan, channels) {
+            chan->silence_buffer(nframes);
+        }
+        if (--m_bufferSwitchCycles <= 0) {
+            m_bufferSwitchState = SWITCH_READY;
+        }
+        break;
+    case SWITCH_FADE_IN:
+        foreach(AudioChannel* chan, channels) {
+            apply_gain_ramp(chan->get_buffer(nframes), nframes, 0.0f, 1.0f);
+        }
+        m_bufferSwitchState = SWITCH_IDLE;
+        break;
+    default:
+        foreach(AudioChannel* chan, channels) {
+            chan->silence_buffer(nframes);
+        }
+    }
+}
+
+// Called by the AudioDeviceThread in between 2 cycles once the output has been
+// silenced. If the driver doesn't accept the new size, the old one is restored.
+int AudioDevice::switch_buffer_size()
+{
+    nframes_t size = nframes_t(m_pendingBufferSize);
+    m_pendingBufferSize = 0;
+
+    m_driver->stop();
+
+    if (m_driver->set_period_size(size) < 0) {
+        printf("AudioDevice: Could not change the buffer size to %d, keeping %d\n", size, m_bufferSize);
+        m_setup.bufferSize = m_bufferSize;
+        if (m_driver->set_period_size(m_bufferSize) < 0) {
+            return -1;
+        }
+    }
+
+    emit bufferSizeChanged();
+
+    m_bufferSwitchState = SWITCH_FADE_IN;
+
+    return m_driver->start();
+}
+
+/**
+ * Changes the period buffer size of the running driver, without re-creating
+ * the driver, its AudioChannels and the AudioBuses like set_parameters() does.
+ *
+ * For ALSA and the Null Driver, the audio thread fades out the output, restarts
+ * the driver with the new buffer size, emits bufferSizeChanged() and fades in again.
+ * With Jack, the buffer size of the jack server is changed, other drivers
+ * are re-initialized by set_parameters().
+ *
+ * @param size The new period buffer size
+ * @return 1 on success, -1 on failure
+ */
+int AudioDevice::change_buffer_size(nframes_t size)
+{
+    PENTER;
+
+    if (!m_driver || size == 0) {
+        return -1;
+    }
+
+    if (size == m_bufferSize && !m_pendingBufferSize) {
+        return 1;
+    }
+
+    m_setup.bufferSize = size;
+
+    if ((m_driverType == "ALSA") || (m_driverType == "Null Driver")) {
+        if (!m_runAudioThread) {
+            return -1;
+        }
+        // The Null Driver has no hardware buffer to drain
+        m_bufferSwitchPeriods = (m_driverType == "ALSA") ? get_driver_property("numberofperiods", 3).toInt() : 1;
+        m_pendingBufferSize = size;
+        return 1;
+    }
+
+#if defined (JACK_SUPPORT)
+    if (libjack_is_present) {
+        JackDriver* jackdriver = qobject_cast<JackDriver*>(m_driver);
+        if (jackdriver) {
+            // The jack buffer size callback updates our buffer size
+            return (jack_set_buffer_size(jackdriver->get_client(), size) == 0) ? 1 : -1;
+        }
+    }
+#endif
+
+    set_parameters(m_setup);
+
+    return 1;
+}
+
+
+/**
+ * Makes set_parameters() use \a driverType, whatever driver type the
+ * AudioDeviceSetup asks for. Used to run without audio hardware, e.g.
+ * with the Null Driver when rendering from the command line.
+ *
+ * @param driverType The driver to use from now on, an empty string
+ *	restores the driver selection by set_parameters()
+ */
+void AudioDevice::force_driver_type(const QString& driverType)
+{
+    m_forcedDriverType = driverType;
+}
+
 
 /**
  * This function is used to initialize the AudioDevice's audioThread with the supplied
@@ -312,6 +458,10 @@ void AudioDevice::set_parameters(AudioDeviceSetup ads)
 {
     PENTER;
 
+    if (!m_forcedDriverType.isEmpty()) {
+        ads.driverType = m_forcedDriverType;
+    }
+
     m_rate = ads.rate;
     m_bufferSize = ads.bufferSize;
     m_xrunCount = 0;
@@ -322,6 +472,9 @@ void AudioDevice::set_parameters(AudioDeviceSetup ads)
 
     shutdown();
 
+    m_pendingBufferSize = 0;
+    m_bufferSwitchState = SWITCH_IDLE;
+
     if (create_driver(ads.driverType, ads.capture, ads.playback, ads.cardDevice) < 0) {
         set_parameters(m_fallBackSetup);
         return;
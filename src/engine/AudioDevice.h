@@ -66,6 +66,8 @@ public:
         };
 
         void set_parameters(AudioDeviceSetup ads);
+        void force_driver_type(const QString& driverType);
+        int change_buffer_size(nframes_t size);
 
         void add_client(TAudioDeviceClient* client);
         void remove_client(TAudioDeviceClient* client);
@@ -123,6 +125,10 @@ public:
 	
     float get_cpu_time();
 
+	size_t run_audio_thread() const;
+	// Incremented by the audio thread after each cycle
+	size_t get_cycle_count() const {return m_cycleCount;}
+
 
 private:
 	AudioDevice();
@@ -160,6 +166,7 @@ private:
 
 	RingBufferNPT<trav_time_t>*	m_cpuTime;
 	volatile size_t		m_runAudioThread;
+	volatile size_t		m_cycleCount;
 	trav_time_t		m_cycleStartTime;
 	trav_time_t		m_lastCpuReadTime;
 	uint 			m_bufferSize;
@@ -167,14 +174,29 @@ private:
 	uint			m_bitdepth;
 	uint			m_xrunCount;
 	QString			m_driverType;
+	QString			m_forcedDriverType;
 	QString			m_ditherShape;
 	QHash<QString, QVariant> m_driverProperties;
 
+	enum {
+		SWITCH_IDLE,
+		SWITCH_SILENCE,
+		SWITCH_READY,
+		SWITCH_FADE_IN
+	};
+
+	volatile size_t		m_pendingBufferSize;
+	int			m_bufferSwitchState;
+	int			m_bufferSwitchCycles;
+	int			m_bufferSwitchPeriods;
+
 	int run_one_cycle(nframes_t nframes, float delayed_usecs);
 	int create_driver(const QString& driverType, bool capture, bool playback, const QString& cardDevice);
 	int transport_control(transport_state_t state);
 
     void post_run_cycle();
+	void process_buffer_size_switch(nframes_t nframes);
+	int switch_buffer_size();
 
 	// These are reserved for Driver Objects only!!
 	AudioChannel* register_capture_channel(const QByteArray& busName, const QString& audioType, int flags, uint bufferSize, uint channel );
@@ -203,7 +225,6 @@ private:
 	void mili_sleep(int msec);
 	void xrun();
 	
-	size_t run_audio_thread() const;
 	
 	QVariant get_driver_property(const QString& property, const QVariant& defaultValue);
 
@@ -228,6 +249,14 @@ signals:
 	 *	the AudioDevice!
 	 */
 	void driverParamsChanged();
+
+	/**
+	 *      The bufferSizeChanged() signal is emited from within the audio thread when
+	 *	change_buffer_size() switched the period buffer size of the running driver.
+	 *	The AudioChannels and AudioBuses are kept, connect with a Qt::DirectConnection
+	 *	to resize the buffers depending on the buffer size before the next cycle is run.
+	 */
+	void bufferSizeChanged();
 	
 	/**
 	 *        Connect this signal to any Object who need to be informed about buffer under/overruns
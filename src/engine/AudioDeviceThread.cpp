@@ -107,6 +107,12 @@ void AudioDeviceThread::run()
 			PERROR("Driver cycle error, exiting!");
 			break;
 		}
+		if (m_device->m_bufferSwitchState == AudioDevice::SWITCH_READY) {
+			if (m_device->switch_buffer_size() < 0) {
+				PERROR("Changing the buffer size failed, exiting!");
+				break;
+			}
+		}
 		watchdogCheck = 1;
 	}
 	
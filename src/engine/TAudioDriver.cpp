@@ -167,6 +167,27 @@ int TAudioDriver::stop( )
 	return 1;
 }
 
+/**
+ * Changes the period size of a stopped driver, keeping the AudioChannels.
+ * Reimplement to reconfigure the real audio device, and call this
+ * function afterwards to resize the AudioChannels.
+ */
+int TAudioDriver::set_period_size(nframes_t nframes)
+{
+        frames_per_cycle = nframes;
+
+        device->set_buffer_size(frames_per_cycle);
+
+        foreach(AudioChannel* chan, m_captureChannels) {
+                chan->set_latency( frames_per_cycle + capture_frame_latency );
+        }
+        foreach(AudioChannel* chan, m_playbackChannels) {
+                chan->set_latency( frames_per_cycle + capture_frame_latency );
+        }
+
+        return 1;
+}
+
 QString TAudioDriver::get_device_name( )
 {
 	return "Null Audio Device";
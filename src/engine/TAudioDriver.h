@@ -52,6 +52,7 @@ public:
         virtual int detach();
         virtual int start();
         virtual int stop();
+        virtual int set_period_size(nframes_t nframes);
         virtual bool supports_software_channels() {return true;}
         virtual QString get_device_name();
         virtual QString get_device_longname();
@@ -52,6 +52,7 @@ CorrelationMeter::CorrelationMeter()
     m_bufferreadouts = 0;
 
 	connect(&audiodevice(), SIGNAL(driverParamsChanged()), this, SLOT(calculate_fract()));
+	connect(&audiodevice(), SIGNAL(bufferSizeChanged()), this, SLOT(calculate_fract()));
 }
 
 
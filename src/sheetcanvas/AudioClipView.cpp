@@ -323,6 +323,14 @@ void AudioClipView::draw_peaks(QPainter* p, qreal xstart, int pixelcount)
             return;
         }
 
+        if (availpeaks == Peak::PEAKDATA_PENDING) {
+            // The samples are being decoded in the background, paint the
+            // -INF lines as a placeholder until they're available
+            connect(peak, SIGNAL(microViewDataAvailable()), this, SLOT(repaint()), Qt::UniqueConnection);
+            draw_micro_view_placeholder(p, xstart, pixelcount);
+            return;
+        }
+
         if (availpeaks == Peak::PERMANENT_FAILURE || availpeaks == Peak::NO_PEAKDATA_FOUND) {
             return;
         }
@@ -525,6 +533,27 @@ void AudioClipView::draw_peaks(QPainter* p, qreal xstart, int pixelcount)
     }
 }
 
+void AudioClipView::draw_micro_view_placeholder(QPainter* p, qreal xstart, int pixelcount)
+{
+    uint channels = m_mergedView ? 1 : m_clip->get_channel_count();
+    int height = m_height / channels;
+
+    p->save();
+
+    if (m_clip->is_selected()) {
+        p->setPen(themer()->get_color("AudioClip:channelseperator:selected"));
+    } else {
+        p->setPen(themer()->get_color("AudioClip:channelseperator"));
+    }
+
+    for (uint chan = 0; chan < channels; ++chan) {
+        int ytrans = (height / 2) + (chan * height);
+        p->drawLine(QPointF(xstart, ytrans), QPointF(xstart + pixelcount, ytrans));
+    }
+
+    p->restore();
+}
+
 void AudioClipView::draw_clipinfo_area(QPainter* p, double xstart)
 {
     if (xstart > m_clipInfo.width()) {
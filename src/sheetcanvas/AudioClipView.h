@@ -110,6 +110,7 @@ private:
 	void draw_clipinfo_area(QPainter* painter, double xstart);
 	void draw_db_lines(QPainter* painter, qreal xstart, int pixelcount);
 	void draw_peaks(QPainter* painter, qreal xstart, int pixelcount);
+	void draw_micro_view_placeholder(QPainter* painter, qreal xstart, int pixelcount);
 	void create_brushes();
 
 	friend class FadeCurveView;
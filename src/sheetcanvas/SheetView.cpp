@@ -35,6 +35,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-11  USA.
 #include "ContextPointer.h"
 #include "Themer.h"
 #include "AudioClipView.h"
+#include "Peak.h"
 #include "CurveView.h"
 #include "CurveNodeView.h"
 #include "MarkerView.h"
@@ -129,6 +130,11 @@ SheetView::SheetView(SheetWidget* sheetwidget,
 	scale_factor_changed();
 
 	connect(m_session, SIGNAL(hzoomChanged()), this, SLOT(scale_factor_changed()));
+	connect(&plc(), SIGNAL(levelsAvailable()), this, SLOT(peak_levels_available()));
+	connect(&m_hzoomTimer, SIGNAL(timeout()), this, SLOT(apply_pending_hzoom()));
+	// Don't let a zoom wait longer then this for the peak data to be loaded
+	m_hzoomTimer.setSingleShot(true);
+	m_hzoomTimer.setInterval(150);
 	connect(m_session, SIGNAL(tempFollowChanged(bool)), this, SLOT(set_follow_state(bool)));
 	connect(m_session, SIGNAL(trackAdded(Track*)), this, SLOT(add_new_track_view(Track*)));
 	connect(m_session, SIGNAL(trackRemoved(Track*)), this, SLOT(remove_track_view(Track*)));
@@ -174,6 +180,11 @@ void SheetView::scale_factor_changed( )
 	m_tlvp->scale_factor_changed();
 
 	update_tracks_bounding_rect();
+
+	// Prepare the neighbouring zoom levels so the next zoom step
+	// can be applied without waiting for the peak data.
+	prefetch_peak_levels(zoom * 2);
+	prefetch_peak_levels(zoom / 2);
 }
 
 AudioTrackView* SheetView::get_audio_trackview_at_scene_pos( QPointF point )
@@ -537,10 +548,88 @@ void SheetView::set_track_height(TrackView *view, int newheight)
 void SheetView::hzoom(qreal factor)
 {
 	PENTER;
-	m_session->set_hzoom(m_session->get_hzoom() * factor);
+
+	// Zoom steps arriving while the previous one is still waiting
+	// for its peak data accumulate into one zoom change.
+	if (qFuzzyIsNull(m_pendingHZoom)) {
+		m_pendingHZoom = m_session->get_hzoom();
+	}
+	m_pendingHZoom = qBound(qreal(1.0), m_pendingHZoom * factor, qreal(Peak::max_zoom_value()));
+
+	// Load the peak data for the new zoom level of all visible clips in the
+	// background, and only apply the zoom once all of them are available, so
+	// the clips repaint at once without reading peak files during painting.
+	if (prefetch_peak_levels(m_pendingHZoom)) {
+		apply_pending_hzoom();
+		return;
+	}
+
+	if (!m_hzoomTimer.isActive()) {
+		m_hzoomTimer.start();
+	}
+}
+
+void SheetView::apply_pending_hzoom()
+{
+	m_hzoomTimer.stop();
+
+	if (qFuzzyIsNull(m_pendingHZoom)) {
+		return;
+	}
+
+	qreal zoom = m_pendingHZoom;
+	m_pendingHZoom = 0;
+
+	m_session->set_hzoom(zoom);
 	center();
 }
 
+void SheetView::peak_levels_available()
+{
+	if (qFuzzyIsNull(m_pendingHZoom)) {
+		return;
+	}
+
+	if (prefetch_peak_levels(m_pendingHZoom)) {
+		apply_pending_hzoom();
+	}
+}
+
+// Schedules loading of the peak data at zoom for all clips that are visible
+// now, or will be visible after zooming out to zoom. Returns true if all
+// of it is available already.
+bool SheetView::prefetch_peak_levels(qreal zoom)
+{
+	if (zoom < 1.0) {
+		return true;
+	}
+
+	QRectF visible = m_clipsViewPort->mapToScene(m_clipsViewPort->viewport()->rect()).boundingRect();
+	qreal ratio = zoom / m_session->get_hzoom();
+
+	if (ratio > 1.0) {
+		// Zooming out brings clips left and right of the view into sight
+		qreal width = visible.width() * ratio;
+		visible.adjust(-(width - visible.width()) / 2, 0, (width - visible.width()) / 2, 0);
+	}
+
+	bool available = true;
+	QList<QGraphicsItem*> items = m_clipsViewPort->scene()->items(visible);
+
+	for (int i=0; i<items.size(); ++i) {
+		AudioClipView* view = dynamic_cast<AudioClipView*>(items.at(i));
+		if (!view) {
+			continue;
+		}
+		Peak* peak = view->get_clip()->get_peak();
+		if (peak && !peak->prefetch_zoom_level(zoom)) {
+			available = false;
+		}
+	}
+
+	return available;
+}
+
 
 void SheetView::layout_tracks()
 {
@@ -149,6 +149,8 @@ private:
     QScrollBar*         m_hScrollBar;
     bool                m_actOnPlayHead;
     bool                m_viewportReady;
+    qreal               m_pendingHZoom{};
+    QTimer              m_hzoomTimer;
 
     static QHash<QString, QString> m_cursorsDict;
 
@@ -159,6 +161,7 @@ private:
 	int	m_trackTopIndent{};
 
 	void update_tracks_bounding_rect();
+	bool prefetch_peak_levels(qreal zoom);
 
     void do_keyboard_canvas_cursor_move(const QPointF &position);
 
@@ -199,6 +202,8 @@ public slots:
 
 private slots:
 	void scale_factor_changed();
+	void apply_pending_hzoom();
+	void peak_levels_available();
 	void add_new_track_view(Track*);
 	void remove_track_view(Track*);
     void hscrollbar_value_changed(int);
@@ -0,0 +1,223 @@
+/*
+Copyright (C) 2026 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+// Checks that gdither_runf_interleaved() produces exactly the same samples
+// as gdither_runf_interleaved_ref(), and that its dither noise has the same
+// statistics as the one of the reference implementation.
+
+#include <stdint.h>
+#include "gdither.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const GDitherType types[] = { GDitherNone, GDitherRect, GDitherTri, GDitherShaped };
+static const char* typeNames[] = { "none", "rect", "tri", "shaped" };
+
+struct Format {
+	GDitherSize	size;
+	int		ditherDepth;
+	float		scale;
+};
+
+static const Format formats[] = {
+	{ GDither16bit, 16, 32768.0f },
+	{ GDither32bit, 24, 8388608.0f * 256.0f },
+};
+
+static uint32_t testRnd = 1;
+
+// Noise of our own, independent of the dither noise
+static float test_noise()
+{
+	testRnd = testRnd * 1664525u + 1013904223u;
+	return float(testRnd) * 2.3283064365387e-10f;
+}
+
+static void fill_input(std::vector<float>& x)
+{
+	for (size_t i = 0; i < x.size(); ++i) {
+		// Slightly beyond full scale, to cover the clamping too
+		x[i] = (test_noise() * 2.0f - 1.0f) * 1.05f;
+	}
+	// Values the rounding and the conversions have to agree on
+	if (x.size() > 4) {
+		x[0] = 0.0f;
+		x[1] = 1.0f;
+		x[2] = -1.0f;
+		x[3] = 0.5f / 32768.0f;
+	}
+}
+
+// Reads sample i of y as an integer
+static int64_t sample(const std::vector<char>& y, GDitherSize size, size_t i)
+{
+	if (size == GDither16bit) {
+		return reinterpret_cast<const int16_t*>(y.data())[i];
+	}
+	return reinterpret_cast<const int32_t*>(y.data())[i];
+}
+
+static int check_bit_exact()
+{
+	static const uint32_t channelCounts[] = { 1, 2, 3, 4, 6 };
+	static const uint32_t lengths[] = { 1, 3, 4, 7, 64, 1021 };
+	int failures = 0;
+
+	for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+	for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+	for (size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); ++c) {
+	for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+		const Format& format = formats[f];
+		uint32_t channels = channelCounts[c];
+		uint32_t length = lengths[l];
+		size_t bytes = (format.size == GDither16bit) ? 2 : 4;
+
+		GDither ref = gdither_new(types[t], channels, format.size, format.ditherDepth);
+		GDither fast = gdither_new(types[t], channels, format.size, format.ditherDepth);
+
+		std::vector<float> x(length * channels);
+		std::vector<char> yRef(x.size() * bytes);
+		std::vector<char> yFast(x.size() * bytes);
+
+		// Consecutive blocks, so the noise, triangular and noise shaping
+		// state have to be carried over. Both instances are run in turns,
+		// which only works out if they don't share any state.
+		for (int block = 0; block < 3; ++block) {
+			fill_input(x);
+			std::vector<float> xFast(x);
+
+			gdither_runf_interleaved_ref(ref, length, x.data(), yRef.data());
+			gdither_runf_interleaved(fast, length, xFast.data(), yFast.data());
+
+			if (memcmp(yRef.data(), yFast.data(), yRef.size()) == 0) {
+				continue;
+			}
+
+			for (size_t i = 0; i < x.size(); ++i) {
+				if (sample(yRef, format.size, i) != sample(yFast, format.size, i)) {
+					printf("FAIL: %s dither, %d bit, %u channels, %u frames, block %d: sample %zu is %lld, expected %lld\n",
+					       typeNames[t], format.ditherDepth, channels, length, block, i,
+					       (long long)sample(yFast, format.size, i), (long long)sample(yRef, format.size, i));
+					break;
+				}
+			}
+			++failures;
+			break;
+		}
+
+		gdither_free(ref);
+		gdither_free(fast);
+	}
+	}
+	}
+	}
+
+	return failures;
+}
+
+struct ErrorStats {
+	double mean;
+	double rms;
+};
+
+// The difference between the dithered output and the undithered input, in LSBs
+static ErrorStats error_stats(const std::vector<float>& x, const std::vector<char>& y, const Format& format)
+{
+	double lsb = (format.size == GDither16bit) ? 1.0 : 256.0;
+	double sum = 0.0;
+	double sumSquares = 0.0;
+
+	for (size_t i = 0; i < x.size(); ++i) {
+		double error = (double(sample(y, format.size, i)) - double(x[i]) * format.scale) / lsb;
+		sum += error;
+		sumSquares += error * error;
+	}
+
+	ErrorStats stats;
+	stats.mean = sum / x.size();
+	stats.rms = sqrt(sumSquares / x.size());
+	return stats;
+}
+
+static int check_statistics()
+{
+	const uint32_t channels = 2;
+	const uint32_t length = 65536;
+	int failures = 0;
+
+	for (size_t t = 1; t < sizeof(types) / sizeof(types[0]); ++t) {
+	for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+		const Format& format = formats[f];
+		size_t bytes = (format.size == GDither16bit) ? 2 : 4;
+
+		GDither ref = gdither_new(types[t], channels, format.size, format.ditherDepth);
+		GDither fast = gdither_new(types[t], channels, format.size, format.ditherDepth);
+
+		// A quiet sine, well within range so nothing is clamped
+		std::vector<float> x(length * channels);
+		for (uint32_t i = 0; i < length; ++i) {
+			x[i * channels] = x[i * channels + 1] = 0.001f * sinf(float(i) * 0.01f);
+		}
+		std::vector<char> yRef(x.size() * bytes);
+		std::vector<char> yFast(x.size() * bytes);
+
+		// Advance the reference generator, so both use a different
+		// stretch of noise
+		std::vector<float> warmup(x);
+		gdither_runf_interleaved_ref(ref, length, warmup.data(), yRef.data());
+
+		std::vector<float> xRef(x);
+		gdither_runf_interleaved_ref(ref, length, xRef.data(), yRef.data());
+		std::vector<float> xFast(x);
+		gdither_runf_interleaved(fast, length, xFast.data(), yFast.data());
+
+		ErrorStats refStats = error_stats(x, yRef, format);
+		ErrorStats fastStats = error_stats(x, yFast, format);
+
+		if (fabs(fastStats.mean - refStats.mean) > 0.02 || fabs(fastStats.rms / refStats.rms - 1.0) > 0.02) {
+			printf("FAIL: %s dither, %d bit: error mean %f, rms %f, expected mean %f, rms %f\n",
+			       typeNames[t], format.ditherDepth, fastStats.mean, fastStats.rms, refStats.mean, refStats.rms);
+			++failures;
+		}
+
+		gdither_free(ref);
+		gdither_free(fast);
+	}
+	}
+
+	return failures;
+}
+
+int main()
+{
+	int failures = check_bit_exact() + check_statistics();
+
+	if (failures) {
+		printf("%d gdither checks failed\n", failures);
+		return 1;
+	}
+
+	printf("All gdither checks passed\n");
+	return 0;
+}
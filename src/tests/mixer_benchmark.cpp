@@ -0,0 +1,153 @@
+/*
+Copyright (C) 2026 Remon Sijrier
+
+This file is part of Traverso
+
+Traverso is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+
+*/
+
+// Measures the throughput of the sample conversions the audio readers decode
+// through, for every source format, and checks that the SSE versions produce
+// exactly the same samples as the plain ones.
+
+#include "Mixer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const nframes_t frames = 4096;
+static const int iterations = 2000;
+
+static uint32_t testRnd = 1;
+
+static uint32_t test_random()
+{
+	testRnd = testRnd * 1664525u + 1013904223u;
+	return testRnd;
+}
+
+// The source data of all formats, 2 interleaved channels
+struct Input {
+	std::vector<float>		f32;
+	std::vector<short>		s16;
+	std::vector<unsigned char>	s24;
+	std::vector<int>		s32;
+};
+
+// Converts frames stereo frames of the source format into dst
+typedef void (*convert_t)(const Input& input, audio_sample_t** dst);
+
+static void default_f32(const Input& in, audio_sample_t** dst) { default_deinterleave(in.f32.data(), dst, frames, 2); }
+static void default_s16(const Input& in, audio_sample_t** dst) { default_convert_s16_to_float(in.s16.data(), dst[0], frames * 2); }
+static void default_s24(const Input& in, audio_sample_t** dst) { default_convert_s24_to_float(in.s24.data(), dst[0], frames * 2); }
+static void default_s32(const Input& in, audio_sample_t** dst) { default_convert_s32_to_float(in.s32.data(), dst[0], frames * 2, 1.0f / 2147483648.0f); }
+static void default_s32_stereo(const Input& in, audio_sample_t** dst) { default_deinterleave_s32_to_float(in.s32.data(), dst, frames, 2, 1.0f / 2147483648.0f); }
+
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (USE_XMMINTRIN)
+static void sse_f32(const Input& in, audio_sample_t** dst) { x86_sse_deinterleave(in.f32.data(), dst, frames, 2); }
+static void sse_s16(const Input& in, audio_sample_t** dst) { x86_sse_convert_s16_to_float(in.s16.data(), dst[0], frames * 2); }
+static void sse_s24(const Input& in, audio_sample_t** dst) { x86_sse_convert_s24_to_float(in.s24.data(), dst[0], frames * 2); }
+static void sse_s32(const Input& in, audio_sample_t** dst) { x86_sse_convert_s32_to_float(in.s32.data(), dst[0], frames * 2, 1.0f / 2147483648.0f); }
+static void sse_s32_stereo(const Input& in, audio_sample_t** dst) { x86_sse_deinterleave_s32_to_float(in.s32.data(), dst, frames, 2, 1.0f / 2147483648.0f); }
+#endif
+
+struct Format {
+	const char*	name;
+	convert_t	reference;
+	convert_t	optimized;
+};
+
+static const Format formats[] = {
+#if (defined (ARCH_X86) || defined (ARCH_X86_64)) && defined (USE_XMMINTRIN)
+	{ "float, 2 channels", default_f32, sse_f32 },
+	{ "16 bit", default_s16, sse_s16 },
+	{ "24 bit", default_s24, sse_s24 },
+	{ "32 bit", default_s32, sse_s32 },
+	{ "32 bit, 2 channels", default_s32_stereo, sse_s32_stereo },
+#else
+	{ "float, 2 channels", default_f32, nullptr },
+	{ "16 bit", default_s16, nullptr },
+	{ "24 bit", default_s24, nullptr },
+	{ "32 bit", default_s32, nullptr },
+	{ "32 bit, 2 channels", default_s32_stereo, nullptr },
+#endif
+};
+
+// Returns the throughput in million frames per second
+static double measure(convert_t convert, const Input& input, audio_sample_t** dst)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; ++i) {
+		convert(input, dst);
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return (double(frames) * iterations) / elapsed.count() / 1000000.0;
+}
+
+int main()
+{
+	Input input;
+	input.f32.resize(frames * 2);
+	input.s16.resize(frames * 2);
+	input.s24.resize(frames * 2 * 3);
+	input.s32.resize(frames * 2);
+
+	for (nframes_t i = 0; i < frames * 2; ++i) {
+		uint32_t value = test_random();
+		input.s32[i] = int(value);
+		input.s16[i] = short(value >> 16);
+		input.s24[i * 3] = (unsigned char)(value >> 8);
+		input.s24[i * 3 + 1] = (unsigned char)(value >> 16);
+		input.s24[i * 3 + 2] = (unsigned char)(value >> 24);
+		input.f32[i] = float(int(value)) / 2147483648.0f;
+	}
+
+	// Stereo conversions write one buffer per channel, the others
+	// convert all samples into the first one
+	std::vector<audio_sample_t> reference(frames * 2);
+	std::vector<audio_sample_t> optimized(frames * 2);
+	audio_sample_t* referenceBuffers[2] = { reference.data(), reference.data() + frames };
+	audio_sample_t* optimizedBuffers[2] = { optimized.data(), optimized.data() + frames };
+
+	int failures = 0;
+
+	for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+		const Format& format = formats[f];
+		double plain = measure(format.reference, input, referenceBuffers);
+
+		if (!format.optimized) {
+			printf("%-20s %8.1f Mframes/s\n", format.name, plain);
+			continue;
+		}
+
+		double sse = measure(format.optimized, input, optimizedBuffers);
+		bool exact = memcmp(reference.data(), optimized.data(), reference.size() * sizeof(audio_sample_t)) == 0;
+
+		printf("%-20s %8.1f Mframes/s, SSE %8.1f Mframes/s (%.2fx)%s\n",
+		       format.name, plain, sse, sse / plain, exact ? "" : " MISMATCH");
+
+		if (!exact) {
+			++failures;
+		}
+	}
+
+	return failures ? 1 : 0;
+}
@@ -75,6 +75,9 @@ int main( int argc, char **argv )
 	signal(SIGSEGV, catch_signal);
 #endif
 
+	QString renderProject, renderFormat = "wav", renderOut;
+	int renderSheet = 1;
+
 	TraversoDebugger::set_debug_level(TraversoDebugger::OFF);
 	if (argc > 1) {
 		for (int i=1; i<argc; i++) {
@@ -100,6 +103,10 @@ int main( int argc, char **argv )
 				printf("\t--log \t\t Create a ~/traverso.log file instead of dumping debug messages to stdout\n");
 				printf("\t--show-compile-options\t\t Print options used during compilation\n");
                                 printf("\t--fft-meter   \t\t Start Traverso as a Spectral Analyzer\n");
+				printf("\t--render FILE \t\t Export a sheet of the project.tpf FILE without user interface, then exit\n");
+				printf("\t--sheet N \t\t The sheet to export with --render, counting from 1 (default 1)\n");
+				printf("\t--format TYPE \t\t wav, aiff, flac or wavpack, for --render (default wav)\n");
+				printf("\t--out FILE \t\t The file --render writes to\n");
                                 printf("\n");
 				return 0;
 			}
@@ -113,6 +120,16 @@ int main( int argc, char **argv )
 				printf("Traverso compile options: %s\n", TRAVERSO_DEFINES);
 				return 0;
 			}
+			if (i + 1 < argc) {
+				if (strcmp(argv[i],"--render")==0)
+					renderProject = QString::fromLocal8Bit(argv[++i]);
+				else if (strcmp(argv[i],"--sheet")==0)
+					renderSheet = atoi(argv[++i]);
+				else if (strcmp(argv[i],"--format")==0)
+					renderFormat = QString::fromLocal8Bit(argv[++i]);
+				else if (strcmp(argv[i],"--out")==0)
+					renderOut = QString::fromLocal8Bit(argv[++i]);
+			}
 		}
 	}
 	PENTER;
@@ -124,6 +141,11 @@ int main( int argc, char **argv )
         // T doesn't need the glib event loop so turn it of:
 #if defined(Q_OS_UNIX)
         setenv("QT_NO_GLIB", "1", true);
+
+        // Rendering from the command line doesn't need a display
+        if (!renderProject.isEmpty()) {
+                setenv("QT_QPA_PLATFORM", "offscreen", false);
+        }
 #endif
 
 	// using the raster graphics backend is faster on my system
@@ -143,6 +165,13 @@ int main( int argc, char **argv )
 		traversoTranslator.load(userLanguage);
 	}
 	traverso->installTranslator(&traversoTranslator);
+
+        if (!renderProject.isEmpty()) {
+                int status = traverso->render(renderProject, renderSheet, renderFormat, renderOut);
+                delete traverso;
+                MEM_OFF();
+                return status;
+        }
 	
         traverso->create_interface();
 
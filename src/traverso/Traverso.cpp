@@ -23,13 +23,19 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 #include "../config.h"
 
 #include <QMessageBox>
+#include <QFile>
 #include <QFileInfo>
 #include <QDir>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
 
 #include "Traverso.h"
 #include "Mixer.h"
 #include "ProjectManager.h"
 #include "Project.h"
+#include "Sheet.h"
+#include "Export.h"
 #include "TMainWindow.h"
 #include "Themer.h"
 #include "TConfig.h"
@@ -97,6 +103,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
 
 Traverso::Traverso(int &argc, char **argv )
     : QApplication ( argc, argv )
+    , m_headless(false)
 {
     QCoreApplication::setOrganizationName("Traverso");
     QCoreApplication::setApplicationName("Traverso");
@@ -121,12 +128,30 @@ Traverso::Traverso(int &argc, char **argv )
 Traverso::~Traverso()
 {
     PENTERDES;
-    delete TMainWindow::instance();
-    delete themer();
-    config().save();
+    // Rendering from the command line creates no interface, and
+    // leaves the configuration of the user alone
+    if (!m_headless) {
+        delete TMainWindow::instance();
+        delete themer();
+        config().save();
+    }
     audiodevice().shutdown();
 }
 
+// Splits the file name of a project.tpf file into the base project
+// directory and the name of the project.
+static bool split_project_file_name(const QString& fileName, QString& baseprojectdirpath, QString& projectname)
+{
+    QFileInfo fi(fileName);
+    QDir projectdir(fi.absolutePath());
+    QDir baseprojectdir(fi.absolutePath());
+    baseprojectdir.cdUp();
+    baseprojectdirpath = baseprojectdir.path();
+    projectname = projectdir.dirName();
+
+    return (!projectname.isEmpty() && ! baseprojectdirpath.isEmpty());
+}
+
 void Traverso::create_interface( )
 {
     themer()->load();
@@ -146,21 +171,168 @@ void Traverso::create_interface( )
     // The user clicked on a project.tpf file, start extracting the
     // baseproject directory, and the project name from the filename.
     if (!projectToLoad.isEmpty()) {
-        QFileInfo fi(projectToLoad);
-        QDir projectdir(fi.path());
-        QDir baseprojectdir(fi.path());
-        baseprojectdir.cdUp();
-        QString baseprojectdirpath = baseprojectdir.path();
-        QString projectdirpath = projectdir.path();
-        QString projectname = projectdirpath.mid(baseprojectdirpath.length() + 1, projectdirpath.length());
-
-        if (!projectname.isEmpty() && ! baseprojectdirpath.isEmpty()) {
+        QString baseprojectdirpath, projectname;
+
+        if (split_project_file_name(projectToLoad, baseprojectdirpath, projectname)) {
             pm().start(baseprojectdirpath, projectname);
             return;
         }
     }
 }
 
+/**
+ * 	Exports sheet \a sheetNumber (counting from 1) of the project \a projectFile
+ *	to \a outFile in \a format (wav, aiff, flac or wavpack), without creating
+ *	the interface. Used instead of create_interface() by the --render option.
+ *
+ *	The project is loaded on the Null Driver, so no audio hardware is needed,
+ *	and is closed again without saving it.
+ *
+ * @return One of the RenderStatus values, to be used as exit status
+ */
+int Traverso::render(const QString& projectFile, int sheetNumber, const QString& format, const QString& outFile)
+{
+    m_headless = true;
+
+    connect(&info(), SIGNAL(message(InfoStruct)), this, SLOT(print_info_message(InfoStruct)));
+
+    ExportSpecification spec;
+
+    if (format == "wav" || format == "aiff") {
+        spec.writerType = "sndfile";
+        spec.extraFormat["filetype"] = format;
+    } else if (format == "flac") {
+        spec.writerType = "flac";
+    } else if (format == "wavpack") {
+        spec.writerType = "wavpack";
+        spec.extraFormat["quality"] = "high";
+        spec.extraFormat["skip_wvx"] = "true";
+    } else {
+        fprintf(stderr, "Unknown export format: %s (use wav, aiff, flac or wavpack)\n", QS_C(format));
+        return RENDER_INVALID_ARGUMENTS;
+    }
+
+    QString baseprojectdirpath, projectname;
+    QFileInfo outInfo(outFile);
+
+    if (outFile.isEmpty() || outInfo.isDir()) {
+        fprintf(stderr, "No output file given\n");
+        return RENDER_INVALID_ARGUMENTS;
+    }
+
+    if (!QFileInfo(projectFile).exists() || !split_project_file_name(projectFile, baseprojectdirpath, projectname)) {
+        fprintf(stderr, "Project file %s doesn't exist\n", QS_C(projectFile));
+        return RENDER_INVALID_ARGUMENTS;
+    }
+
+    // Don't open the audio hardware, nor ask or save anything on close,
+    // the configuration isn't written back in headless mode.
+    audiodevice().force_driver_type("Null Driver");
+    config().set_property("Project", "directory", baseprojectdirpath);
+    config().set_property("Project", "onclose", "dontsave");
+
+    if (pm().load_project(projectname) < 0) {
+        fprintf(stderr, "Unable to load project %s\n", QS_C(projectFile));
+        return RENDER_PROJECT_LOAD_FAILED;
+    }
+
+    Project* project = pm().get_project();
+    QList<Sheet*> sheets = project->get_sheets();
+
+    if (sheetNumber < 1 || sheetNumber > sheets.size()) {
+        fprintf(stderr, "Project %s has no sheet %d (it has %d)\n", QS_C(projectname), sheetNumber, sheets.size());
+        pm().exit();
+        return RENDER_NO_SUCH_SHEET;
+    }
+
+    Sheet* sheet = sheets.at(sheetNumber - 1);
+    project->set_current_session(sheet->get_id());
+
+    // The sheet decides on the file names, render into a directory of our
+    // own next to the output file and move the result in place afterwards.
+    QTemporaryDir renderDir(outInfo.absolutePath() + "/.traverso-render-XXXXXX");
+    if (!renderDir.isValid()) {
+        fprintf(stderr, "Unable to create a directory in %s\n", QS_C(outInfo.absolutePath()));
+        pm().exit();
+        return RENDER_EXPORT_FAILED;
+    }
+
+    spec.exportdir = renderDir.path() + "/";
+    spec.allSheets = false;
+    spec.isRecording = false;
+    spec.data_width = 16;
+    spec.channels = 2;
+    spec.sample_rate = audiodevice().get_sample_rate();
+    spec.dither_type = GDitherTri;
+
+    connect(project, SIGNAL(overallExportProgressChanged(int)), this, SLOT(print_render_progress(int)));
+
+    QEventLoop loop;
+    connect(project, SIGNAL(exportFinished()), &loop, SLOT(quit()));
+
+    printf("Rendering sheet %d (%s) of project %s\n", sheetNumber, QS_C(sheet->get_name()), QS_C(projectname));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (project->export_project(&spec) < 0) {
+        pm().exit();
+        return RENDER_EXPORT_FAILED;
+    }
+
+    loop.exec();
+    spec.thread->wait();
+
+    qint64 elapsed = qMax(qint64(1), timer.elapsed());
+    printf("\n");
+
+    QStringList files = QDir(renderDir.path()).entryList(QDir::Files);
+
+    if (!spec.renderfinished || files.isEmpty()) {
+        fprintf(stderr, "Rendering sheet %d failed\n", sheetNumber);
+        pm().exit();
+        return RENDER_EXPORT_FAILED;
+    }
+
+    // One file per CD track if the sheet has CD track markers, the
+    // extra ones keep the name the sheet gave them
+    for (int i = 0; i < files.size(); ++i) {
+        QString destination = (i == 0) ? outInfo.absoluteFilePath() : outInfo.absolutePath() + "/" + files.at(i);
+        QFile::remove(destination);
+        if (!QFile::rename(renderDir.path() + "/" + files.at(i), destination)) {
+            fprintf(stderr, "Unable to move the rendered file to %s\n", QS_C(destination));
+            pm().exit();
+            return RENDER_EXPORT_FAILED;
+        }
+        printf("Wrote %s\n", QS_C(destination));
+    }
+
+    TimeRef renderLength = spec.endLocation - spec.startLocation;
+    double seconds = double(renderLength.universal_frame()) / UNIVERSAL_SAMPLE_RATE;
+
+    printf("Rendered %.1f seconds of audio in %.2f seconds (%.1fx realtime, %u frames per block)\n",
+           seconds, elapsed / 1000.0, seconds * 1000.0 / elapsed, spec.blocksize);
+
+    pm().exit();
+
+    return RENDER_SUCCESS;
+}
+
+void Traverso::print_info_message(InfoStruct message)
+{
+    if (message.type == INFO) {
+        printf("%s\n", QS_C(message.message));
+    } else {
+        fprintf(stderr, "%s\n", QS_C(message.message));
+    }
+}
+
+void Traverso::print_render_progress(int progress)
+{
+    printf("\rProgress: %d%%", progress);
+    fflush(stdout);
+}
+
 void Traverso::shutdown( int signal )
 {
     PENTER;
@@ -204,6 +376,23 @@ void Traverso::init_sse( )
         Mixer::apply_gain_to_buffer 	= x86_sse_apply_gain_to_buffer;
         Mixer::mix_buffers_with_gain 	= x86_sse_mix_buffers_with_gain;
         Mixer::mix_buffers_no_gain 	= x86_sse_mix_buffers_no_gain;
+#if defined (USE_XMMINTRIN)
+        Mixer::find_peaks		= x86_sse_find_peaks;
+        Mixer::convert_s16_to_float	= x86_sse_convert_s16_to_float;
+        Mixer::convert_s24_to_float	= x86_sse_convert_s24_to_float;
+        Mixer::convert_s32_to_float	= x86_sse_convert_s32_to_float;
+        Mixer::deinterleave		= x86_sse_deinterleave;
+        Mixer::deinterleave_s32_to_float = x86_sse_deinterleave_s32_to_float;
+        Mixer::interleave		= x86_sse_interleave;
+#else
+        Mixer::find_peaks		= default_find_peaks;
+        Mixer::convert_s16_to_float	= default_convert_s16_to_float;
+        Mixer::convert_s24_to_float	= default_convert_s24_to_float;
+        Mixer::convert_s32_to_float	= default_convert_s32_to_float;
+        Mixer::deinterleave		= default_deinterleave;
+        Mixer::deinterleave_s32_to_float = default_deinterleave_s32_to_float;
+        Mixer::interleave		= default_interleave;
+#endif
 
         generic_mix_functions = false;
 
@@ -220,6 +409,13 @@ void Traverso::init_sse( )
         Mixer::apply_gain_to_buffer   = veclib_apply_gain_to_buffer;
         Mixer::mix_buffers_with_gain  = veclib_mix_buffers_with_gain;
         Mixer::mix_buffers_no_gain    = veclib_mix_buffers_no_gain;
+        Mixer::find_peaks             = veclib_find_peaks;
+        Mixer::convert_s16_to_float   = veclib_convert_s16_to_float;
+        Mixer::convert_s24_to_float   = default_convert_s24_to_float;
+        Mixer::convert_s32_to_float   = veclib_convert_s32_to_float;
+        Mixer::deinterleave           = default_deinterleave;
+        Mixer::deinterleave_s32_to_float = default_deinterleave_s32_to_float;
+        Mixer::interleave             = default_interleave;
 
         generic_mix_functions = false;
 
@@ -237,6 +433,13 @@ void Traverso::init_sse( )
         Mixer::apply_gain_to_buffer 	= default_apply_gain_to_buffer;
         Mixer::mix_buffers_with_gain 	= default_mix_buffers_with_gain;
         Mixer::mix_buffers_no_gain 	= default_mix_buffers_no_gain;
+        Mixer::find_peaks		= default_find_peaks;
+        Mixer::convert_s16_to_float	= default_convert_s16_to_float;
+        Mixer::convert_s24_to_float	= default_convert_s24_to_float;
+        Mixer::convert_s32_to_float	= default_convert_s32_to_float;
+        Mixer::deinterleave		= default_deinterleave;
+        Mixer::deinterleave_s32_to_float = default_deinterleave_s32_to_float;
+        Mixer::interleave		= default_interleave;
 
         printf("No Hardware specific optimizations in use\n");
     }
@@ -26,6 +26,8 @@
 #include <QApplication>
 #include <QSessionManager>
 
+#include "Information.h"
+
 class Traverso : public QApplication
 {
 	Q_OBJECT
@@ -36,17 +38,33 @@ public :
         ~Traverso();
 
 
+        // Exit status of the command line render mode
+        enum RenderStatus {
+                RENDER_SUCCESS = 0,
+                RENDER_INVALID_ARGUMENTS = 1,
+                RENDER_PROJECT_LOAD_FAILED = 2,
+                RENDER_NO_SUCH_SHEET = 3,
+                RENDER_EXPORT_FAILED = 4
+        };
+
         void shutdown(int signal);
         void create_interface();
+        int render(const QString& projectFile, int sheetNumber, const QString& format, const QString& outFile);
 
 protected:
         void saveState ( QSessionManager& manager );
         void commitData ( QSessionManager& manager );
 
 private :
+        bool m_headless;
+
 	void init_sse();
 	void setup_fpu();
         void prepare_audio_device();
+
+private slots:
+        void print_info_message(InfoStruct message);
+        void print_render_progress(int progress);
 };
 
 #endif
@@ -90,7 +90,7 @@ void ExportDialog::on_startButton_clicked( )
 		return;
 	}
 	
-	connect(m_project, SIGNAL(sheetExportProgressChanged(int)), this, SLOT(update_sheet_progress(int)));
+	connect(m_project, SIGNAL(sheetExportProgressChanged(Sheet*,int)), this, SLOT(update_sheet_progress(Sheet*,int)));
 	connect(m_project, SIGNAL(overallExportProgressChanged(int)), this, SLOT(update_overall_progress(int)));
 	connect(m_project, SIGNAL(exportFinished()), this, SLOT(render_finished()));
 	connect(m_project, SIGNAL(exportStartedForSheet(Sheet*)), this, SLOT (set_exporting_sheet(Sheet*)));
@@ -106,6 +106,8 @@ void ExportDialog::on_startButton_clicked( )
 	} else {
                 m_exportSpec->allSheets = false;
 	}
+
+	m_exportSpec->stems = stemsCheckBox->isChecked();
 	
 	m_exportSpec->exportdir = exportDirName->text();
 	if (m_exportSpec->exportdir.size() > 1 && (m_exportSpec->exportdir.at(m_exportSpec->exportdir.size()-1).decomposition() != "/")) {
@@ -156,7 +158,7 @@ void ExportDialog::on_fileSelectButton_clicked( )
 }
 
 
-void ExportDialog::update_sheet_progress( int progress )
+void ExportDialog::update_sheet_progress(Sheet* sheet, int progress)
 {
 }
 
@@ -172,7 +174,7 @@ void ExportDialog::set_export_message(QString message)
 
 void ExportDialog::render_finished( )
 {
-	disconnect(m_project, SIGNAL(sheetExportProgressChanged(int)), this, SLOT(update_sheet_progress(int)));
+	disconnect(m_project, SIGNAL(sheetExportProgressChanged(Sheet*,int)), this, SLOT(update_sheet_progress(Sheet*,int)));
 	disconnect(m_project, SIGNAL(overallExportProgressChanged(int)), this, SLOT(update_overall_progress(int)));
 	disconnect(m_project, SIGNAL(exportFinished()), this, SLOT(render_finished()));
 	disconnect(m_project, SIGNAL(exportStartedForSheet(Sheet*)), this, SLOT (set_exporting_sheet(Sheet*)));
@@ -57,7 +57,7 @@ private:
 
 private slots:
 	void set_project(Project* project);
-	void update_sheet_progress(int progress);
+	void update_sheet_progress(Sheet* sheet, int progress);
 	void update_overall_progress(int progress);
 	void render_finished();
 	void set_exporting_sheet(Sheet* sheet);
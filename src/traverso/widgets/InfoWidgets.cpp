@@ -184,6 +184,7 @@ DriverInfo::DriverInfo( QWidget * parent )
 	setFrameStyle(QFrame::NoFrame);
 	
 	connect(&audiodevice(), SIGNAL(driverParamsChanged()), this, SLOT(update_driver_info()));
+	connect(&audiodevice(), SIGNAL(bufferSizeChanged()), this, SLOT(update_driver_info()));
 	connect(&audiodevice(), SIGNAL(bufferUnderRun()), this, SLOT(update_xrun_info()));
     connect(m_driver, SIGNAL(clicked( bool )), TMainWindow::instance(), SLOT(show_settings_dialog_sound_system_page()));
 	
@@ -562,17 +563,14 @@ ProgressToolBar::~ProgressToolBar()
 {
 }
 
+// The progress covers all files of the import, which are copied in parallel
 void ProgressToolBar::set_progress(int i)
 {
 	if (i == m_progressBar->maximum()) {
-		if (filenum == filecount) {
-			hide();
-			m_progressBar->reset();
-			m_progressBar->setEnabled(false);
-			return;
-		} else {
-			++filenum;
-		}
+		hide();
+		m_progressBar->reset();
+		m_progressBar->setEnabled(false);
+		return;
 	}
 
 	if (!m_progressBar->isEnabled()) {
@@ -587,6 +585,9 @@ void ProgressToolBar::set_label(QString s)
 {
 	Q_UNUSED(s);
 	m_progressBar->setFormat(tr("Importing file %1 of %2: %p%").arg(filenum).arg(filecount));
+	if (filenum < filecount) {
+		++filenum;
+	}
 }
 
 void ProgressToolBar::set_num_files(int i)